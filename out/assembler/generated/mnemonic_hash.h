@@ -0,0 +1,15 @@
+// Generated by gen_mnemonic_hash from mnemonics.def, do not edit
+#ifndef MNEMONIC_HASH_H
+#define MNEMONIC_HASH_H
+
+#define MNEMONIC_HASH_SEED 45549u
+#define MNEMONIC_HASH_SIZE 64
+
+static const int8_t mnemonic_slots[MNEMONIC_HASH_SIZE] = {
+    -1, 14, -1, 8, -1, 4, -1, 34, -1, 9, 28, 32, -1, 26, -1, 1,
+    -1, 33, 31, 3, 24, -1, 2, 25, 23, 10, -1, -1, 11, 27, -1, 35,
+    -1, -1, -1, 7, 13, 17, -1, 5, -1, 30, -1, 18, -1, -1, 0, 21,
+    -1, 20, -1, 22, -1, 19, 29, 36, 12, 16, -1, 15, -1, -1, -1, 6,
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "arena.h"
+
+static arena_block_t *arena_block_create(size_t size, arena_block_t *prev) {
+    arena_block_t *block = malloc(sizeof(arena_block_t) + size);
+    assert(block != NULL);
+    block->prev = prev;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+arena_t *arena_create(void) {
+    arena_t *arena = malloc(sizeof(arena_t));
+    assert(arena != NULL);
+    arena->head = arena_block_create(ARENA_BLOCK_SIZE, NULL);
+    arena->spare = NULL;
+    arena->intern_count = 0;
+    arena->intern_capacity = ARENA_INTERN_INITIAL_CAPACITY;
+    arena->interned = calloc(arena->intern_capacity, sizeof(const char *));
+    assert(arena->interned != NULL);
+    return arena;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    if (arena->head->used + size > arena->head->size) {
+        // Oversized allocations get a block of their own
+        if (size <= ARENA_BLOCK_SIZE && arena->spare) {
+            arena_block_t *block = arena->spare;
+            arena->spare = block->prev;
+            block->prev = arena->head;
+            block->used = 0;
+            arena->head = block;
+        } else {
+            size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+            arena->head = arena_block_create(block_size, arena->head);
+        }
+    }
+
+    void *ptr = arena->head->data + arena->head->used;
+    arena->head->used += size;
+    return ptr;
+}
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// FNV-1a
+static uint64_t intern_hash(const char *str) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (; *str; str++) {
+        hash = (hash ^ (unsigned char)*str) * 0x100000001b3;
+    }
+    return hash;
+}
+
+static void intern_grow(arena_t *arena) {
+    size_t capacity = arena->intern_capacity * 2;
+    const char **slots = calloc(capacity, sizeof(const char *));
+    assert(slots != NULL);
+
+    for (size_t i = 0; i < arena->intern_capacity; i++) {
+        const char *str = arena->interned[i];
+        if (!str) continue;
+        size_t j = intern_hash(str) & (capacity - 1);
+        while (slots[j]) j = (j + 1) & (capacity - 1);
+        slots[j] = str;
+    }
+
+    free(arena->interned);
+    arena->interned = slots;
+    arena->intern_capacity = capacity;
+}
+
+const char *arena_intern(arena_t *arena, const char *str) {
+    // Keep the set at most half full
+    if (2 * (arena->intern_count + 1) > arena->intern_capacity) {
+        intern_grow(arena);
+    }
+
+    size_t mask = arena->intern_capacity - 1;
+    size_t i = intern_hash(str) & mask;
+    while (arena->interned[i]) {
+        if (strcmp(arena->interned[i], str) == 0) return arena->interned[i];
+        i = (i + 1) & mask;
+    }
+
+    const char *copy = arena_strndup(arena, str, strlen(str));
+    arena->interned[i] = copy;
+    arena->intern_count++;
+    return copy;
+}
+
+static void free_blocks(arena_block_t *block) {
+    while (block) {
+        arena_block_t *prev = block->prev;
+        free(block);
+        block = prev;
+    }
+}
+
+void arena_reset(arena_t *arena) {
+    // The first block is always standard sized, so it becomes the head
+    arena_block_t *block = arena->head;
+    while (block->prev) {
+        arena_block_t *prev = block->prev;
+        if (block->size == ARENA_BLOCK_SIZE) {
+            block->prev = arena->spare;
+            arena->spare = block;
+        } else {
+            free(block);
+        }
+        block = prev;
+    }
+    block->used = 0;
+    arena->head = block;
+
+    memset(arena->interned, 0, arena->intern_capacity * sizeof(const char *));
+    arena->intern_count = 0;
+}
+
+void arena_destroy(arena_t *arena) {
+    if (!arena) return;
+    free_blocks(arena->head);
+    free_blocks(arena->spare);
+    free(arena->interned);
+    free(arena);
+}
@@ -0,0 +1,108 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+#define ARENA_INTERN_INITIAL_CAPACITY 256
+
+/**
+ * @struct arena_block
+ * @brief One contiguous region of an arena, chained to the previous block
+ */
+
+typedef struct arena_block {
+    struct arena_block *prev;
+    size_t size;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+/**
+ * @struct arena
+ * @brief Bump allocator for the lifetime of one assembly
+ *
+ * Allocations are never freed on their own, the whole arena is released
+ * at once with `arena_destroy`. Strings can be interned so that each
+ * distinct string is stored once
+ *
+ * @var head Block currently being allocated from
+ * @var spare Standard sized blocks kept by `arena_reset` for reuse
+ * @var interned Open addressing set of interned strings
+ * @var intern_count Number of interned strings
+ * @var intern_capacity Number of slots in the intern set (a power of two)
+ */
+
+typedef struct arena {
+    arena_block_t *head;
+    arena_block_t *spare;
+    const char **interned;
+    size_t intern_count;
+    size_t intern_capacity;
+} arena_t;
+
+/**
+ * @brief Creates a new, empty arena
+ * @return Pointer to the newly created arena
+ */
+
+arena_t *arena_create(void);
+
+/**
+ * @brief Allocates `size` bytes from the arena, aligned to ARENA_ALIGNMENT
+ *
+ * @param arena Arena to allocate from
+ * @param size Number of bytes
+ * @return Pointer to the uninitialised memory
+ */
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * @brief Copies the first `len` bytes of a string into the arena
+ *
+ * @param arena Arena to allocate from
+ * @param str String to copy
+ * @param len Number of bytes to copy
+ * @return Null terminated copy
+ */
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+
+/**
+ * @brief Returns the arena's copy of a string, copying it in the first time
+ *
+ * Equal strings interned in the same arena share one pointer
+ *
+ * @param arena Arena to intern into
+ * @param str Null terminated string
+ * @return Interned copy of `str`
+ */
+
+const char *arena_intern(arena_t *arena, const char *str);
+
+/**
+ * @brief Releases everything allocated from the arena, keeping its memory
+ *
+ * Standard sized blocks and the intern set are kept for the next
+ * allocations, so an arena reused across assemblies stops calling malloc
+ * once it has grown to fit them. Oversized blocks are freed
+ *
+ * @param arena Arena to reset
+ */
+
+void arena_reset(arena_t *arena);
+
+/**
+ * @brief Frees every block of the arena and the arena itself
+ * @param arena Arena to destroy
+ */
+
+void arena_destroy(arena_t *arena);
+
+#endif
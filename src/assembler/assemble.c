@@ -2,52 +2,280 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 
-#include "symbol_table.h"
 #include "tokens.h"
 #include "parser.h"
 #include "encoding_functions.h"
 #include "assemble_utils.h"
-#include "storing_labels.h"
+#include "object.h"
+#include "cache.h"
+#include "batch.h"
+#include "listing.h"
+#include "peephole.h"
+#include "layout.h"
+
+// Creates an empty file, exiting if it cannot be created
+static void create_empty_file(
+    const char *filename
+) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to create file");
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);  // Close immediately to leave it empty
+}
+
+// Opens a file, exiting if it cannot be opened
+static FILE* load_file(
+    const char* filename, 
+    const char* mode
+) {
+    FILE *file = fopen(filename, mode);
+    if (!file) {
+        perror("Error opening file");
+        exit(EXIT_FAILURE);
+    }
+    return file;
+}
+
+static int usage(void) {
+    printf("Usage: ./assemble [-j <threads> | --stream | -c] [-O] [--linemap <out.map>]\n");
+    printf("                  [--listing <out.lst>] [--cache-dir <dir>] <file_in> [<file_out>]\n");
+    printf("       ./assemble --batch <list> [-j <threads>] [-c]\n");
+    return EXIT_FAILURE;
+}
 
 int main(int argc, char **argv) {
 
-   if (argc > 3 || argc < 2) {
-        printf("Usage: ./assemble <file_in> [<file_out>]\n");
-        return EXIT_FAILURE;
+    char *linemap_file = NULL;
+    char *listing_file = NULL;
+    char *cache_dir = NULL;
+    char *batch_list = NULL;
+    int threads = 1;
+    bool streaming = false;
+    bool object = false;
+    bool optimise = false;
+    char *files[2] = { NULL, NULL }; // Input and optional output file
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--linemap") == 0 && i + 1 < argc) {
+            linemap_file = argv[++i];
+        } else if (strcmp(argv[i], "--listing") == 0 && i + 1 < argc) {
+            listing_file = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_list = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) return usage();
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            streaming = true;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            object = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimise = true;
+        } else if (argv[i][0] != '-' && file_count < 2) {
+            files[file_count++] = argv[i];
+        } else {
+            return usage();
+        }
     }
 
-    char* in_file_name = argv[1];
+    // In batch mode the threads assemble whole sources side by side, each
+    // written next to its source
+    if (batch_list) {
+        if (file_count > 0 || streaming || optimise || linemap_file || listing_file || cache_dir) {
+            return usage();
+        }
+        return assemble_batch(batch_list, threads, object) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Streaming and objects rely on the single pass encoding as it parses,
+    // and the optimiser needs every instruction before any is encoded
+    if (file_count == 0 || (streaming + object + (threads > 1) > 1) || (streaming && optimise)) {
+        return usage();
+    }
+
+    char* in_file_name = files[0];
     FILE *file_in = load_file(in_file_name, "r");
     FILE* file_out; // Stdout or output file pointer
 
-    if (argc == 3) {
-        create_empty_file(argv[2]);
-        file_out = load_file(argv[2], "wb");
+    if (files[1]) {
+        create_empty_file(files[1]);
+        file_out = load_file(files[1], "wb");
     } else {
         file_out = stdout;
     }
 
+    // The line map names the source, so its path is part of the key then
+    char options[64 + FILENAME_MAX];
+    snprintf(options, sizeof(options), "object=%d optimise=%d linemap=%s listing=%d", object, optimise,
+        linemap_file ? in_file_name : "", listing_file != NULL);
+    char cache_entry[CACHE_KEY_SIZE];
+    bool cached = cache_dir && cache_key(file_in, options, cache_entry);
+
+    if (cached && cache_fetch(cache_dir, cache_entry, file_out, linemap_file, listing_file)) {
+        fclose(file_in);
+        return fclose(file_out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // On a miss the output is built in memory, to go to both the real
+    // output and the cache
+    FILE *cache_out = file_out;
+    char *output = NULL;
+    size_t output_size = 0;
+    if (cached) {
+        file_out = open_memstream(&output, &output_size);
+        assert(file_out != NULL);
+    }
+
+    listing_t *listing = NULL;
+    if (listing_file) {
+        listing = listing_open(listing_file, in_file_name);
+        if (!listing) exit(EXIT_FAILURE);
+    }
+
+    // Errors are gathered while the source is assembled and reported
+    // together, in source order, once it is done
+    diag_list_t diags;
+    diag_list_init(&diags);
+    diag_set_sink(&diags);
+    diag_set_file(in_file_name);
+
     parser_state_t *parser_state = create_parser_state();
+    parser_state->relocatable = object;
 
-    // FIRST PASS:
-    //     Populate the symbol table with labels and addresses
-    symbol_table s_table = symbol_table_create();
-    fill_symbol_table(file_in, s_table);
+    // In streaming mode instructions are written out as soon as every
+    // label they refer to is resolved, rather than all at the end, and
+    // the listing follows along
+    instruction_stream_t stream = { .out = file_out, .keep_lines = linemap_file != NULL, .listing = listing };
+    if (streaming) {
+        parser_state->sink = stream_instructions;
+        parser_state->sink_context = &stream;
+    }
 
-    // SECOND PASS:
-    //     Tokenize, and parse instructions and fill in
-    //     `parser_state->instructions`
-    parse(parser_state, file_in);
+    if (threads > 1 || optimise) {
+        // WITH THREADS OR OPTIMISING:
+        //     Tokenize and parse chunks of the source concurrently and merge
+        //     them, or parse it in one go without encoding, then relax the
+        //     conditional branches that cannot reach their label, rewrite the
+        //     instructions with the peephole optimiser if asked to, and
+        //     encode the instruction array in chunks across the threads
+        //     against the complete symbol table
+        if (threads > 1) {
+            parse_parallel(parser_state, file_in, threads);
+        } else {
+            parser_state->defer_encoding = true;
+            parse(parser_state, file_in);
+        }
+        relax_branches(parser_state);
+        if (optimise) {
+            peephole_optimise(parser_state);
+        }
 
-    // After we've parsed the instructions (located inside
-    // `parser_state->instructions` array), handle the instruction
-    // to binary encoding logic
-    encode_instructions(parser_state->instructions, parser_state->instruction_count, s_table);
+        if (object) {
+            // Labels this source does not define are left as fixups, to
+            // become relocations
+            for (int i = 0; i < parser_state->instruction_count; i++) {
+                encode_instruction(&parser_state->instructions[i], i, parser_state->symbols, parser_state->fixups);
+            }
+        } else {
+            encode_instructions_parallel(parser_state->instructions, parser_state->instruction_count,
+                parser_state->symbols, threads);
+        }
+    } else {
+        // SINGLE PASS:
+        //     Tokenize, parse and encode instructions into
+        //     `parser_state->instructions`, recording labels as they are
+        //     reached and patching forward references once their label is seen
+        parse(parser_state, file_in);
+    }
+
+    diag_set_sink(NULL);
+    diag_list_sort(&diags);
+    diag_list_print(&diags, stderr);
+    diag_list_free(&diags);
+    int status = diag_error_count() > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    if (status == EXIT_FAILURE) {
+        // Leave no binary, object or listing behind, not even what
+        // streaming wrote already, so a build never takes them for up to
+        // date ones. No line map is written either
+        if (listing) {
+            listing_close(listing);
+            remove(listing_file);
+        }
+        fclose(file_out);
+        if (cached) {
+            fclose(cache_out);
+            free(output);
+        }
+        if (files[1]) remove(files[1]);
+        free(stream.lines);
+        free_parser_state(parser_state);
+        return status;
+    }
 
-    // Print the instructions to output file
-    print_instructions_to_binary(file_out, parser_state->instructions, parser_state->instruction_count);
+    if (listing) {
+        if (!streaming) {
+            listing_add(listing, parser_state->instructions, parser_state->instruction_count);
+        }
+        if (!listing_close(listing)) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if (object) {
+        // Relocatable object for the linker instead of a flat binary
+        object_t *obj = object_build(parser_state->instructions, parser_state->instruction_count,
+            parser_state->symbols, parser_state->fixups);
+        if (!obj || !object_write(file_out, obj)) {
+            status = EXIT_FAILURE;
+        }
+        object_free(obj);
+        fclose(file_out);
+
+        if (linemap_file && !write_linemap(linemap_file, in_file_name,
+                parser_state->instructions, parser_state->instruction_count)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (streaming) {
+        if (fclose(file_out) != 0 || stream.failed) {
+            status = EXIT_FAILURE;
+        }
+        if (linemap_file && !linemap_write(linemap_file, in_file_name, stream.lines, stream.line_count)) {
+            status = EXIT_FAILURE;
+        }
+        free(stream.lines);
+    } else {
+        // Print the instructions to output file
+        if (!print_instructions_to_binary(file_out, parser_state->instructions, parser_state->instruction_count)) {
+            status = EXIT_FAILURE;
+        }
+
+        if (linemap_file && !write_linemap(linemap_file, in_file_name,
+                parser_state->instructions, parser_state->instruction_count)) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if (cached) {
+        // file_out was closed above, which finalises `output`
+        if (fwrite(output, 1, output_size, cache_out) != output_size) {
+            status = EXIT_FAILURE;
+        }
+        if (fclose(cache_out) != 0) status = EXIT_FAILURE;
+        // The cache key only covers the source, not the files it includes
+        if (status == EXIT_SUCCESS && !parser_state->includes_files) {
+            cache_store(cache_dir, cache_entry, output, output_size, linemap_file, listing_file);
+        }
+        free(output);
+    }
 
     free_parser_state(parser_state);
-    symbol_table_free(s_table);
+    return status;
 }
@@ -1,52 +1,123 @@
+#include <assert.h>
 #include "assemble_utils.h"
 
-void print_instructions_to_binary(FILE *file_out, instruction_t ** instructions, int instruction_count) {
-    if (!file_out) return;
-    for (int i = 0; i < instruction_count; i++) {
-        uint32_t word = instructions[i]->encoded;
-        fwrite(&word, sizeof(uint32_t), 1, file_out);
+// Copies the file of an `.incbin` into `out` a buffer at a time, so it
+// is never held in memory whole
+static bool write_included_file(FILE *out, const instruction_t *instr) {
+    FILE *in = fopen(instr->data_file, "rb");
+    if (!in) {
+        perror(instr->data_file);
+        return false;
+    }
+
+    char buffer[INCLUDE_BUFFER_SIZE];
+    uint32_t remaining = instr->size;
+    while (remaining > 0) {
+        size_t n = fread(buffer, 1, remaining < sizeof(buffer) ? remaining : sizeof(buffer), in);
+        if (n == 0 || fwrite(buffer, 1, n, out) != n) break;
+        remaining -= n;
     }
-    fclose(file_out);
+    fclose(in);
+
+    if (remaining > 0) {
+        fprintf(stderr, "Error: Failed to include '%s'\n", instr->data_file);
+    }
+    return remaining == 0;
 }
 
-const char *resolve_alias_mnemonic(const char *mnemonic) {
-    if (strcmp(mnemonic, "cmp") == 0)     return "subs";
-    if (strcmp(mnemonic, "cmn") == 0)     return "adds";
-    if (strcmp(mnemonic, "neg") == 0)     return "sub";
-    if (strcmp(mnemonic, "negs") == 0)    return "subs";
-    if (strcmp(mnemonic, "tst") == 0)     return "ands";
-    if (strcmp(mnemonic, "mvn") == 0)     return "orn";
-    if (strcmp(mnemonic, "mov") == 0)     return "orr";
-    if (strcmp(mnemonic, "mul") == 0)     return "madd";
-    if (strcmp(mnemonic, "mneg") == 0)    return "msub";
+static bool write_data(FILE *out, const instruction_t *instr) {
+    if (instr->data) {
+        return fwrite(instr->data, 1, instr->size, out) == instr->size;
+    }
+    if (instr->data_file) {
+        return write_included_file(out, instr);
+    }
 
-    // Not an alias, return as-is
-    return mnemonic;
+    static const char zeros[INCLUDE_BUFFER_SIZE];
+    for (uint32_t remaining = instr->size; remaining > 0; ) {
+        size_t n = remaining < sizeof(zeros) ? remaining : sizeof(zeros);
+        if (fwrite(zeros, 1, n, out) != n) return false;
+        remaining -= n;
+    }
+    return true;
 }
 
-int string_to_immediate(char *value) {
-    return (uint32_t) strtol(value, NULL, 0); // base 0 auto-detects hex (0x) or decimal;
+bool write_encoded_instructions(FILE *file_out, instruction_t *instructions, int instruction_count) {
+    if (instruction_count == 0) return true;
+
+    // Gather each run of words into one buffer rather than writing them
+    // one by one, and write the data between runs as it is
+    uint32_t *words = malloc(sizeof(uint32_t) * instruction_count);
+    assert(words != NULL);
+
+    bool ok = true;
+    int run = 0;
+    for (int i = 0; i <= instruction_count && ok; i++) {
+        if (i < instruction_count && instructions[i].type != INSTR_DATA) {
+            words[run++] = instructions[i].encoded;
+            continue;
+        }
+
+        ok = fwrite(words, sizeof(uint32_t), run, file_out) == (size_t)run;
+        run = 0;
+        if (ok && i < instruction_count) {
+            ok = write_data(file_out, &instructions[i]);
+        }
+    }
+    free(words);
+    return ok;
 }
 
-void create_empty_file(
-    const char *filename
-) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror("Failed to create file");
-        exit(EXIT_FAILURE);
+bool print_instructions_to_binary(FILE *file_out, instruction_t *instructions, int instruction_count) {
+    if (!file_out) return false;
+    bool ok = write_encoded_instructions(file_out, instructions, instruction_count);
+    return fclose(file_out) == 0 && ok;
+}
+
+// Fills `entries` for the instructions that are not directives or data and
+// returns how many there are
+static uint32_t collect_line_entries(linemap_entry_t *entries, instruction_t *instructions, int instruction_count) {
+    uint32_t count = 0;
+    for (int i = 0; i < instruction_count; i++) {
+        if (instructions[i].type == INSTR_DIRECTIVE || instructions[i].type == INSTR_DATA) continue;
+        entries[count].address = instructions[i].instr_address;
+        entries[count].line = instructions[i].line;
+        count++;
     }
-    fclose(file);  // Close immediately to leave it empty
+    return count;
 }
 
-FILE* load_file(
-    const char* filename, 
-    const char* mode
-) {
-    FILE *file = fopen(filename, mode);
-    if (!file) {
-        perror("Error opening file");
-        exit(EXIT_FAILURE);
+void stream_instructions(void *context, instruction_t *instructions, int instruction_count) {
+    instruction_stream_t *stream = context;
+    if (!write_encoded_instructions(stream->out, instructions, instruction_count)) {
+        stream->failed = true;
+    }
+    if (stream->listing) {
+        listing_add(stream->listing, instructions, instruction_count);
     }
-    return file;
-}
\ No newline at end of file
+    if (!stream->keep_lines) return;
+
+    uint32_t needed = stream->line_count + instruction_count;
+    if (needed > stream->line_capacity) {
+        while (stream->line_capacity < needed) {
+            stream->line_capacity = stream->line_capacity ? stream->line_capacity * 2 : 1024;
+        }
+        stream->lines = realloc(stream->lines, sizeof(linemap_entry_t) * stream->line_capacity);
+        assert(stream->lines != NULL);
+    }
+    stream->line_count += collect_line_entries(&stream->lines[stream->line_count], instructions, instruction_count);
+}
+
+bool write_linemap(const char *filename, const char *source, instruction_t *instructions, int instruction_count) {
+    linemap_entry_t *entries = malloc(sizeof(linemap_entry_t) * (instruction_count ? instruction_count : 1));
+    assert(entries != NULL);
+
+    uint32_t count = collect_line_entries(entries, instructions, instruction_count);
+    bool ok = linemap_write(filename, source, entries, count);
+    free(entries);
+    return ok;
+}
+
+int string_to_immediate(char *value) {
+    return (uint32_t) strtol(value, NULL, 0); // base 0 auto-detects hex (0x) or decimal;
+}
@@ -3,64 +3,95 @@
 
 #include <stdio.h>
 #include "instruction_representation.h"
+#include "linemap.h"
+#include "listing.h"
 
 /**
- * @brief Writes encoded instructions to a binary file
+ * @struct instruction_stream_t
+ * @brief Destination of instructions written out while the source is still being parsed
+ *
+ * @var out File the encoded words are appended to
+ * @var keep_lines Whether to collect line map entries for the instructions
+ * @var lines Line map entries collected so far
+ * @var line_count Number of entries in `lines`
+ * @var line_capacity Capacity of `lines`
+ * @var listing Listing fed the instructions as they are written, or NULL
+ * @var failed Set once a write or an included file has failed
+ */
+
+typedef struct {
+    FILE *out;
+    bool keep_lines;
+    linemap_entry_t *lines;
+    uint32_t line_count;
+    uint32_t line_capacity;
+    listing_t *listing;
+    bool failed;
+} instruction_stream_t;
+
+// Size of the buffer files included with `.incbin` are copied through
+#define INCLUDE_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Writes the encodings of instructions to a binary file
+ *
+ * Runs of instruction words go out in a single write each, and the data
+ * between them as it is, with `.incbin` files copied in a buffer at a time
  *
  * @param file_out File pointer opened in binary write mode
- * @param instructions Array of pointers to instruction_t structures
+ * @param instructions Array of instructions
  * @param instruction_count Number of instructions to write
+ * @return true on success, false if the write or an included file failed
  */
 
-void print_instructions_to_binary(FILE *, instruction_t **, int);
+bool write_encoded_instructions(FILE *, instruction_t *, int);
 
 /**
- * @brief Resolves alias mnemonics to their actual instruction counterparts
- *
- * If the mnemonic is not an alias, it is returned unchanged
+ * @brief Writes encoded instructions to a binary file and closes it
  *
- * @param mnemonic The mnemonic to resolve
- * @return A string representing the actual instruction mnemonic
+ * @param file_out File pointer opened in binary write mode
+ * @param instructions Array of instructions
+ * @param instruction_count Number of instructions to write
+ * @return true on success, false if writing or closing the file failed
  */
 
-const char *resolve_alias_mnemonic(const char *);
+bool print_instructions_to_binary(FILE *, instruction_t *, int);
 
 /**
- * @brief Converts a string to an integer, detecting the numeric base
+ * @brief Appends a run of final instructions to an instruction stream
  *
- * Automatically detects base from string prefix
+ * Matches `instruction_sink_t`, so it can be handed to the parser
  *
- * @param value String containing the numeric value
- * @return The parsed integer value
+ * @param stream Pointer to the instruction_stream_t
+ * @param instructions Array of instructions whose encodings will not change
+ * @param instruction_count Number of instructions
  */
 
-int string_to_immediate(char *);
+void stream_instructions(void *, instruction_t *, int);
 
 /**
- * @brief Creates an empty file with the specified name
+ * @brief Writes the address to source line table for the instructions
  *
- * If the file cannot be created, the function exits the program with failure
+ * Directives and data are left out, so the table only covers executable code
  *
- * @param filename Name of the file to create
+ * @param filename Name of the line map file to write
+ * @param source Name of the assembly source file
+ * @param instructions Array of instructions
+ * @param instruction_count Number of instructions
+ * @return true on success, false on failure
  */
 
-void create_empty_file(
-    const char *filename
-);
+bool write_linemap(const char *, const char *, instruction_t *, int);
 
 /**
- * @brief Opens a file with the given mode
+ * @brief Converts a string to an integer, detecting the numeric base
  *
- * Exits the program with failure if the file cannot be opened
+ * Automatically detects base from string prefix
  *
- * @param filename Name of the file to open
- * @param mode Mode to open the file in
- * @return FILE pointer to the opened file
+ * @param value String containing the numeric value
+ * @return The parsed integer value
  */
 
-FILE* load_file(
-    const char* filename, 
-    const char* mode
-);
+int string_to_immediate(char *);
 
 #endif
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "batch.h"
+#include "parser.h"
+#include "assemble_utils.h"
+#include "object.h"
+#include "diagnostics.h"
+
+typedef struct {
+    char **sources;
+    int source_count;
+    bool object;
+    diag_list_t *diags; // One list per source
+    atomic_int next_source;
+} batch_job_t;
+
+// Reads the paths in the list file into a newly allocated array
+static char **read_source_list(const char *list_file, int *count) {
+    FILE *list = fopen(list_file, "r");
+    if (!list) {
+        perror("Failed to open batch list");
+        return NULL;
+    }
+
+    int capacity = BATCH_INITIAL_CAPACITY;
+    char **sources = malloc(sizeof(char *) * capacity);
+    assert(sources != NULL);
+    *count = 0;
+
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    while ((length = getline(&line, &line_size, list)) != -1) {
+        while (length > 0 && isspace((unsigned char)line[length - 1])) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') continue;
+
+        if (*count >= capacity) {
+            capacity *= 2;
+            sources = realloc(sources, sizeof(char *) * capacity);
+            assert(sources != NULL);
+        }
+        sources[(*count)++] = strdup(line);
+    }
+    free(line);
+    fclose(list);
+    return sources;
+}
+
+// Returns a newly allocated copy of `source` with its extension, if any,
+// replaced by `extension`
+static char *output_path(const char *source, const char *extension) {
+    const char *name = strrchr(source, '/');
+    name = name ? name + 1 : source;
+    const char *dot = strrchr(name, '.');
+    size_t stem = dot && dot != name ? (size_t)(dot - source) : strlen(source);
+
+    size_t size = stem + strlen(extension) + 2;
+    char *path = malloc(size);
+    assert(path != NULL);
+    snprintf(path, size, "%.*s.%s", (int)stem, source, extension);
+    return path;
+}
+
+// Assembles one source in a single pass and writes its output if it had
+// no errors, which are collected in `diags`
+static void assemble_source(const char *source, arena_t *arena, bool object, diag_list_t *diags) {
+    diag_set_sink(diags);
+    diag_set_file(source);
+    char *out_path = output_path(source, object ? "o" : "bin");
+    if (strcmp(out_path, source) == 0) {
+        diag_error(0, "Error: Output would overwrite the source\n");
+        free(out_path);
+        return;
+    }
+
+    FILE *file_in = fopen(source, "r");
+    if (!file_in) {
+        diag_error(0, "Error: Failed to open source\n");
+        free(out_path);
+        return;
+    }
+
+    parser_state_t *parser_state = create_parser_state_in_arena(arena);
+    parser_state->relocatable = object;
+    parse(parser_state, file_in);
+
+    if (diags->count == 0) {
+        FILE *file_out = fopen(out_path, "wb");
+        bool ok = file_out != NULL;
+        if (ok && object) {
+            object_t *obj = object_build(parser_state->instructions, parser_state->instruction_count,
+                parser_state->symbols, parser_state->fixups);
+            ok = obj && object_write(file_out, obj);
+            object_free(obj);
+        } else if (ok) {
+            ok = write_encoded_instructions(file_out, parser_state->instructions,
+                parser_state->instruction_count);
+        }
+        if (file_out && fclose(file_out) != 0) ok = false;
+        if (!ok) {
+            diag_error(0, "Error: Failed to write %s\n", out_path);
+        }
+    } else {
+        // Leave no stale output behind from an earlier, successful build
+        remove(out_path);
+    }
+
+    free_parser_state(parser_state);
+    free(out_path);
+}
+
+static void *batch_worker(void *arg) {
+    batch_job_t *job = arg;
+
+    // Every source this thread takes reuses the same arena
+    arena_t *arena = arena_create();
+    for (;;) {
+        int i = atomic_fetch_add(&job->next_source, 1);
+        if (i >= job->source_count) break;
+
+        assemble_source(job->sources[i], arena, job->object, &job->diags[i]);
+        arena_reset(arena);
+    }
+    diag_set_sink(NULL);
+    diag_set_file(NULL);
+    arena_destroy(arena);
+    return NULL;
+}
+
+bool assemble_batch(const char *list_file, int threads, bool object) {
+    batch_job_t job = { .object = object };
+    job.sources = read_source_list(list_file, &job.source_count);
+    if (!job.sources) return false;
+
+    job.diags = malloc(sizeof(diag_list_t) * (job.source_count ? job.source_count : 1));
+    assert(job.diags != NULL);
+    atomic_init(&job.next_source, 0);
+    for (int i = 0; i < job.source_count; i++) {
+        diag_list_init(&job.diags[i]);
+    }
+
+    // The calling thread takes sources alongside the pool
+    if (threads > job.source_count) threads = job.source_count;
+    pthread_t *pool = malloc(sizeof(pthread_t) * (threads > 1 ? threads - 1 : 1));
+    assert(pool != NULL);
+    int started = 0;
+    for (; started < threads - 1; started++) {
+        if (pthread_create(&pool[started], NULL, batch_worker, &job) != 0) break;
+    }
+    batch_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool[i], NULL);
+    }
+
+    bool ok = true;
+    for (int i = 0; i < job.source_count; i++) {
+        diag_list_t *diags = &job.diags[i];
+        diag_list_sort(diags);
+        diag_list_print(diags, stderr);
+        if (diags->count > 0) ok = false;
+        diag_list_free(diags);
+        free(job.sources[i]);
+    }
+    free(pool);
+    free(job.diags);
+    free(job.sources);
+    return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+#define BATCH_INITIAL_CAPACITY 64
+
+/**
+ * @brief Assembles every source named in a list file, several at a time
+ *
+ * The list holds one path per line; blank lines and lines starting with
+ * '#' are skipped. Each source is assembled in one pass by one of the
+ * threads, which reuse a single arena between the files they take. The
+ * output is written next to its source with the extension replaced by
+ * `.bin`, or `.o` for objects, and only when the source assembled without
+ * errors. Diagnostics are printed to stderr in list order once every file
+ * is done, each prefixed with the path of its source
+ *
+ * @param list_file Path of the list of sources
+ * @param threads Number of sources assembled at once
+ * @param object Whether to write relocatable objects instead of flat binaries
+ * @return true if every source assembled, false otherwise
+ */
+
+bool assemble_batch(const char *list_file, int threads, bool object);
+
+#endif
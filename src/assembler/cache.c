@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+// Two FNV-1a style lanes with different primes, mixed together at the end
+typedef struct {
+    uint64_t lanes[2];
+    uint64_t length;
+} cache_hash_t;
+
+static void hash_init(cache_hash_t *hash) {
+    hash->lanes[0] = 0xcbf29ce484222325;
+    hash->lanes[1] = 0x84222325cbf29ce4;
+    hash->length = 0;
+}
+
+static void hash_update(cache_hash_t *hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    uint64_t a = hash->lanes[0], b = hash->lanes[1];
+    for (size_t i = 0; i < len; i++) {
+        a = (a ^ bytes[i]) * 0x100000001b3;
+        b = (b ^ bytes[i]) * 0x9E3779B97F4A7C15;
+    }
+    hash->lanes[0] = a;
+    hash->lanes[1] = b;
+    hash->length += len;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccd;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53;
+    x ^= x >> 33;
+    return x;
+}
+
+bool cache_key(FILE *source, const char *options, char key[CACHE_KEY_SIZE]) {
+    struct stat st;
+    if (fstat(fileno(source), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    cache_hash_t hash;
+    hash_init(&hash);
+    // The null terminators keep the fields from running into each other
+    hash_update(&hash, ASSEMBLER_VERSION, sizeof(ASSEMBLER_VERSION));
+    hash_update(&hash, options, strlen(options) + 1);
+
+    char *buffer = malloc(CACHE_READ_SIZE);
+    if (!buffer) return false;
+    size_t n;
+    while ((n = fread(buffer, 1, CACHE_READ_SIZE, source)) > 0) {
+        hash_update(&hash, buffer, n);
+    }
+    free(buffer);
+
+    bool ok = !ferror(source) && fseek(source, 0, SEEK_SET) == 0;
+    uint64_t high = mix(hash.lanes[0] ^ hash.length);
+    uint64_t low = mix(hash.lanes[1] ^ high);
+    snprintf(key, CACHE_KEY_SIZE, "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+    return ok;
+}
+
+// Returns a newly allocated "dir/key.extension"
+static char *entry_path(const char *dir, const char *key, const char *extension) {
+    size_t size = strlen(dir) + CACHE_KEY_SIZE + strlen(extension) + 2;
+    char *path = malloc(size);
+    if (path) snprintf(path, size, "%s/%s.%s", dir, key, extension);
+    return path;
+}
+
+static bool copy_stream(FILE *from, FILE *to) {
+    char *buffer = malloc(CACHE_READ_SIZE);
+    if (!buffer) return false;
+
+    bool ok = true;
+    size_t n;
+    while (ok && (n = fread(buffer, 1, CACHE_READ_SIZE, from)) > 0) {
+        ok = fwrite(buffer, 1, n, to) == n;
+    }
+    free(buffer);
+    return ok && !ferror(from);
+}
+
+// Copies the file at `from` to the file at `to`
+static bool copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    if (!in) return false;
+    FILE *out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    bool ok = copy_stream(in, out);
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+bool cache_fetch(const char *dir, const char *key, FILE *out, const char *linemap_file, const char *listing_file) {
+    char *bin_path = entry_path(dir, key, "bin");
+    char *map_path = entry_path(dir, key, "map");
+    char *lst_path = entry_path(dir, key, "lst");
+    FILE *bin = bin_path ? fopen(bin_path, "rb") : NULL;
+    bool hit = bin != NULL && map_path != NULL && lst_path != NULL;
+
+    // Check the line map and listing are there before writing anything out
+    if (hit && linemap_file) {
+        hit = access(map_path, R_OK) == 0 && copy_file(map_path, linemap_file);
+    }
+    if (hit && listing_file) {
+        hit = access(lst_path, R_OK) == 0 && copy_file(lst_path, listing_file);
+    }
+    if (hit) {
+        hit = copy_stream(bin, out);
+    }
+
+    if (bin) fclose(bin);
+    free(bin_path);
+    free(map_path);
+    free(lst_path);
+    return hit;
+}
+
+// Moves a finished temporary file into place as a cache entry
+static void publish(const char *tmp_path, const char *path, bool ok) {
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+}
+
+void cache_store(const char *dir, const char *key, const char *data, size_t size, const char *linemap_file,
+        const char *listing_file) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror("Failed to create cache directory");
+        return;
+    }
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "tmp.%ld", (long)getpid());
+    char *bin_path = entry_path(dir, key, "bin");
+    char *map_path = entry_path(dir, key, "map");
+    char *lst_path = entry_path(dir, key, "lst");
+    char *tmp_path = entry_path(dir, key, suffix);
+
+    if (bin_path && map_path && lst_path && tmp_path) {
+        // The line map and listing go in first, so an entry whose binary is
+        // there is complete
+        if (linemap_file) {
+            publish(tmp_path, map_path, copy_file(linemap_file, tmp_path));
+        }
+        if (listing_file) {
+            publish(tmp_path, lst_path, copy_file(listing_file, tmp_path));
+        }
+
+        FILE *tmp = fopen(tmp_path, "wb");
+        if (tmp) {
+            bool ok = fwrite(data, 1, size, tmp) == size;
+            publish(tmp_path, bin_path, fclose(tmp) == 0 && ok);
+        }
+    }
+
+    free(bin_path);
+    free(map_path);
+    free(lst_path);
+    free(tmp_path);
+}
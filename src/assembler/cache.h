@@ -0,0 +1,62 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Defined by the Makefile from a checksum of the assembler's sources, so
+// a rebuilt assembler never reuses output from an older one
+#ifndef ASSEMBLER_VERSION
+#define ASSEMBLER_VERSION "unversioned"
+#endif
+
+#define CACHE_KEY_SIZE 33 // 32 hex digits and a null terminator
+#define CACHE_READ_SIZE (64 * 1024)
+
+/**
+ * @brief Computes the cache key of an assembly
+ *
+ * The key is a 128-bit hash of the assembler version, the options that
+ * change the output and every byte of the source. Only regular files can
+ * be hashed, as the source is read once here and again by the tokeniser
+ *
+ * @param source Source file, rewound to the start afterwards
+ * @param options Options that change the output, as a string
+ * @param key Buffer the key is written to in hex
+ * @return true on success, false if the source cannot be cached
+ */
+
+bool cache_key(FILE *source, const char *options, char key[CACHE_KEY_SIZE]);
+
+/**
+ * @brief Copies the cached output of an assembly to its destinations
+ *
+ * @param dir Cache directory
+ * @param key Key of the assembly
+ * @param out Stream the binary is written to
+ * @param linemap_file Path the line map is copied to, or NULL
+ * @param listing_file Path the listing is copied to, or NULL
+ * @return true on a hit, false if anything needed is not cached
+ */
+
+bool cache_fetch(const char *dir, const char *key, FILE *out, const char *linemap_file, const char *listing_file);
+
+/**
+ * @brief Adds the output of an assembly to the cache
+ *
+ * Entries are written under a temporary name and renamed into place, so
+ * concurrent builds sharing the directory never see a partial entry
+ *
+ * @param dir Cache directory, created if it does not exist
+ * @param key Key of the assembly
+ * @param data Binary output
+ * @param size Size of the binary output in bytes
+ * @param linemap_file Path of the line map written alongside, or NULL
+ * @param listing_file Path of the listing written alongside, or NULL
+ */
+
+void cache_store(const char *dir, const char *key, const char *data, size_t size, const char *linemap_file,
+    const char *listing_file);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include "diagnostics.h"
+
+static _Thread_local diag_list_t *current_sink = NULL;
+static _Thread_local const char *current_file = NULL;
+static atomic_int error_count = 0;
+
+void diag_list_init(diag_list_t *list) {
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void diag_list_free(diag_list_t *list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].message);
+    }
+    free(list->items);
+    diag_list_init(list);
+}
+
+// Writes the parts of the location that are known, each followed by ':'
+static void print_location(FILE *out, const char *file, int line, int column) {
+    if (file) fprintf(out, "%s:", file);
+    if (line > 0) fprintf(out, "%d:", line);
+    if (line > 0 && column > 0) fprintf(out, "%d:", column);
+    if (file || line > 0) fputc(' ', out);
+}
+
+void diag_list_print(const diag_list_t *list, FILE *out) {
+    for (int i = 0; i < list->count; i++) {
+        const diagnostic_t *diag = &list->items[i];
+        print_location(out, diag->file, diag->line, diag->column);
+        fputs(diag->message, out);
+    }
+}
+
+static int compare_diagnostics(const void *a, const void *b) {
+    const diagnostic_t *x = a, *y = b;
+    if (x->line != y->line) return (x->line > y->line) - (x->line < y->line);
+    if (x->column != y->column) return (x->column > y->column) - (x->column < y->column);
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+void diag_list_sort(diag_list_t *list) {
+    if (list->count > 1) {
+        qsort(list->items, list->count, sizeof(diagnostic_t), compare_diagnostics);
+    }
+}
+
+diag_list_t *diag_set_sink(diag_list_t *sink) {
+    diag_list_t *previous = current_sink;
+    current_sink = sink;
+    return previous;
+}
+
+void diag_set_file(const char *file) {
+    current_file = file;
+}
+
+const char *diag_file(void) {
+    return current_file;
+}
+
+// Takes ownership of the diagnostic's message
+static void diag_list_add(diag_list_t *list, diagnostic_t diag) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : DIAG_LIST_INITIAL_CAPACITY;
+        list->items = realloc(list->items, list->capacity * sizeof(diagnostic_t));
+        assert(list->items != NULL);
+    }
+    diag.order = list->count;
+    list->items[list->count++] = diag;
+}
+
+static char *format_message(const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+
+    char *message = malloc(length + 1);
+    assert(message != NULL);
+    vsnprintf(message, length + 1, fmt, args);
+    return message;
+}
+
+static void report(diagnostic_t diag) {
+    if (current_sink) {
+        diag_list_add(current_sink, diag);
+    } else {
+        print_location(stderr, diag.file, diag.line, diag.column);
+        fputs(diag.message, stderr);
+        free(diag.message);
+    }
+}
+
+void diag_list_report(const diag_list_t *list) {
+    for (int i = 0; i < list->count; i++) {
+        diagnostic_t diag = list->items[i];
+        diag.message = strdup(diag.message);
+        assert(diag.message != NULL);
+        report(diag);
+    }
+}
+
+static void diag_report(int line, int column, const char *fmt, va_list args) {
+    atomic_fetch_add(&error_count, 1);
+    report((diagnostic_t) {
+        .file = current_file,
+        .line = line,
+        .column = column,
+        .message = format_message(fmt, args)
+    });
+}
+
+void diag_error_at(int line, int column, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    diag_report(line, column, fmt, args);
+    va_end(args);
+}
+
+void diag_error(int line, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    diag_report(line, 0, fmt, args);
+    va_end(args);
+}
+
+int diag_error_count(void) {
+    return atomic_load(&error_count);
+}
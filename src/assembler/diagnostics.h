@@ -0,0 +1,139 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#define DIAG_LIST_INITIAL_CAPACITY 8
+
+/**
+ * @struct diagnostic_t
+ * @brief One formatted error message and where in the source it points
+ *
+ * Printed as `file:line:column: message`, leaving out the parts that are
+ * not known, which are NULL or 0
+ *
+ * @var file Source file, as given with `diag_set_file`
+ * @var line Source line, counting from 1
+ * @var column Source column, counting from 1
+ * @var order Position in the list it was first reported to, to keep sorting stable
+ * @var message Formatted message, ending in a newline
+ */
+
+typedef struct {
+    const char *file;
+    int line;
+    int column;
+    int order;
+    char *message;
+} diagnostic_t;
+
+/**
+ * @struct diag_list
+ * @brief Dynamic array of diagnostics held back to be reported later
+ *
+ * Worker threads each collect into a list of their own so that messages
+ * can be printed in source order once every thread has finished
+ */
+
+typedef struct diag_list {
+    diagnostic_t *items;
+    int count;
+    int capacity;
+} diag_list_t;
+
+/**
+ * @brief Initialises an empty diagnostic list
+ * @param list List to initialise
+ */
+
+void diag_list_init(diag_list_t *list);
+
+/**
+ * @brief Frees the messages held by a diagnostic list
+ * @param list List to free
+ */
+
+void diag_list_free(diag_list_t *list);
+
+/**
+ * @brief Prints every diagnostic in a list, in the order they are held
+ *
+ * @param list List to print
+ * @param out Stream to print to
+ */
+
+void diag_list_print(const diag_list_t *list, FILE *out);
+
+/**
+ * @brief Sorts a list by line and column, keeping diagnostics at the same place in the order they were reported
+ * @param list List to sort
+ */
+
+void diag_list_sort(diag_list_t *list);
+
+/**
+ * @brief Passes the diagnostics in a list on as the calling thread would report them
+ *
+ * They go to the calling thread's sink if it has one, and to stderr
+ * otherwise. They were counted when first reported, so are not counted again
+ *
+ * @param list List to pass on, left as it is
+ */
+
+void diag_list_report(const diag_list_t *list);
+
+/**
+ * @brief Redirects the calling thread's diagnostics into a list
+ *
+ * @param sink List to collect into, or NULL to print straight to stderr
+ * @return diag_list_t* The sink it replaces, to be put back afterwards
+ */
+
+diag_list_t *diag_set_sink(diag_list_t *sink);
+
+/**
+ * @brief Names the source file the calling thread's diagnostics refer to
+ *
+ * @param file File name, which must outlive the diagnostics, or NULL for none
+ */
+
+void diag_set_file(const char *file);
+
+/**
+ * @brief Source file the calling thread's diagnostics refer to
+ * @return const char* File name, or NULL for none
+ */
+
+const char *diag_file(void);
+
+/**
+ * @brief Reports an error at a line and column of the source
+ *
+ * The message goes to the calling thread's sink if it has one, and to
+ * stderr otherwise, after the file, line and column
+ *
+ * @param line Source line the error refers to, or 0 for the whole file
+ * @param column Source column the error refers to, or 0 for the whole line
+ * @param fmt printf style format of the message
+ */
+
+void diag_error_at(int line, int column, const char *fmt, ...);
+
+/**
+ * @brief Reports an error on a line of the source, as `diag_error_at` does without a column
+ *
+ * @param line Source line the error refers to, or 0 for the whole file
+ * @param fmt printf style format of the message
+ */
+
+void diag_error(int line, const char *fmt, ...);
+
+/**
+ * @brief Number of errors reported so far, across all threads
+ * @return int Error count
+ */
+
+int diag_error_count(void);
+
+#endif
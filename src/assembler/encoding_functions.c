@@ -1,61 +1,10 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include "encoding_functions.h"
 
 
-static general_entry arithmetic_table[] = {
-    {"add", 0},
-    {"adds", 1},
-    {"sub", 2},
-    {"subs", 3},
-    {"cmp", 3},    // alias for subs with rd = xzr
-    {"cmn", 2},    // alias for adds with rd = xzr
-    {"neg", 2},    // alias for sub with rn = xzr
-    {"negs", 3},   // alias for subs with rn = xzr
-    END_ENTRY
-};
-
-static dp_logical_entry_t logical_table[] = {
-    {"and",  0, 0},
-    {"bic",  0, 1}, // alias for and with N = 1
-    {"orr",  1, 0},
-    {"orn",  1, 1},
-    {"eor",  2, 0},
-    {"eon",  2, 1},
-    {"ands", 3, 0},
-    {"bics", 3, 1},
-    {"tst",  3, 0}, // alias for ands with rd = xzr
-    {"mov",  1, 0}, // alias for orr with rn = xzr
-    {"mvn",  1, 1}, // alias for orn with rn = xzr
-    {NULL, 0, 0}
-};
-
-static general_entry condition_table[] = {
-    {"b.eq", 0},
-    {"b.ne", 1},
-    {"b.ge", 10},
-    {"b.lt", 11},
-    {"b.gt", 12},
-    {"b.le", 13},
-    {"b.al", 14},
-    END_ENTRY
-};
-
-static general_entry multiplication_table[] = {
-    {"madd", 0},
-    {"msub", 1},
-    {"mul",  0},  // ra = xzr
-    {"mneg", 1},  // ra = xzr
-    END_ENTRY
-};
-
-static general_entry wide_move_table[] = {
-    {"movz", 2},
-    {"movn", 0},
-    {"movk", 3},
-    END_ENTRY
-};
-
 void encode_dp_immediate (instruction_t* instr) {
-    char *mnemonic = instr->mnemonic;
+    const mnemonic_t *desc = instr->desc;
     reg_t rd = instr->rd;
     reg_t rn = instr->rn;
     operand_t operand = instr->operand;
@@ -66,32 +15,28 @@ void encode_dp_immediate (instruction_t* instr) {
 
     uint8_t opc = 0, shift = 0;
 
-    int found = lookup_general_entry_table(arithmetic_table, mnemonic, &opc);
-    
-    if (!found) {
-        fprintf(stderr, "Error: Unknown immediate instruction: %s\n", mnemonic);
+    if (!desc || desc->encoding != ENC_ARITHMETIC) {
+        diag_error_at(instr->line, instr->column, "Error: Unknown immediate instruction: %s\n", instr->mnemonic);
         return;
     }
+    opc = desc->opc;
 
     uint32_t imm12 = 0;
     if (operand.type == OP_IMM) { 
         //checks if it is in the range
         if (operand.value.imm < 0 || operand.value.imm > 0xFFF) {
-            fprintf(stderr, "Error: Immediate value out of range (0-4095): %d\n", operand.value.imm);
+            diag_error_at(instr->line, instr->column, "Error: Immediate value out of range (0-4095): %d\n", operand.value.imm);
             instr->encoded = 0;
             return;
         }
         imm12 = operand.value.imm & 0xFFF; 
-        printf("imm12: %" PRId32 "\n", imm12);
     } else if (operand.type == OP_SHIFTED_IMM) {
         if (operand.value.shifted_imm.shift_amount != 0) {
             shift = 1;
         }
         imm12 = operand.value.shifted_imm.imm & 0xFFF;
-        
-        printf("imm12: %" PRId32 "\n", imm12);
     } else {
-        fprintf(stderr, "Error: Unsupported operand type for DP Immediate.\n");
+        diag_error_at(instr->line, instr->column, "Error: Unsupported operand type for DP Immediate.\n");
         instr->encoded = 0;
         return;
     }
@@ -107,7 +52,7 @@ void encode_dp_immediate (instruction_t* instr) {
 } 
 
 void encode_dp_register(instruction_t *instr) {
-    char *mnemonic = instr->mnemonic;
+    const mnemonic_t *desc = instr->desc;
     reg_t rd = instr->rd;
     reg_t rn = instr->rn;
     reg_t rm = instr->rm;
@@ -120,24 +65,17 @@ void encode_dp_register(instruction_t *instr) {
     uint8_t opc = 0, shift = 0, is_arithmetic = 0, N = 0, shift_amount = 0;
 
 
-    if (lookup_general_entry_table(arithmetic_table, mnemonic, &opc)) {
+    if (desc && desc->encoding == ENC_ARITHMETIC) {
+        opc = desc->opc;
         is_arithmetic = 1;
+    } else if (desc && desc->encoding == ENC_LOGICAL) {
+        opc = desc->opc;
+        N = desc->N;
+        is_arithmetic = 0;
     } else {
-        bool found = false;
-        for (int i = 0; logical_table[i].mnemonic != NULL; i++){
-            if (strcmp(mnemonic, logical_table[i].mnemonic) == 0) {
-                opc = logical_table[i].opc;
-                N = logical_table[i].N;
-                is_arithmetic = 0;
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            fprintf(stderr, "Error: Unknown DP-register mnemonic: %s\n", mnemonic);
-            instr->encoded = 0;
-            return;
-        }
+        diag_error_at(instr->line, instr->column, "Error: Unknown DP-register mnemonic: %s\n", instr->mnemonic);
+        instr->encoded = 0;
+        return;
     }
 
     if (operand.type == OP_SHIFTED_REG){
@@ -149,7 +87,7 @@ void encode_dp_register(instruction_t *instr) {
         rm = operand.value.reg;
         shift_amount = 0; //already 0, but for clarity
     } else {
-        fprintf(stderr, "Error: Invalid operand type for DP-Register\n");
+        diag_error_at(instr->line, instr->column, "Error: Invalid operand type for DP-Register\n");
         instr->encoded = 0;
         return;
     }
@@ -169,26 +107,22 @@ void encode_dp_register(instruction_t *instr) {
 }
 
 void encode_multiply(instruction_t *instr) {
-    char *mnemonic = instr->mnemonic;
+    const mnemonic_t *desc = instr->desc;
     reg_t rd = instr->rd;
     reg_t rn = instr->rn;
     reg_t ra = instr->ra;
     reg_t rm = instr->rm;
 
     uint32_t binary_rep = 0;
-    uint8_t opc = 0;
     uint8_t sf = GET_SF(rd);
-    if (strcmp(mnemonic, "mull") == 0 || strcmp(mnemonic, "mneg") == 0){
-        ra.number = 31;
-    }
-
-    bool found = lookup_general_entry_table(multiplication_table, mnemonic, &opc);
 
-    if (!found) {
-        fprintf(stderr, "Error: Unknown multiply mnemonic: %s\n", mnemonic);
+    // mul and mneg already have ra = xzr from the parser
+    if (!desc || desc->encoding != ENC_MULTIPLY) {
+        diag_error_at(instr->line, instr->column, "Error: Unknown multiply mnemonic: %s\n", instr->mnemonic);
         instr->encoded = 0;
         return;
     }
+    uint8_t opc = desc->opc;
 
     binary_rep |= (sf << 31);             
     binary_rep |= (216 << 21);            // 0 0 1 1 0 1 1 0 0 0      
@@ -202,7 +136,7 @@ void encode_multiply(instruction_t *instr) {
 }
 
 void encode_wide_move(instruction_t *instr) {
-    const char* mnemonic = instr->mnemonic;
+    const mnemonic_t *desc = instr->desc;
     reg_t rd = instr->rd;
     uint16_t imm16 = instr->imm16;          
     uint8_t shift_amount = instr->shift_amount;
@@ -210,17 +144,15 @@ void encode_wide_move(instruction_t *instr) {
     uint32_t binary_rep = 0;
     uint8_t sf = GET_SF(rd);
 
-    uint8_t opc = 0;
-    bool found = lookup_general_entry_table(wide_move_table, mnemonic, &opc);
-
-    if (!found) {
-        fprintf(stderr, "Error: Unknown wide move mnemonic: %s\n", mnemonic);
+    if (!desc || desc->encoding != ENC_WIDE_MOVE) {
+        diag_error_at(instr->line, instr->column, "Error: Unknown wide move mnemonic: %s\n", instr->mnemonic);
         instr->encoded = 0;
         return;
     }
+    uint8_t opc = desc->opc;
 
     if (shift_amount % 16 != 0 || shift_amount > 48) {
-        fprintf(stderr, "Error: Invalid shift amount %d for wide move\n", shift_amount);
+        diag_error_at(instr->line, instr->column, "Error: Invalid shift amount %d for wide move\n", shift_amount);
         instr->encoded = 0;
         return;
     }
@@ -237,97 +169,96 @@ void encode_wide_move(instruction_t *instr) {
     instr->encoded = binary_rep;
 }
 
-void encode_branch(instruction_t* instr, symbol_table symbols) {
+// Encodes the offset to `label` now if it is defined, otherwise leaves it
+// for a fixup to patch once the label is seen
+static void encode_label_reference(instruction_t* instr, int index, const char *label, fixup_kind_t kind, symbol_table symbols, fixup_list_t fixups) {
+    uint32_t address = symbol_table_get(symbols, (char *)label);
+    if (address != NOT_FOUND) {
+        patch_label_offset(instr, kind, address, fixups);
+    } else if (fixups) {
+        fixup_list_add(fixups, label, index, kind);
+    } else {
+        diag_error_at(instr->line, instr->column, "Error: Undefined label '%s' on address %d\n", label, instr->instr_address);
+        instr->encoded = 0;
+    }
+}
+
+bool patch_label_offset(instruction_t* instr, fixup_kind_t kind, uint32_t target, fixup_list_t fixups) {
+    // Offsets are counted in words, so data of other sizes must not leave
+    // the label between two of them
+    if ((target - instr->instr_address) % 4 != 0) {
+        diag_error_at(instr->line, instr->column, "Error: Label at 0x%x is not word aligned\n", target);
+        instr->encoded = 0;
+        return false;
+    }
+    int32_t offset = ((int32_t)target - (int32_t)instr->instr_address) >> 2;
+
+    uint32_t patched = instr->encoded;
+    if (!patch_offset_field(&patched, kind, offset) && fixups && fixups->relax_branches
+            && instr->type == INSTR_BRANCH && kind == FIXUP_IMM19) {
+        fixups->relaxations++;
+        return false;
+    }
+    if (!patch_offset_field(&instr->encoded, kind, offset)) {
+        diag_error_at(instr->line, instr->column, "Error: %s offset out of range\n",
+            kind == FIXUP_IMM26 ? "Branch" : "Label");
+        instr->encoded = 0;
+        return false;
+    }
+    return true;
+}
+
+void encode_branch(instruction_t* instr, int index, symbol_table symbols, fixup_list_t fixups) {
     if (!instr) {
         fprintf(stderr, "Error: instruction is NULL\n");
-        instr->encoded = 0;
         return;
     }
 
-    const char* mnemonic = instr->mnemonic;
+    const mnemonic_t *desc = instr->desc;
     const char* label = instr->branch_label;
 
-    
-
-    uint32_t target_address = symbol_table_get(symbols, (char *)label);
-    int32_t offset = ((int32_t)target_address - (int32_t)instr->instr_address) >> 2;
-
     uint32_t binary_rep = 0;
+    fixup_kind_t kind;
 
     // Conditional branch
-    if (strncmp(mnemonic, "b.", 2) == 0) { 
-        if (!symbol_table_find(symbols, (char *)label)) {
-            fprintf(stderr, "Error: Undefined label '%s' on address %d\n", label, instr->instr_address);
-            instr->encoded = 0;
-            return;
-        }
+    if (desc && desc->encoding == ENC_BRANCH_COND) { 
         binary_rep |= (84 << 24);  // fixed upper 8 bits 01010100
-
-        if (offset < -(1 << 18) || offset >= (1 << 18)) {
-            fprintf(stderr, "Error: Branch offset out of range on line %d\n", instr->instr_address);
-            instr->encoded = 0;
-            return;
-        }
-
-        binary_rep |= ((offset & 0x7FFFF) << 5);  // imm19
-
-        bool found = false;
-        for (int i = 0; condition_table[i].mnemonic != NULL; i++) {
-            if (strcmp(mnemonic, condition_table[i].mnemonic) == 0) {
-                binary_rep |= condition_table[i].opc;  // cond bits
-                found = true;
-                break;
-            }
-        }
-
-        if (!found) {
-            fprintf(stderr, "Error: Unknown condition mnemonic '%s' on line %d\n", mnemonic, instr->instr_address);
-            instr->encoded = 0;
-            return;
-        }
+        binary_rep |= desc->opc;   // cond bits
+        kind = FIXUP_IMM19;
     }
 
     // Unconditional: b
-    else if (strcmp(mnemonic, "b") == 0) {
-        if (!symbol_table_find(symbols, (char *)label)) {
-            fprintf(stderr, "Error: Undefined label '%s' on address %d\n", label, instr->instr_address);
-            instr->encoded = 0;
-            return;
-        }
+    else if (desc && desc->encoding == ENC_BRANCH) {
         if (!instr->branch_label) {
-            fprintf(stderr, "Instruction does not have branch label\n");
+            diag_error_at(instr->line, instr->column, "Instruction does not have branch label\n");
             instr->encoded = 0;
             return;
         }
         uint8_t opcode = 5;
 
-        if (offset < -(1 << 25) || offset >= (1 << 25)) {
-            fprintf(stderr, "Error: Branch offset out of range on line %d\n", instr->instr_address);
-            instr->encoded = 0;
-            return;
-        }
-
         binary_rep |= (opcode << 26);             // bits 31–26
-        binary_rep |= (offset & 0x03FFFFFF);      // imm26
+        kind = FIXUP_IMM26;
     }
-    else if (strcmp(mnemonic, "br") == 0) {
+    else if (desc && desc->encoding == ENC_BRANCH_REG) {
         uint32_t bin_val = 3508160;
         int reg_no = instr->rn.number;
-        printf("reg no: %d\n", reg_no);
         binary_rep |= (bin_val << 10);             // bits 31–26
         binary_rep |= ((reg_no & 0x1F) << 5);      // imm26
+        instr->encoded = binary_rep;
+        return;
     }
 
     else {
-        fprintf(stderr, "Error: Unsupported branch mnemonic '%s' on line %d\n", mnemonic, instr->instr_address);
+        diag_error_at(instr->line, instr->column, "Error: Unsupported branch mnemonic '%s'\n", instr->mnemonic);
         instr->encoded = 0;
         return;
     }
 
     instr->encoded = binary_rep;
+    encode_label_reference(instr, index, label, kind, symbols, fixups);
 }
 
-void encode_load_store(instruction_t* instr, symbol_table symbols) {
+void encode_load_store(instruction_t* instr, int index, symbol_table symbols, fixup_list_t fixups) {
     if (!instr) return;
 
     uint32_t binary_rep = 0;
@@ -348,7 +279,7 @@ void encode_load_store(instruction_t* instr, symbol_table symbols) {
             base = addr.value.unsigned_offset.xn;
 
             if ((imm % scale != 0) || (imm / scale > 0xFFF)) {
-                fprintf(stderr, "Error: Offset must be a multiple of %d and <= %d\n", scale, 0xFFF * scale);
+                diag_error_at(instr->line, instr->column, "Error: Offset must be a multiple of %d and <= %d\n", scale, 0xFFF * scale);
                 return;
             }
 
@@ -375,7 +306,7 @@ void encode_load_store(instruction_t* instr, symbol_table symbols) {
             base = addr.value.pre_post_indexed.xn;
 
             if (simm9 < -256 || simm9 > 255) {
-                fprintf(stderr, "Error: simm9 out of range (-256 to 255)\n");
+                diag_error_at(instr->line, instr->column, "Error: simm9 out of range (-256 to 255)\n");
                 return;
             }
 
@@ -413,41 +344,24 @@ void encode_load_store(instruction_t* instr, symbol_table symbols) {
 
         case LITERAL: {
             const char* label = instr->address.value.literal.label;
-            printf("label: %s\n", label);
-            uint32_t target_addr;
-
-            if (label == NULL) {
-                // immediate 
-                target_addr = instr->address.value.literal.int_directive;
-            } else {
-                if (!label || !symbol_table_find(symbols, (char*)label)) {
-                    fprintf(stderr, "Error: Undefined label '%s' on line %d\n", label, instr->instr_address);
-                    instr->encoded = 0; 
-                    return;
-                }
-                target_addr = symbol_table_get(symbols, (char*)label);
-            }
-           
-            uint32_t pc = instr->instr_address;  // assuming each instruction is 4 bytes
-            int32_t offset = ((int32_t)target_addr - (int32_t)pc) / 4;
-
-            if (offset < -262144 || offset > 262143) {  // simm19 range
-                fprintf(stderr, "Error: Literal offset out of range on line %d\n", instr->instr_address);
-                instr->encoded = 0;
-                return;
-            }
-
             uint8_t sf = (instr->rt.type == REG_X) ? 1 : 0;
 
             binary_rep |= (sf << 30);
             binary_rep |= (3 << 27);       // bits 29–27 for Load literal
-            binary_rep |= ((offset & 0x7FFFF) << 5); // simm19 in bits 23–5
             binary_rep |= instr->rt.number;
-            break;
+            instr->encoded = binary_rep;
+
+            if (label == NULL) {
+                // immediate 
+                patch_label_offset(instr, FIXUP_IMM19, instr->address.value.literal.int_directive, NULL);
+            } else {
+                encode_label_reference(instr, index, label, FIXUP_IMM19, symbols, fixups);
+            }
+            return;
         }
 
         default:
-            fprintf(stderr, "Error: Unsupported addressing mode for load/store\n");
+            diag_error_at(instr->line, instr->column, "Error: Unsupported addressing mode for load/store\n");
             return;
     }
     instr->encoded = binary_rep;
@@ -459,57 +373,135 @@ void encode_directive(instruction_t* instr) {
 }
 
 void encode_unknown(instruction_t* instr) {
-    fprintf(stderr, "Error: Unknown instruction on line %d", instr->instr_address);
+    diag_error_at(instr->line, instr->column, "Error: Unknown instruction\n");
     instr->encoded = 0;
 }
 
-bool lookup_general_entry_table(general_entry *table, const char *mnemonic, uint8_t *opc) {
-    for (int i = 0; table[i].mnemonic != NULL; i++){
-        if (strcmp(mnemonic, table[i].mnemonic) == 0) {
-            *opc = table[i].opc;
-            return true;
+void encode_instruction(instruction_t *instr, int index, symbol_table symbols, fixup_list_t fixups) {
+    if (instr->type != INSTR_DATA && instr->type != INSTR_DIRECTIVE && instr->instr_address % 4 != 0) {
+        diag_error_at(instr->line, instr->column, "Error: Instruction at 0x%x is not word aligned\n", instr->instr_address);
+        instr->encoded = 0;
+        return;
+    }
+
+    switch (instr->type) {
+        case INSTR_DATA_PROC_IMM: {
+            encode_dp_immediate(instr);
+            break;
+        }
+        case INSTR_DATA_PROC_REG: {
+            encode_dp_register(instr);
+            break;
+        }
+        case INSTR_MULTIPLY: {
+            encode_multiply(instr);
+            break;
+        }
+        case INSTR_WIDE_MOVE: {
+            encode_wide_move(instr);
+            break;
+        }
+        case INSTR_BRANCH: {
+            encode_branch(instr, index, symbols, fixups);
+            break;
+        }
+        case INSTR_LOAD_STORE: {
+            encode_load_store(instr, index, symbols, fixups);
+            break;
+        }
+        case INSTR_DIRECTIVE: {
+            encode_directive(instr);
+            break;
+        }
+        case INSTR_DATA: {
+            // Written out from its bytes, zeros or file as it is
+            break;
+        }
+        case INSTR_UNKNOWN: {
+            encode_unknown(instr);
+            break;
         }
     }
-    return false;
 }
 
-void encode_instructions(instruction_t **instrs, int instruction_count, symbol_table sym_table) {
+void encode_instructions(instruction_t *instrs, int instruction_count, symbol_table sym_table) {
     for (int i = 0; i < instruction_count; i++) {
-        instruction_t *instr = instrs[i];
-        switch (instr->type) {
-            case INSTR_DATA_PROC_IMM: {
-                encode_dp_immediate(instr);
-                break;
-            }
-            case INSTR_DATA_PROC_REG: {
-                encode_dp_register(instr);
-                break;
-            }
-            case INSTR_MULTIPLY: {
-                encode_multiply(instr);
-                break;
-            }
-            case INSTR_WIDE_MOVE: {
-                encode_wide_move(instr);
-                break;
-            }
-            case INSTR_BRANCH: {
-                encode_branch(instr, sym_table);
-                break;
-            }
-            case INSTR_LOAD_STORE: {
-                encode_load_store(instr, sym_table);
-                break;
-            }
-            case INSTR_DIRECTIVE: {
-                encode_directive(instr);
-                break;
-            }
-            case INSTR_UNKNOWN: {
-                encode_unknown(instr);
-                break;
-            }
-            
+        encode_instruction(&instrs[i], i, sym_table, NULL);
+    }
+}
+
+typedef struct {
+    instruction_t *instrs;
+    int instruction_count;
+    symbol_table symbols;
+    diag_list_t *chunk_diags;
+    int chunk_count;
+    atomic_int next_chunk;
+    const char *file;       // Source file the diagnostics refer to
+} encode_job_t;
+
+static void *encode_worker(void *arg) {
+    encode_job_t *job = arg;
+    const char *file = diag_file();
+    diag_list_t *sink = diag_set_sink(NULL);
+    diag_set_file(job->file);
+
+    for (;;) {
+        int chunk = atomic_fetch_add(&job->next_chunk, 1);
+        if (chunk >= job->chunk_count) break;
+
+        int start = chunk * ENCODE_CHUNK_SIZE;
+        int end = start + ENCODE_CHUNK_SIZE;
+        if (end > job->instruction_count) end = job->instruction_count;
+
+        diag_set_sink(&job->chunk_diags[chunk]);
+        for (int i = start; i < end; i++) {
+            encode_instruction(&job->instrs[i], i, job->symbols, NULL);
         }
     }
+    diag_set_sink(sink);
+    diag_set_file(file);
+    return NULL;
+}
+
+void encode_instructions_parallel(instruction_t *instrs, int instruction_count, symbol_table sym_table, int threads) {
+    int chunk_count = (instruction_count + ENCODE_CHUNK_SIZE - 1) / ENCODE_CHUNK_SIZE;
+    if (threads > chunk_count) threads = chunk_count;
+    if (threads <= 1) {
+        encode_instructions(instrs, instruction_count, sym_table);
+        return;
+    }
+
+    encode_job_t job = {
+        .instrs = instrs,
+        .instruction_count = instruction_count,
+        .symbols = sym_table,
+        .chunk_diags = malloc(chunk_count * sizeof(diag_list_t)),
+        .chunk_count = chunk_count,
+        .file = diag_file()
+    };
+    assert(job.chunk_diags != NULL);
+    atomic_init(&job.next_chunk, 0);
+    for (int i = 0; i < chunk_count; i++) {
+        diag_list_init(&job.chunk_diags[i]);
+    }
+
+    // The calling thread works through chunks alongside the pool
+    pthread_t *pool = malloc((threads - 1) * sizeof(pthread_t));
+    assert(pool != NULL);
+    int started = 0;
+    for (; started < threads - 1; started++) {
+        if (pthread_create(&pool[started], NULL, encode_worker, &job) != 0) break;
+    }
+    encode_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool[i], NULL);
+    }
+
+    for (int i = 0; i < chunk_count; i++) {
+        diag_list_report(&job.chunk_diags[i]);
+        diag_list_free(&job.chunk_diags[i]);
+    }
+    free(pool);
+    free(job.chunk_diags);
 }
@@ -7,33 +7,79 @@
 
 #include "instruction_representation.h"
 #include "symbol_table.h"  
+#include "fixups.h"
+#include "diagnostics.h"
 #include "../emulator/bitwise_shifts.h"
 
-#define END_ENTRY {NULL, 0}
-#define GET_SF(reg) ((reg.type == REG_X || reg.type == REG_XZR) ? 1 : 0)
-
-typedef struct {
-    const char* mnemonic;
-    uint8_t opc;     // 00, 01, 10, 11
-    uint8_t N;       // 0 for normal, 1 for NOT variants
-} dp_logical_entry_t;
-
-typedef struct {
-    const char* mnemonic;
-    uint8_t opc;              
-} general_entry;
-
+// Instructions handed to a worker at a time by encode_instructions_parallel
+#define ENCODE_CHUNK_SIZE 4096
 
+#define GET_SF(reg) ((reg.type == REG_X || reg.type == REG_XZR) ? 1 : 0)
 
 void encode_dp_immediate(instruction_t* instr);
 void encode_dp_register(instruction_t* instr);
 void encode_multiply(instruction_t* instr);
 void encode_wide_move(instruction_t* instr);
-void encode_branch(instruction_t* instr, symbol_table symbols);
-void encode_load_store(instruction_t* instr, symbol_table symbols);
+void encode_branch(instruction_t* instr, int index, symbol_table symbols, fixup_list_t fixups);
+void encode_load_store(instruction_t* instr, int index, symbol_table symbols, fixup_list_t fixups);
 void encode_directive(instruction_t* instr);
 void encode_unknown(instruction_t* instr);
-void encode_instructions(instruction_t **instrs, int instruction_count, symbol_table sym_table);
-bool lookup_general_entry_table(general_entry *table, const char *mnemonic, uint8_t *opc);
+
+/**
+ * @brief Patches the word offset from an instruction to a label into its encoding
+ *
+ * A conditional branch that cannot reach its label is left alone and
+ * counted, rather than reported, when the fixups allow branches to be
+ * relaxed afterwards (see layout.h)
+ *
+ * @param instr Instruction whose encoding has a zero offset field
+ * @param kind Field the offset goes into (imm26 or imm19)
+ * @param target Address of the label
+ * @param fixups Fixups of the assembly, or NULL
+ * @return true on success, false if the offset is out of range
+ */
+
+bool patch_label_offset(instruction_t* instr, fixup_kind_t kind, uint32_t target, fixup_list_t fixups);
+
+/**
+ * @brief Encodes a single instruction
+ *
+ * Label references that are not yet in the symbol table are recorded in
+ * `fixups` and patched when the label is defined. Without a fixup list
+ * they are reported as undefined
+ *
+ * @param instr Instruction to encode
+ * @param index Index of the instruction in the parser's instruction array
+ * @param symbols Symbol table of the labels defined so far
+ * @param fixups Fixup list for forward references, or NULL
+ */
+
+void encode_instruction(instruction_t *instr, int index, symbol_table symbols, fixup_list_t fixups);
+
+/**
+ * @brief Encodes an array of instructions once every label is defined
+ *
+ * @param instrs Array of instructions
+ * @param instruction_count Number of instructions
+ * @param sym_table Complete symbol table
+ */
+
+void encode_instructions(instruction_t *instrs, int instruction_count, symbol_table sym_table);
+
+/**
+ * @brief Encodes an array of instructions across a pool of threads
+ *
+ * The array is split into chunks of ENCODE_CHUNK_SIZE instructions that
+ * the threads take in turn. Each chunk collects its own diagnostics, which
+ * are printed to stderr in chunk order, and so in source order, once every
+ * thread is done
+ *
+ * @param instrs Array of instructions
+ * @param instruction_count Number of instructions
+ * @param sym_table Complete symbol table, only read by the threads
+ * @param threads Number of threads to encode with
+ */
+
+void encode_instructions_parallel(instruction_t *instrs, int instruction_count, symbol_table sym_table, int threads);
 
 #endif
@@ -0,0 +1,79 @@
+#include "fixups.h"
+#include "encoding_functions.h"
+
+fixup_list_t fixup_list_create(arena_t *arena) {
+    fixup_list_t list = malloc(sizeof(struct fixup_list));
+    assert(list != NULL);
+    list->count = 0;
+    list->capacity = FIXUP_LIST_INITIAL_CAPACITY;
+    list->fixups = malloc(list->capacity * sizeof(fixup_t));
+    assert(list->fixups != NULL);
+    list->pending = symbol_table_create_in_arena(arena);
+    list->first_pending = 0;
+    list->relax_branches = false;
+    list->relaxations = 0;
+    return list;
+}
+
+void fixup_list_add(fixup_list_t list, const char *label, int instr_index, fixup_kind_t kind) {
+    if (list->count >= list->capacity) {
+        list->capacity *= 2;
+        list->fixups = realloc(list->fixups, list->capacity * sizeof(fixup_t));
+        assert(list->fixups != NULL);
+    }
+
+    // Push onto the front of this label's pending chain
+    uint32_t head = symbol_table_get(list->pending, (char *)label);
+    list->fixups[list->count] = (fixup_t) {
+        .label = label,
+        .instr_index = instr_index,
+        .kind = kind,
+        .next = head,
+        .resolved = false
+    };
+    symbol_table_append(list->pending, (char *)label, list->count);
+    list->count++;
+}
+
+void resolve_fixups(fixup_list_t list, const char *label, uint32_t address, instruction_t *instructions, int first_index) {
+    uint32_t i = symbol_table_get(list->pending, (char *)label);
+    if (i == FIXUP_NONE) return;
+
+    while (i != FIXUP_NONE) {
+        fixup_t *fixup = &list->fixups[i];
+        patch_label_offset(&instructions[fixup->instr_index - first_index], fixup->kind, address, list);
+        fixup->resolved = true;
+        i = fixup->next;
+    }
+    symbol_table_append(list->pending, (char *)label, FIXUP_NONE);
+}
+
+int oldest_pending_fixup(fixup_list_t list) {
+    // Fixups are added in instruction order, so the first unresolved one
+    // is the oldest, and resolved ones are never looked at again
+    while (list->first_pending < list->count && list->fixups[list->first_pending].resolved) {
+        list->first_pending++;
+    }
+    return list->first_pending < list->count ? list->fixups[list->first_pending].instr_index : -1;
+}
+
+int report_unresolved_fixups(fixup_list_t list, instruction_t *instructions, int first_index) {
+    int unresolved = 0;
+    for (int i = 0; i < list->count; i++) {
+        fixup_t *fixup = &list->fixups[i];
+        if (fixup->resolved) continue;
+
+        instruction_t *instr = &instructions[fixup->instr_index - first_index];
+        diag_error_at(instr->line, instr->column, "Error: Undefined label '%s' on address %d\n", fixup->label, instr->instr_address);
+        instr->encoded = 0;
+        unresolved++;
+    }
+    return unresolved;
+}
+
+void free_fixup_list(fixup_list_t list) {
+    if (!list) return;
+    symbol_table_free(list->pending);
+    free(list->fixups);
+    free(list);
+}
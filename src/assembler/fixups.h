@@ -0,0 +1,139 @@
+#ifndef FIXUPS_H
+#define FIXUPS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "instruction_representation.h"
+#include "symbol_table.h"
+
+#define FIXUP_LIST_INITIAL_CAPACITY 64
+#define FIXUP_NONE NOT_FOUND
+
+/**
+ * @enum fixup_kind_t
+ * @brief The instruction field a label offset is patched into
+ */
+
+typedef enum {
+    FIXUP_IMM26,    // b: word offset in bits 25-0
+    FIXUP_IMM19     // b.cond and ldr literal: word offset in bits 23-5
+} fixup_kind_t;
+
+/**
+ * @brief Writes a word offset into the imm26 or imm19 field of an encoded instruction
+ *
+ * Shared by the assembler's fixups and the linker's relocations
+ *
+ * @param word Encoded instruction to patch
+ * @param kind Field the offset goes into
+ * @param offset Offset from the instruction to its target, in words
+ * @return true on success, false if the offset does not fit the field
+ */
+
+static inline bool patch_offset_field(uint32_t *word, fixup_kind_t kind, int32_t offset) {
+    if (kind == FIXUP_IMM26) {
+        if (offset < -(1 << 25) || offset >= (1 << 25)) return false;
+        *word = (*word & ~0x03FFFFFFu) | (offset & 0x03FFFFFF);
+    } else {
+        if (offset < -(1 << 18) || offset >= (1 << 18)) return false;
+        *word = (*word & ~(0x7FFFFu << 5)) | ((offset & 0x7FFFF) << 5);
+    }
+    return true;
+}
+
+/**
+ * @struct fixup_t
+ * @brief A reference to a label that was not yet defined when its instruction was encoded
+ *
+ * Fixups for the same label are chained through `next` so that defining a
+ * label only visits the instructions waiting on it
+ */
+
+typedef struct {
+    const char *label;
+    int instr_index;        // Index into the parser's instruction array
+    fixup_kind_t kind;
+    uint32_t next;          // Previous fixup for the same label, or FIXUP_NONE
+    bool resolved;
+} fixup_t;
+
+/**
+ * @struct fixup_list
+ * @brief Dynamic array of fixups plus the head of the pending chain for each label
+ */
+
+struct fixup_list {
+    fixup_t *fixups;
+    int count;
+    int capacity;
+    symbol_table pending;   // label -> index of its latest unresolved fixup
+    int first_pending;      // No fixup before this index is still unresolved
+    bool relax_branches;    // Leave out of range conditional branches to relax_branches
+    int relaxations;        // Conditional branches left unpatched for that reason
+};
+
+typedef struct fixup_list *fixup_list_t;
+
+/**
+ * @brief Creates a new, empty fixup list
+ *
+ * @param arena Arena the pending labels are interned in
+ * @return fixup_list_t Newly allocated fixup list
+ */
+
+fixup_list_t fixup_list_create(arena_t *arena);
+
+/**
+ * @brief Records a forward reference to be patched once the label is defined
+ *
+ * @param list Fixup list to add to
+ * @param label Name of the undefined label
+ * @param instr_index Index of the referencing instruction
+ * @param kind Field the label offset goes into
+ */
+
+void fixup_list_add(fixup_list_t list, const char *label, int instr_index, fixup_kind_t kind);
+
+/**
+ * @brief Patches every pending reference to a label that has just been defined
+ *
+ * @param list Fixup list
+ * @param label Name of the label
+ * @param address Address the label was defined at
+ * @param instructions Array of the instructions referenced by the fixups
+ * @param first_index Index of the first instruction in `instructions`
+ */
+
+void resolve_fixups(fixup_list_t list, const char *label, uint32_t address, instruction_t *instructions, int first_index);
+
+/**
+ * @brief Finds the earliest instruction still waiting on an undefined label
+ *
+ * Every instruction before it has its final encoding
+ *
+ * @param list Fixup list
+ * @return int Index of the instruction, or -1 if nothing is waiting
+ */
+
+int oldest_pending_fixup(fixup_list_t list);
+
+/**
+ * @brief Reports every reference to a label that was never defined
+ *
+ * @param list Fixup list
+ * @param instructions Array of the instructions referenced by the fixups
+ * @param first_index Index of the first instruction in `instructions`
+ * @return int Number of unresolved references
+ */
+
+int report_unresolved_fixups(fixup_list_t list, instruction_t *instructions, int first_index);
+
+/**
+ * @brief Frees all memory used by the fixup list
+ *
+ * @param list Fixup list to free
+ */
+
+void free_fixup_list(fixup_list_t list);
+
+#endif
@@ -0,0 +1,59 @@
+// Build-time generator for the mnemonic perfect hash.
+//
+// Finds the smallest power-of-two table size and a seed for `mnemonic_hash`
+// under which every mnemonic in mnemonics.def gets a slot of its own, and
+// prints the resulting slot table as a C header on stdout.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "mnemonics.h"
+
+#define MAX_TABLE_SIZE 1024
+#define MAX_SEED (1u << 22)
+
+static const char *names[MNEMONIC_COUNT] = {
+#define MNEMONIC(id, name, form, encoding, opc, N, canonical) [MN_##id] = name,
+#include "mnemonics.def"
+#undef MNEMONIC
+};
+
+static int16_t slots[MAX_TABLE_SIZE];
+
+// Fills `slots` and returns true if `seed` is collision free for `size`
+static bool try_seed(uint32_t seed, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) slots[i] = -1;
+
+    for (int i = 0; i < MNEMONIC_COUNT; i++) {
+        uint32_t slot = mnemonic_hash(names[i], seed) & (size - 1);
+        if (slots[slot] >= 0) return false;
+        slots[slot] = i;
+    }
+    return true;
+}
+
+int main(void) {
+    uint32_t size = 1;
+    while (size < MNEMONIC_COUNT) size *= 2;
+
+    for (; size <= MAX_TABLE_SIZE; size *= 2) {
+        for (uint32_t seed = 0; seed < MAX_SEED; seed++) {
+            if (!try_seed(seed, size)) continue;
+
+            printf("// Generated by gen_mnemonic_hash from mnemonics.def, do not edit\n");
+            printf("#ifndef MNEMONIC_HASH_H\n#define MNEMONIC_HASH_H\n\n");
+            printf("#define MNEMONIC_HASH_SEED %uu\n", seed);
+            printf("#define MNEMONIC_HASH_SIZE %u\n\n", size);
+            printf("static const int8_t mnemonic_slots[MNEMONIC_HASH_SIZE] = {");
+            for (uint32_t i = 0; i < size; i++) {
+                printf("%s%d,", i % 16 == 0 ? "\n    " : " ", slots[i]);
+            }
+            printf("\n};\n\n#endif\n");
+            return EXIT_SUCCESS;
+        }
+    }
+
+    fprintf(stderr, "No perfect hash seed found for %d mnemonics\n", MNEMONIC_COUNT);
+    return EXIT_FAILURE;
+}
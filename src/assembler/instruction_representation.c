@@ -1,16 +1,10 @@
 #include "instruction_representation.h"
 
-instruction_t* create_instruction(void) {
-    instruction_t* instr = malloc(sizeof(instruction_t));
-
-    if (!instr) {
-        fprintf(stderr, "Error: Failed to allocate memory for instruction\n");
-        exit(EXIT_FAILURE);
-    }
-    
+void init_instruction(instruction_t* instr) {
     // Initialize all fields to safe defaults
     instr->type = INSTR_UNKNOWN;
     memset(instr->mnemonic, 0, sizeof(instr->mnemonic));
+    instr->desc = NULL;
     
     // Initialize registers to invalid state
     instr->rd = (reg_t){REG_UNDEFINED, -1};
@@ -36,32 +30,13 @@ instruction_t* create_instruction(void) {
     instr->imm16 = 0;
     instr->shift_amount = 0;
     instr->directive_value = 0;
+    instr->size = 4;
+    instr->data = NULL;
+    instr->data_file = NULL;
     instr->instr_address = 0x0;
+    instr->line = 0;
+    instr->column = 0;
     instr->encoded = 0;
-    
-    return instr;
-}
-
-
-void free_instruction(instruction_t* instr) {
-    if (!instr) return;
-    
-    // // Free dynamic strings
-    // if (instr->branch_label) {
-    //     free(instr->branch_label);
-    // }
-    
-    // if (instr->raw_line) {
-    //     free(instr->raw_line);
-    // }
-    
-    // Free addressing mode label if it exists
-    // if (instr->address.type == LITERAL && instr->address.value.literal.label) {
-    //     free(instr->address.value.literal.label);
-    // }
-    
-    // Free the instruction itself
-    free(instr);
 }
 
 
@@ -76,7 +51,7 @@ shift_type string_to_shift_type(char* str) {
 }
 
 reg_t string_to_reg_t(char *regstr) {
-    reg_t reg;
+    reg_t reg = {.type = REG_UNDEFINED, .number = -1};
 
     if (strcmp(regstr, "sp") == 0) {
         reg = (reg_t) {.type = REG_SP, .number = 0};
@@ -86,16 +61,41 @@ reg_t string_to_reg_t(char *regstr) {
         reg = (reg_t) {.type = REG_XZR, .number = 31};
     } else if (strcmp(regstr, "PC") == 0 || strcmp(regstr, "pc") == 0) {
         reg = (reg_t) {.type = REG_PC, .number = 0}; 
-    } else if (strlen(regstr) >= 2 || strlen(regstr) <= 3) { 
+    } else if (strlen(regstr) >= 2 && strlen(regstr) <= 3 && (regstr[0] == 'x' || regstr[0] == 'w')) {
         char sf = regstr[0];
-        if (sf != 'x' && sf != 'w')
-         { fprintf(stderr, "Invalid register format.\n"); exit(EXIT_FAILURE); }
-        char no[2] = {regstr[1], regstr[2]};
+        char no[3] = {regstr[1], regstr[2], '\0'};
         int reg_no = atoi(no);
         reg = (reg_t) {.type = (sf == 'w' ? REG_W : REG_X), .number = reg_no};
-    } else {
-        fprintf(stderr, "Invalid register format.\n"); exit(EXIT_FAILURE);
     }
     return reg;
 }
 
+uint32_t encoded_size(const instruction_t *instructions, int instruction_count) {
+    if (instruction_count == 0) return 0;
+    const instruction_t *last = &instructions[instruction_count - 1];
+    return last->instr_address + last->size - instructions[0].instr_address;
+}
+
+bool copy_encoded_instructions(uint8_t *out, const instruction_t *instructions, int instruction_count) {
+    for (int i = 0; i < instruction_count; i++) {
+        const instruction_t *instr = &instructions[i];
+        uint8_t *dest = out + (instr->instr_address - instructions[0].instr_address);
+
+        if (instr->type != INSTR_DATA) {
+            memcpy(dest, &instr->encoded, sizeof(uint32_t));
+        } else if (instr->data) {
+            memcpy(dest, instr->data, instr->size);
+        } else if (instr->data_file) {
+            FILE *in = fopen(instr->data_file, "rb");
+            bool ok = in && fread(dest, 1, instr->size, in) == instr->size;
+            if (in) fclose(in);
+            if (!ok) {
+                fprintf(stderr, "Error: Failed to include '%s'\n", instr->data_file);
+                return false;
+            }
+        } else {
+            memset(dest, 0, instr->size);
+        }
+    }
+    return true;
+}
@@ -10,6 +10,7 @@
 #include <stdbool.h>
 
 #include "../emulator/bitwise_shifts.h"
+#include "mnemonics.h"
 
 /**
  * @brief Types of ARM instructions recognized by the assembler
@@ -23,6 +24,7 @@ typedef enum {
     INSTR_BRANCH,            // Branch instructions
     INSTR_LOAD_STORE,        // Load/store instructions
     INSTR_DIRECTIVE,         // Assembler directives
+    INSTR_DATA,              // Data of any size: .byte, .hword, .quad, .space, .align, .incbin
     INSTR_UNKNOWN
 } instruction_type_t;
 
@@ -80,10 +82,10 @@ typedef enum {
 } addressing_mode_type_t;
 
 /**
- * @brief Union representing literal values or labels in address modes
+ * @brief Literal operand of a load: a label, or an address when `label` is NULL
  */
 
-typedef union {
+typedef struct {
     char *label;
     uint32_t int_directive;
 } literal_t;
@@ -132,6 +134,7 @@ typedef struct {
 typedef struct {
     instruction_type_t type;
     char mnemonic[16];           // Instruction mnemonic (e.g., "add", "ldr")
+    const mnemonic_t *desc;      // Descriptor of the encoded mnemonic (aliases resolved)
     
     // Registers (not all instructions use all of these)
     reg_t rd;               // Destination register
@@ -150,36 +153,36 @@ typedef struct {
     int shift_amount;            // Shift amount for wide moves
     
     // Directive specific
-    uint32_t directive_value;    // Value for .int directive
+    uint32_t directive_value;    // Value for .int directive, or the alignment .align pads to
+    uint32_t size;               // Bytes taken up, 4 for instructions and .int
+    uint8_t *data;               // Bytes of a data list, NULL for zeros or a file
+    char *data_file;             // File copied in by .incbin
     
     // Metadata
     uint32_t instr_address;      // Instruction address
+    int line;                    // Source line number
+    int column;                  // Source column the statement starts at
     char *raw_line;              // original string 
 
     uint32_t encoded;            // encoded binary representation
 } instruction_t;
 
 /**
- * @brief Allocates and initializes a new instruction
+ * @brief Initializes an instruction in place to safe defaults
  *
- * @return Pointer to a heap-allocated instruction_t object
- */
-
-instruction_t* create_instruction(void);
-
-
-/**
- * @brief Frees the memory allocated for an instruction
+ * Instructions are stored by value in the parser's instruction array, so
+ * they are initialized where they live rather than allocated
  *
- * @param instr Pointer to the instruction to free
+ * @param instr Pointer to the instruction to initialize
  */
 
-void free_instruction(instruction_t* instr);
+void init_instruction(instruction_t* instr);
 
 /**
  * @brief Converts a string to a reg_t struct
  *
- * Exits the program with an error if the format is invalid
+ * An invalid format gives a register of type REG_UNDEFINED, for the
+ * caller to report
  *
  * @param regstr The string representation of a register
  * @return Corresponding reg_t structure
@@ -196,4 +199,25 @@ reg_t string_to_reg_t(char *regstr);
 
 shift_type string_to_shift_type( char* str);
 
+/**
+ * @brief Counts the bytes that a run of instructions and data takes up
+ *
+ * @param instructions Array of instructions, in address order
+ * @param instruction_count Number of instructions
+ * @return Bytes from the first instruction's address to the end of the last
+ */
+
+uint32_t encoded_size(const instruction_t *, int);
+
+/**
+ * @brief Copies the encodings of instructions into memory, laid out as in a binary file
+ *
+ * @param out Buffer of at least `encoded_size` bytes
+ * @param instructions Array of instructions, in address order
+ * @param instruction_count Number of instructions
+ * @return true on success, false if an included file could not be read
+ */
+
+bool copy_encoded_instructions(uint8_t *, const instruction_t *, int);
+
 #endif
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "layout.h"
+
+// Where the label at `address` moves to: in front of the first entry at or
+// after it that takes up space, so a label next to a `.align` that had
+// nothing to pad stays behind the padding, or as far into the entry it
+// points into as before. `old_addresses` and `new_addresses` hold one more
+// entry than there are instructions, for the end of the program
+static uint32_t moved_address(const uint32_t *old_addresses, const uint32_t *new_addresses, int count, uint32_t address) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (old_addresses[mid] < address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low > 0 && old_addresses[low] != address) {
+        return new_addresses[low - 1] + (address - old_addresses[low - 1]);
+    }
+    while (low < count && old_addresses[low + 1] == old_addresses[low]) low++;
+    return new_addresses[low];
+}
+
+void layout_update(parser_state_t *state, const bool *removed) {
+    instruction_t *instrs = state->instructions;
+    int count = state->instruction_count;
+
+    uint32_t *old_addresses = malloc(sizeof(uint32_t) * (count + 1));
+    uint32_t *new_addresses = malloc(sizeof(uint32_t) * (count + 1));
+    assert(old_addresses != NULL && new_addresses != NULL);
+
+    uint32_t pc = count > 0 ? instrs[0].instr_address : 0;
+    for (int i = 0; i < count; i++) {
+        instruction_t *instr = &instrs[i];
+        old_addresses[i] = instr->instr_address;
+        if (instr->type == INSTR_DATA && instr->directive_value > 0) {
+            uint32_t alignment = instr->directive_value;
+            instr->size = (alignment - pc % alignment) % alignment;
+        }
+        new_addresses[i] = pc;
+        if (!removed || !removed[i]) pc += instr->size;
+    }
+    old_addresses[count] = state->pc;
+    new_addresses[count] = pc;
+    state->pc = pc;
+
+    symbol_table symbols = state->symbols;
+    for (uint32_t i = 0; i < symbols->capacity; i++) {
+        symbol_entry_t *entry = &symbols->entries[i];
+        if (entry->dist == 0) continue;
+        entry->value = moved_address(old_addresses, new_addresses, count, entry->value);
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (removed && removed[i]) continue;
+        instrs[i].instr_address = new_addresses[i];
+        instrs[kept++] = instrs[i];
+    }
+    state->instruction_count = kept;
+
+    free(old_addresses);
+    free(new_addresses);
+}
+
+// BRANCH RELAXATION
+
+static bool is_conditional_branch(const instruction_t *instr) {
+    return instr->type == INSTR_BRANCH && instr->desc && instr->desc->encoding == ENC_BRANCH_COND
+        && instr->branch_label;
+}
+
+static void set_mnemonic(instruction_t *instr, const mnemonic_t *desc) {
+    instr->desc = desc;
+    strncpy(instr->mnemonic, desc->name, sizeof(instr->mnemonic));
+}
+
+// The conditional branch taken exactly when `desc` is not. Conditions
+// come in pairs that differ in their lowest bit
+static const mnemonic_t *inverted_condition(const mnemonic_t *desc) {
+    for (int id = 0; id < MNEMONIC_COUNT; id++) {
+        const mnemonic_t *inverse = &mnemonic_table[id];
+        if (inverse->encoding == ENC_BRANCH_COND && inverse->opc == (desc->opc ^ 1)
+                && !mnemonic_is_alias(inverse)) {
+            return inverse;
+        }
+    }
+    return NULL;
+}
+
+// Marks the conditional branches that cannot reach their label by growing
+// them to the two instructions they become. Returns how many were marked
+static int mark_out_of_reach(parser_state_t *state) {
+    int marked = 0;
+    for (int i = 0; i < state->instruction_count; i++) {
+        instruction_t *instr = &state->instructions[i];
+        if (!is_conditional_branch(instr) || instr->size != PC_INC) continue;
+
+        uint32_t target = symbol_table_get(state->symbols, instr->branch_label);
+        if (target == NOT_FOUND) continue;
+
+        int64_t offset = (int64_t)target - instr->instr_address;
+        if (offset >= -BRANCH_COND_REACH && offset < BRANCH_COND_REACH) continue;
+
+        if (instr->desc == &mnemonic_table[MN_B_AL]) {
+            set_mnemonic(instr, &mnemonic_table[MN_B]);
+        } else {
+            instr->size = 2 * PC_INC;
+        }
+        marked++;
+    }
+    return marked;
+}
+
+int relax_branches(parser_state_t *state) {
+    // Nothing is out of reach in a program shorter than the reach
+    if (state->pc <= BRANCH_COND_REACH) return 0;
+
+    int relaxed = 0;
+    int marked;
+    while ((marked = mark_out_of_reach(state)) > 0) {
+        relaxed += marked;
+        layout_update(state, NULL);
+    }
+    if (relaxed == 0) return 0;
+
+    int count = state->instruction_count;
+    int split = 0;
+    for (int i = 0; i < count; i++) {
+        if (state->instructions[i].size == 2 * PC_INC && is_conditional_branch(&state->instructions[i])) split++;
+    }
+
+    // Keep one spare slot, as add_instruction_to_parser_state does
+    int needed = count + split + 1;
+    if (needed > state->instruction_capacity) {
+        while (state->instruction_capacity < needed) state->instruction_capacity *= 2;
+        state->instructions = realloc(state->instructions, state->instruction_capacity * sizeof(instruction_t));
+        assert(state->instructions != NULL);
+    }
+
+    // Split back to front, so every instruction moves at most once
+    instruction_t *instrs = state->instructions;
+    int next = count + split;
+    for (int i = count - 1; i >= 0; i--) {
+        instruction_t instr = instrs[i];
+        if (instr.size != 2 * PC_INC || !is_conditional_branch(&instr)) {
+            instrs[--next] = instr;
+            continue;
+        }
+
+        instruction_t *jump = &instrs[--next];
+        init_instruction(jump);
+        jump->type = INSTR_BRANCH;
+        set_mnemonic(jump, &mnemonic_table[MN_B]);
+        jump->branch_label = instr.branch_label;
+        jump->line = instr.line;
+        jump->instr_address = instr.instr_address + PC_INC;
+
+        char *skip = new_internal_label(state, "relax");
+        symbol_table_append(state->symbols, skip, instr.instr_address + 2 * PC_INC);
+
+        instruction_t *test = &instrs[--next];
+        *test = instr;
+        set_mnemonic(test, inverted_condition(instr.desc));
+        test->branch_label = skip;
+        test->size = PC_INC;
+    }
+    state->instruction_count = count + split;
+    return relaxed;
+}
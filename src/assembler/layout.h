@@ -0,0 +1,45 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdbool.h>
+#include "parser.h"
+
+// Furthest a conditional branch reaches either way, in bytes
+#define BRANCH_COND_REACH (1 << 20)
+
+/**
+ * @brief Gives every instruction its address again after sizes have changed
+ *
+ * Instructions take up their current `size`, so an instruction that grew
+ * pushes the ones after it down and the ones marked in `removed` are
+ * dropped, with the instructions after them moving up. `.align` padding is
+ * worked out again and every label moves with the instruction it was in
+ * front of, or with the data it points into. A label in front of an
+ * instruction that no longer takes up space moves to the next one that does
+ *
+ * @param state Pointer to the parser state, with every instruction still in the array
+ * @param removed One flag per instruction saying whether to drop it, or NULL to keep them all
+ */
+
+void layout_update(parser_state_t *, const bool *);
+
+/**
+ * @brief Rewrites conditional branches whose label is out of their reach
+ *
+ * Each such `b.cond label` becomes an inverted `b.cond` over a `b label`,
+ * which reaches 128 MiB either way. Relaxing one branch can push another
+ * out of reach, so branches are marked and the layout updated until none
+ * is left; a `b.al` out of reach simply becomes a `b`. References to
+ * labels that are not defined are left alone.
+ *
+ * Works on the whole instruction array, so the parser state must not have
+ * handed any instructions to a sink. The instructions moved are encoded
+ * again by the caller
+ *
+ * @param state Pointer to the parser state
+ * @return Number of branches relaxed
+ */
+
+int relax_branches(parser_state_t *);
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include <assert.h>
+#include "libasm.h"
+#include "parser.h"
+#include "diagnostics.h"
+
+int asm_assemble_buffer(const char *src, size_t len, uint32_t **out, size_t *n) {
+    // Errors are gathered and reported in source order once parsing is
+    // done. The sink is the calling thread's, so only this call's errors
+    // are counted
+    diag_list_t diags;
+    diag_list_init(&diags);
+    diag_list_t *sink = diag_set_sink(&diags);
+
+    parser_state_t *parser_state = create_parser_state();
+    parse_buffer(parser_state, src, len);
+
+    diag_set_sink(sink);
+    diag_list_sort(&diags);
+    diag_list_report(&diags);
+    int errors = diags.count;
+    diag_list_free(&diags);
+
+    // Data may end part way through a word, which is padded with zeros
+    uint32_t size = encoded_size(parser_state->instructions, parser_state->instruction_count);
+    size_t count = (size + 3) / 4;
+    uint32_t *words = calloc(count ? count : 1, sizeof(uint32_t));
+    assert(words != NULL);
+    bool copied = copy_encoded_instructions((uint8_t *)words, parser_state->instructions,
+        parser_state->instruction_count);
+    free_parser_state(parser_state);
+
+    *out = words;
+    *n = count;
+    return errors + !copied;
+}
@@ -0,0 +1,28 @@
+#ifndef LIBASM_H
+#define LIBASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Assembles a source held in memory into encoded instruction words
+ *
+ * Part of libasm.a, which holds every assembler object but the `assemble`
+ * and `link` entry points, so other tools can assemble without writing
+ * or reading any file but those named by `.incbin`. Errors are reported
+ * on stderr as `assemble` reports them: every one in a single pass, in
+ * source order, as `line:column: message` (with the file first if the
+ * calling thread named one with `diag_set_file`). A statement with a
+ * syntax error is left out and parsing carries on from the next line.
+ * Data that ends part way through a word is padded with zeros
+ *
+ * @param src Assembly source text, which need not be null terminated
+ * @param len Length of the source in bytes
+ * @param out Set to a newly allocated array of the words, freed by the caller
+ * @param n Set to the number of words
+ * @return int 0 on success, otherwise the number of errors reported
+ */
+
+int asm_assemble_buffer(const char *src, size_t len, uint32_t **out, size_t *n);
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "object.h"
+#include "symbol_table.h"
+#include "fixups.h"
+
+static int usage(void) {
+    printf("Usage: ./link [-o <file_out>] <object> [<object> ...]\n");
+    return EXIT_FAILURE;
+}
+
+// Address the target of a relocation ends up at, or NOT_FOUND if it names
+// a label no object defines
+static uint32_t relocation_target(const object_t *object, uint32_t base, const object_relocation_t *reloc, symbol_table globals) {
+    if (reloc->symbol == OBJECT_NO_SYMBOL) {
+        return reloc->addend;
+    }
+    const object_symbol_t *symbol = &object->symbols[reloc->symbol];
+    if (symbol->defined) {
+        return base + symbol->value + reloc->addend;
+    }
+    uint32_t address = symbol_table_get(globals, object->strings + symbol->name);
+    return address == NOT_FOUND ? NOT_FOUND : address + reloc->addend;
+}
+
+int main(int argc, char **argv) {
+    char *out_file_name = NULL;
+    char **in_file_names = malloc(sizeof(char *) * argc);
+    int object_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_file_name = argv[++i];
+        } else if (argv[i][0] != '-') {
+            in_file_names[object_count++] = argv[i];
+        } else {
+            free(in_file_names);
+            return usage();
+        }
+    }
+    if (object_count == 0) {
+        free(in_file_names);
+        return usage();
+    }
+
+    // The objects are laid out one after the other in the order given,
+    // so the first one holds the entry point at address 0
+    object_t **objects = calloc(object_count, sizeof(object_t *));
+    uint32_t *bases = malloc(sizeof(uint32_t) * object_count);
+    uint32_t text_words = 0;
+    int status = EXIT_SUCCESS;
+
+    for (int i = 0; i < object_count; i++) {
+        objects[i] = object_load(in_file_names[i]);
+        if (!objects[i]) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        bases[i] = text_words * 4;
+        text_words += objects[i]->text_words;
+    }
+
+    symbol_table globals = symbol_table_create();
+    uint32_t *text = malloc(sizeof(uint32_t) * (text_words ? text_words : 1));
+
+    for (int i = 0; i < object_count && status == EXIT_SUCCESS; i++) {
+        object_t *object = objects[i];
+        for (uint32_t j = 0; j < object->symbol_count; j++) {
+            object_symbol_t *symbol = &object->symbols[j];
+            if (!symbol->defined) continue;
+
+            char *name = object->strings + symbol->name;
+            if (symbol_table_find(globals, name)) {
+                fprintf(stderr, "Error: Label '%s' in %s is already defined\n", name, in_file_names[i]);
+                status = EXIT_FAILURE;
+            }
+            symbol_table_append(globals, name, bases[i] + symbol->value);
+        }
+        memcpy(&text[bases[i] / 4], object->text, sizeof(uint32_t) * object->text_words);
+    }
+
+    for (int i = 0; i < object_count && status == EXIT_SUCCESS; i++) {
+        object_t *object = objects[i];
+        for (uint32_t j = 0; j < object->relocation_count; j++) {
+            object_relocation_t *reloc = &object->relocations[j];
+            uint32_t address = bases[i] + reloc->offset;
+            uint32_t target = relocation_target(object, bases[i], reloc, globals);
+
+            if (target == NOT_FOUND) {
+                fprintf(stderr, "Error: Undefined label '%s' referenced from %s\n",
+                    object->strings + object->symbols[reloc->symbol].name, in_file_names[i]);
+                status = EXIT_FAILURE;
+                continue;
+            }
+            int32_t offset = ((int32_t)target - (int32_t)address) >> 2;
+            if (!patch_offset_field(&text[address / 4], reloc->kind, offset)) {
+                fprintf(stderr, "Error: Offset to address %u out of range at address %u in %s\n",
+                    target, address, in_file_names[i]);
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    // Nothing is written unless every object linked
+    if (status == EXIT_SUCCESS) {
+        FILE *file_out = out_file_name ? fopen(out_file_name, "wb") : stdout;
+        if (!file_out) {
+            perror("Error opening file");
+            status = EXIT_FAILURE;
+        } else {
+            if (fwrite(text, sizeof(uint32_t), text_words, file_out) != text_words) {
+                status = EXIT_FAILURE;
+            }
+            if (fclose(file_out) != 0) status = EXIT_FAILURE;
+        }
+    }
+
+    free(text);
+    symbol_table_free(globals);
+    for (int i = 0; i < object_count; i++) {
+        object_free(objects[i]);
+    }
+    free(objects);
+    free(bases);
+    free(in_file_names);
+    return status;
+}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "listing.h"
+
+// Blank address and encoding columns, for lines that emit nothing
+#define LISTING_BLANK_COLUMNS "                  "
+
+listing_t *listing_open(const char *filename, const char *source) {
+    listing_t *listing = calloc(1, sizeof(listing_t));
+    if (!listing) return NULL;
+
+    listing->source = fopen(source, "r");
+    listing->out = listing->source ? fopen(filename, "w") : NULL;
+    if (!listing->out) {
+        perror("Failed to open listing");
+        if (listing->source) fclose(listing->source);
+        free(listing);
+        return NULL;
+    }
+    listing->ok = true;
+    return listing;
+}
+
+// Reads the next source line into `text` without its newline, returning
+// false at the end of the source
+static bool next_line(listing_t *listing) {
+    ssize_t length = getline(&listing->text, &listing->text_size, listing->source);
+    if (length < 0) return false;
+
+    while (length > 0 && (listing->text[length - 1] == '\n' || listing->text[length - 1] == '\r')) {
+        listing->text[--length] = '\0';
+    }
+    listing->line++;
+    return true;
+}
+
+static void write_row(listing_t *listing, int line, const char *columns, const char *text) {
+    if (fprintf(listing->out, "%6d  %s  %s\n", line, columns, text) < 0) {
+        listing->ok = false;
+    }
+}
+
+void listing_add(listing_t *listing, const instruction_t *instructions, int instruction_count) {
+    for (int i = 0; i < instruction_count; i++) {
+        const instruction_t *instr = &instructions[i];
+
+        // Copy the lines that emit nothing, such as labels, up to this one
+        bool on_new_line = false;
+        while (listing->line < instr->line && next_line(listing)) {
+            on_new_line = listing->line == instr->line;
+            if (!on_new_line) {
+                write_row(listing, listing->line, LISTING_BLANK_COLUMNS, listing->text);
+            }
+        }
+
+        // Data is listed by its size rather than its contents
+        char columns[sizeof(LISTING_BLANK_COLUMNS) + 8];
+        if (instr->type == INSTR_DATA) {
+            snprintf(columns, sizeof(columns), "%08x  %7uB", instr->instr_address, instr->size);
+        } else {
+            snprintf(columns, sizeof(columns), "%08x  %08x", instr->instr_address, instr->encoded);
+        }
+        // Repeated and macro expanded lines come back to a line already
+        // copied, and are listed under its number without its text
+        write_row(listing, instr->line, columns, on_new_line ? listing->text : "");
+    }
+}
+
+bool listing_close(listing_t *listing) {
+    while (next_line(listing)) {
+        write_row(listing, listing->line, LISTING_BLANK_COLUMNS, listing->text);
+    }
+
+    bool ok = listing->ok && !ferror(listing->source);
+    if (fclose(listing->out) != 0) ok = false;
+    fclose(listing->source);
+    free(listing->text);
+    free(listing);
+    return ok;
+}
@@ -0,0 +1,67 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "instruction_representation.h"
+
+/**
+ * @struct listing_t
+ * @brief Listing file written alongside the output, one row per source line
+ *
+ * Each row holds the line number, then the address and encoding of the
+ * instruction or directive on that line, if there is one, then the line
+ * itself. Instructions are added in address order, as they become final,
+ * and the source is copied up to each one, so the listing can be written
+ * while a stream is still being assembled
+ *
+ * @var out Listing being written
+ * @var source The assembly source, read a second time for its lines
+ * @var line Number of source lines copied so far
+ * @var text Buffer holding the current source line
+ * @var text_size Capacity of `text`
+ * @var ok Whether every write so far succeeded
+ */
+
+typedef struct {
+    FILE *out;
+    FILE *source;
+    int line;
+    char *text;
+    size_t text_size;
+    bool ok;
+} listing_t;
+
+/**
+ * @brief Opens a listing for a source file
+ *
+ * @param filename Path of the listing to write
+ * @param source Path of the assembly source
+ * @return The listing, or NULL if either file cannot be opened
+ */
+
+listing_t *listing_open(const char *filename, const char *source);
+
+/**
+ * @brief Adds a run of final instructions to a listing
+ *
+ * Matches the calling convention of `instruction_sink_t`, so a stream
+ * can feed the listing as it writes the output
+ *
+ * @param listing Pointer to the listing
+ * @param instructions Array of instructions, in address order
+ * @param instruction_count Number of instructions
+ */
+
+void listing_add(listing_t *listing, const instruction_t *instructions, int instruction_count);
+
+/**
+ * @brief Copies the rest of the source to a listing and closes it
+ *
+ * @param listing Pointer to the listing, freed by this call
+ * @return true if the whole listing was written, false otherwise
+ */
+
+bool listing_close(listing_t *listing);
+
+#endif
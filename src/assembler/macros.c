@@ -0,0 +1,760 @@
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "macros.h"
+#include "diagnostics.h"
+
+// Directives handled here rather than by the parser, apart from `.int`
+static const char *const expander_directives[] = { ".macro", ".rept", ".equ", ".set" };
+
+static bool is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static bool is_operator(char c) {
+    return c != '\0' && strchr("+-*/%<>&|^~", c) != NULL;
+}
+
+// Directives whose operands are each a value, which may be an expression
+static const char *const data_directives[] = { ".byte", ".hword", ".quad", ".space", ".align" };
+
+static bool is_data_directive(const char *text) {
+    for (size_t i = 0; i < sizeof(data_directives) / sizeof(data_directives[0]); i++) {
+        if (strcmp(text, data_directives[i]) == 0) return true;
+    }
+    return false;
+}
+
+static bool is_expander_directive(const char *text) {
+    for (size_t i = 0; i < sizeof(expander_directives) / sizeof(expander_directives[0]); i++) {
+        if (strcmp(text, expander_directives[i]) == 0) return true;
+    }
+    return false;
+}
+
+// True for the numbers the parser reads itself, such as "12", "-4" or "0x1f"
+static bool is_plain_number(const char *text) {
+    const char *digits = text[0] == '-' ? text + 1 : text;
+    if (!isdigit((unsigned char)digits[0])) return false;
+
+    char *end;
+    strtoull(digits, &end, 0);
+    return *end == '\0';
+}
+
+bool macros_needed(token_list_t tokens) {
+    for (int i = 0; i < tokens->count; i++) {
+        const token_t *token = &tokens->tokens[i];
+        const char *text = token_text(tokens, token);
+
+        if (token->type == TOKEN_IMMEDIATE && !is_plain_number(text)) return true;
+        // The constant of `ldr rt, =value` may be an expression too
+        if (token->type == TOKEN_LITERAL && text[0] == '=' && !is_plain_number(text + 1)) return true;
+        if (token->type != TOKEN_DIRECTIVE) continue;
+        if (is_expander_directive(text)) return true;
+
+        // A `.int` value is one number followed by the end of the line
+        const token_t *value = &tokens->tokens[i + 1];
+        if (strcmp(text, ".int") == 0 && value->type != TOKEN_NEWLINE
+                && (!is_plain_number(token_text(tokens, value)) || value[1].type != TOKEN_NEWLINE)) {
+            return true;
+        }
+
+        // Data values are plain numbers, one to a token
+        if (is_data_directive(text)) {
+            for (; value->type != TOKEN_NEWLINE && value->type != TOKEN_EOF; value++) {
+                if (!is_plain_number(token_text(tokens, value))) return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool macros_in_source(const char *source, size_t len) {
+    for (const char *p = source; (p = memchr(p, '.', source + len - p)) != NULL; p++) {
+        for (size_t i = 0; i < sizeof(expander_directives) / sizeof(expander_directives[0]); i++) {
+            size_t length = strlen(expander_directives[i]);
+            if ((size_t)(source + len - p) >= length && memcmp(p, expander_directives[i], length) == 0
+                    && (p + length == source + len || !is_name_char(p[length]))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+macro_expander_t *macro_expander_create(token_list_t source) {
+    macro_expander_t *expander = calloc(1, sizeof(macro_expander_t));
+    assert(expander != NULL);
+
+    expander->source = source;
+    expander->macro_names = symbol_table_create();
+    expander->constants = symbol_table_create();
+
+    // The source itself is the outermost expansion, up to its end of file
+    expander->frames[0] = (macro_frame_t) { .end = source->count - 1 };
+    expander->depth = 1;
+    return expander;
+}
+
+static void free_args(char **args, int count) {
+    for (int i = 0; args && i < count; i++) {
+        free(args[i]);
+    }
+    free(args);
+}
+
+void macro_expander_free(macro_expander_t *expander) {
+    for (int i = 0; i < expander->depth; i++) {
+        const macro_t *macro = expander->frames[i].macro;
+        free_args(expander->frames[i].args, macro ? macro->param_count : 0);
+    }
+    for (int i = 0; i < expander->macro_count; i++) {
+        macro_t *macro = &expander->macros[i];
+        free_args(macro->params, macro->param_count);
+        free_args(macro->defaults, macro->param_count);
+        free(macro->name);
+    }
+    free(expander->macros);
+    symbol_table_free(expander->macro_names);
+    symbol_table_free(expander->constants);
+    free(expander->values);
+    free(expander->words);
+    free(expander->word_starts);
+    free(expander->word_commas);
+    free(expander->line);
+    free(expander);
+}
+
+// Grows a character buffer to hold at least `needed` bytes
+static void reserve_text(char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return;
+    while (*capacity < needed) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+    }
+    *buffer = realloc(*buffer, *capacity);
+    assert(*buffer != NULL);
+}
+
+static void words_append(macro_expander_t *expander, const char *text, size_t length) {
+    reserve_text(&expander->words, &expander->words_capacity, expander->words_length + length + 1);
+    memcpy(expander->words + expander->words_length, text, length);
+    expander->words_length += length;
+}
+
+static void words_begin(macro_expander_t *expander, bool after_comma) {
+    if (expander->word_count >= expander->word_capacity) {
+        expander->word_capacity = expander->word_capacity ? expander->word_capacity * 2 : 16;
+        expander->word_starts = realloc(expander->word_starts, expander->word_capacity * sizeof(size_t));
+        expander->word_commas = realloc(expander->word_commas, expander->word_capacity * sizeof(bool));
+        assert(expander->word_starts != NULL && expander->word_commas != NULL);
+    }
+    expander->word_commas[expander->word_count] = after_comma;
+    expander->word_starts[expander->word_count++] = expander->words_length;
+}
+
+static void words_end(macro_expander_t *expander) {
+    words_append(expander, "", 0);
+    expander->words[expander->words_length++] = '\0';
+}
+
+static char *word(const macro_expander_t *expander, int i) {
+    return expander->words + expander->word_starts[i];
+}
+
+// Returns a newly allocated copy of words `from` up to `to`, separated by spaces
+static char *join_words(const macro_expander_t *expander, int from, int to) {
+    size_t size = 1;
+    for (int i = from; i < to; i++) {
+        size += strlen(word(expander, i)) + 1;
+    }
+
+    char *text = malloc(size);
+    assert(text != NULL);
+    char *p = text;
+    for (int i = from; i < to; i++) {
+        if (i > from) *p++ = ' ';
+        size_t length = strlen(word(expander, i));
+        memcpy(p, word(expander, i), length);
+        p += length;
+    }
+    *p = '\0';
+    return text;
+}
+
+static void line_append(macro_expander_t *expander, const char *text, size_t length) {
+    reserve_text(&expander->line, &expander->line_capacity, expander->line_length + length + 1);
+    memcpy(expander->line + expander->line_length, text, length);
+    expander->line_length += length;
+}
+
+// The call whose arguments are substituted: the innermost macro frame,
+// which may have repetitions above it
+static const macro_frame_t *current_call(const macro_expander_t *expander) {
+    for (int i = expander->depth - 1; i >= 0; i--) {
+        if (expander->frames[i].macro) return &expander->frames[i];
+    }
+    return NULL;
+}
+
+static int find_param(const macro_t *macro, const char *name, size_t length) {
+    for (int i = 0; i < macro->param_count; i++) {
+        if (strlen(macro->params[i]) == length && strncmp(macro->params[i], name, length) == 0) return i;
+    }
+    return -1;
+}
+
+// Appends `text` to the current word, replacing `\param` with the
+// argument of the current call, `\@` with the number of the call and
+// `\()` with nothing, so an argument can run into the text after it
+static void append_substituted(macro_expander_t *expander, const char *text, size_t length) {
+    const macro_frame_t *call = current_call(expander);
+    size_t i = 0;
+
+    while (i < length) {
+        const char *slash = call ? memchr(text + i, '\\', length - i) : NULL;
+        if (!slash) {
+            words_append(expander, text + i, length - i);
+            return;
+        }
+        words_append(expander, text + i, slash - (text + i));
+        i = slash - text + 1;
+
+        if (i < length && text[i] == '@') {
+            char number[16];
+            int n = snprintf(number, sizeof(number), "%" PRIu32, call->expansion);
+            words_append(expander, number, n);
+            i++;
+            continue;
+        }
+        if (i + 1 < length && text[i] == '(' && text[i + 1] == ')') {
+            i += 2;
+            continue;
+        }
+
+        size_t name_end = i;
+        while (name_end < length && is_name_char(text[name_end])) name_end++;
+        int param = find_param(call->macro, text + i, name_end - i);
+        if (param < 0) {
+            words_append(expander, "\\", 1);
+            continue;
+        }
+        words_append(expander, call->args[param], strlen(call->args[param]));
+        i = name_end;
+    }
+}
+
+// Splits the line of source tokens starting at `first` into words, with
+// the arguments of the current call substituted. An expression stays in
+// one word even if it has spaces in it, when it is in parentheses or is
+// an immediate whose tokens meet at an operator. Returns the index of the
+// newline token ending the line
+static int read_words(macro_expander_t *expander, int first) {
+    token_list_t source = expander->source;
+    expander->words_length = 0;
+    expander->word_count = 0;
+
+    int depth = 0;
+    int i = first;
+    for (; source->tokens[i].type != TOKEN_NEWLINE && source->tokens[i].type != TOKEN_EOF; i++) {
+        const token_t *token = &source->tokens[i];
+        const char *text = token_text(source, token);
+
+        bool join = depth > 0;
+        if (!join && expander->word_count > 0 && token->type != TOKEN_IMMEDIATE) {
+            const char *previous = word(expander, expander->word_count - 1);
+            size_t length = strlen(previous);
+            join = previous[0] == '#' && (is_operator(previous[length - 1]) || is_operator(text[0]));
+            if (join) expander->words_length--; // Reopen it, dropping its terminator
+        }
+        if (join) {
+            words_append(expander, " ", 1);
+        } else {
+            words_begin(expander, token->after_comma);
+        }
+
+        switch (token->type) {
+            case TOKEN_LBRACKET:
+                words_append(expander, "[", 1);
+                break;
+            case TOKEN_RBRACKET:
+                words_append(expander, "]", 1);
+                break;
+            case TOKEN_EXCLAMATION:
+                words_append(expander, "!", 1);
+                break;
+            case TOKEN_IMMEDIATE:
+                words_append(expander, "#", 1);
+                append_substituted(expander, text, token->length);
+                break;
+            case TOKEN_LABEL:
+                append_substituted(expander, text, token->length);
+                words_append(expander, ":", 1);
+                break;
+            default:
+                append_substituted(expander, text, token->length);
+                break;
+        }
+
+        for (uint32_t j = 0; j < token->length; j++) {
+            if (text[j] == '(') {
+                depth++;
+            } else if (text[j] == ')' && depth > 0) {
+                depth--;
+            }
+        }
+        if (depth == 0) words_end(expander);
+    }
+    if (depth > 0) words_end(expander);
+    return i;
+}
+
+// Index of the first token of the line after the one holding token `i`
+static int line_after(token_list_t source, int i) {
+    while (source->tokens[i].type != TOKEN_NEWLINE && source->tokens[i].type != TOKEN_EOF) i++;
+    return source->tokens[i].type == TOKEN_NEWLINE ? i + 1 : i;
+}
+
+// Finds the `close` directive ending a block whose body starts at
+// `first`, passing over blocks of the same kind nested inside it.
+// Returns its index, or -1 if the block is still open at `end`
+static int find_block_end(token_list_t source, int first, int end, const char *open, const char *close) {
+    int nesting = 0;
+    for (int i = first; i < end; i = line_after(source, i)) {
+        const token_t *token = &source->tokens[i];
+        if (token->type != TOKEN_DIRECTIVE) continue;
+
+        const char *text = token_text(source, token);
+        if (strcmp(text, open) == 0) {
+            nesting++;
+        } else if (strcmp(text, close) == 0 && nesting-- == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Constant expressions, evaluated with 64-bit wrapping arithmetic and C
+ * operator precedence: unary - ~ +, then * / %, + -, << >>, &, ^ and |
+ */
+
+typedef struct {
+    const char *p;
+    const macro_expander_t *expander;
+    char error[96];
+} expression_t;
+
+static int64_t parse_or(expression_t *e);
+
+static void skip_space(expression_t *e) {
+    while (isspace((unsigned char)*e->p)) e->p++;
+}
+
+static void fail(expression_t *e, const char *message) {
+    if (e->error[0] == '\0') snprintf(e->error, sizeof(e->error), "%s", message);
+}
+
+static int64_t parse_unary(expression_t *e) {
+    skip_space(e);
+    char c = *e->p;
+
+    if (c == '-' || c == '~' || c == '+') {
+        e->p++;
+        uint64_t operand = parse_unary(e);
+        return c == '-' ? (int64_t)(0 - operand) : c == '~' ? (int64_t)~operand : (int64_t)operand;
+    }
+    if (c == '(') {
+        e->p++;
+        int64_t value = parse_or(e);
+        skip_space(e);
+        if (*e->p == ')') {
+            e->p++;
+        } else {
+            fail(e, "Expected ')'");
+        }
+        return value;
+    }
+    if (isdigit((unsigned char)c)) {
+        char *end;
+        int64_t value = strtoull(e->p, &end, 0);
+        e->p = end;
+        if (is_name_char(*e->p)) fail(e, "Malformed number");
+        return value;
+    }
+    if (isalpha((unsigned char)c) || c == '_' || c == '.') {
+        const char *start = e->p;
+        while (is_name_char(*e->p) || *e->p == '.') e->p++;
+
+        char name[64];
+        snprintf(name, sizeof(name), "%.*s", (int)(e->p - start), start);
+        uint32_t index = symbol_table_get(e->expander->constants, name);
+        if (index == NOT_FOUND) {
+            char message[sizeof(e->error)];
+            snprintf(message, sizeof(message), "Undefined constant '%s'", name);
+            fail(e, message);
+            return 0;
+        }
+        return e->expander->values[index];
+    }
+
+    fail(e, "Expected a number or constant");
+    return 0;
+}
+
+static int64_t parse_multiplicative(expression_t *e) {
+    int64_t value = parse_unary(e);
+    for (;;) {
+        skip_space(e);
+        char op = *e->p;
+        if (op != '*' && op != '/' && op != '%') return value;
+        e->p++;
+
+        int64_t rhs = parse_unary(e);
+        if (op == '*') {
+            value = (int64_t)((uint64_t)value * (uint64_t)rhs);
+        } else if (rhs == 0 || (value == INT64_MIN && rhs == -1)) {
+            fail(e, "Division by zero or overflow");
+        } else {
+            value = op == '/' ? value / rhs : value % rhs;
+        }
+    }
+}
+
+static int64_t parse_additive(expression_t *e) {
+    int64_t value = parse_multiplicative(e);
+    for (;;) {
+        skip_space(e);
+        char op = *e->p;
+        if (op != '+' && op != '-') return value;
+        e->p++;
+
+        uint64_t rhs = parse_multiplicative(e);
+        value = op == '+' ? (int64_t)((uint64_t)value + rhs) : (int64_t)((uint64_t)value - rhs);
+    }
+}
+
+static int64_t parse_shift(expression_t *e) {
+    int64_t value = parse_additive(e);
+    for (;;) {
+        skip_space(e);
+        bool left = e->p[0] == '<' && e->p[1] == '<';
+        bool right = e->p[0] == '>' && e->p[1] == '>';
+        if (!left && !right) return value;
+        e->p += 2;
+
+        int64_t amount = parse_additive(e);
+        if (amount < 0 || amount > 63) {
+            fail(e, "Shift amount out of range");
+        } else {
+            value = left ? (int64_t)((uint64_t)value << amount) : value >> amount;
+        }
+    }
+}
+
+static int64_t parse_and(expression_t *e) {
+    int64_t value = parse_shift(e);
+    while (skip_space(e), *e->p == '&') {
+        e->p++;
+        value &= parse_shift(e);
+    }
+    return value;
+}
+
+static int64_t parse_xor(expression_t *e) {
+    int64_t value = parse_and(e);
+    while (skip_space(e), *e->p == '^') {
+        e->p++;
+        value ^= parse_and(e);
+    }
+    return value;
+}
+
+static int64_t parse_or(expression_t *e) {
+    int64_t value = parse_xor(e);
+    while (skip_space(e), *e->p == '|') {
+        e->p++;
+        value |= parse_xor(e);
+    }
+    return value;
+}
+
+// Evaluates `text`, reporting any error against `line_no`
+static bool evaluate(const macro_expander_t *expander, const char *text, int line_no, int64_t *value) {
+    expression_t e = { .p = text, .expander = expander };
+    *value = parse_or(&e);
+    skip_space(&e);
+    if (*e.p != '\0') fail(&e, "Unexpected text after expression");
+
+    if (e.error[0] != '\0') {
+        diag_error(line_no, "Error: %s in '%s'\n", e.error, text);
+        return false;
+    }
+    return true;
+}
+
+// Evaluates words `from` onwards as one expression
+static bool evaluate_words(const macro_expander_t *expander, int from, int line_no, int64_t *value) {
+    char *text = join_words(expander, from, expander->word_count);
+    bool ok = evaluate(expander, text, line_no, value);
+    free(text);
+    return ok;
+}
+
+// Appends the value of an expression to the line, leaving plain numbers
+// as they were written
+static void append_value(macro_expander_t *expander, const char *text, int line_no) {
+    if (is_plain_number(text)) {
+        line_append(expander, text, strlen(text));
+        return;
+    }
+
+    int64_t value = 0;
+    evaluate(expander, text, line_no, &value);
+    char number[24];
+    int n = snprintf(number, sizeof(number), "%" PRId64, value);
+    line_append(expander, number, n);
+}
+
+static macro_frame_t *push_frame(macro_expander_t *expander, int line_no) {
+    if (expander->depth >= MACRO_MAX_DEPTH) {
+        diag_error(line_no, "Error: Macros and repetitions nested more than %d deep\n", MACRO_MAX_DEPTH);
+        return NULL;
+    }
+    macro_frame_t *frame = &expander->frames[expander->depth++];
+    *frame = (macro_frame_t) { 0 };
+    return frame;
+}
+
+static void pop_frame(macro_expander_t *expander) {
+    macro_frame_t *frame = &expander->frames[--expander->depth];
+    if (frame->macro) {
+        free_args(frame->args, frame->macro->param_count);
+    }
+}
+
+// `.macro name param param=default ...` up to the matching `.endm`
+static void define_macro(macro_expander_t *expander, macro_frame_t *frame, int line_no) {
+    int body_first = frame->cursor;
+    int body_end = find_block_end(expander->source, body_first, frame->end, ".macro", ".endm");
+    if (body_end < 0) {
+        diag_error(line_no, "Error: .macro without a matching .endm\n");
+        frame->cursor = frame->end;
+        return;
+    }
+    frame->cursor = line_after(expander->source, body_end);
+
+    if (expander->word_count < 2) {
+        diag_error(line_no, "Error: Expected a macro name after .macro\n");
+        return;
+    }
+    char *name = word(expander, 1);
+    if (symbol_table_find(expander->macro_names, name)) {
+        diag_error(line_no, "Error: Macro '%s' is already defined\n", name);
+        return;
+    }
+
+    if (expander->macro_count >= expander->macro_capacity) {
+        expander->macro_capacity = expander->macro_capacity ? expander->macro_capacity * 2 : MACRO_INITIAL_CAPACITY;
+        expander->macros = realloc(expander->macros, expander->macro_capacity * sizeof(macro_t));
+        assert(expander->macros != NULL);
+    }
+
+    int param_count = expander->word_count - 2;
+    macro_t *macro = &expander->macros[expander->macro_count];
+    *macro = (macro_t) {
+        .name = strdup(name),
+        .param_count = param_count,
+        .params = calloc(param_count + 1, sizeof(char *)),
+        .defaults = calloc(param_count + 1, sizeof(char *)),
+        .body_first = body_first,
+        .body_end = body_end
+    };
+    assert(macro->params != NULL && macro->defaults != NULL);
+
+    for (int i = 0; i < param_count; i++) {
+        const char *param = word(expander, i + 2);
+        const char *equals = strchr(param, '=');
+        macro->params[i] = strndup(param, equals ? (size_t)(equals - param) : strlen(param));
+        macro->defaults[i] = equals ? strdup(equals + 1) : NULL;
+    }
+    symbol_table_append(expander->macro_names, macro->name, expander->macro_count++);
+}
+
+// Pushes a call of `macro`, taking the words after its name as arguments.
+// Arguments are separated by commas, so one may have spaces in it, as an
+// expression can. A comma in brackets, as in an address, or in
+// parentheses does not end an argument
+static void call_macro(macro_expander_t *expander, const macro_t *macro, int line_no) {
+    char **args = calloc(macro->param_count + 1, sizeof(char *));
+    assert(args != NULL);
+
+    int arg = 0;
+    for (int i = 1; i < expander->word_count; ) {
+        int from = i;
+        int depth = 0;
+        do {
+            for (const char *p = word(expander, i); *p; p++) {
+                depth += (*p == '[' || *p == '(') - (*p == ']' || *p == ')');
+            }
+            i++;
+        } while (i < expander->word_count && (depth > 0 || !expander->word_commas[i]));
+
+        if (arg < macro->param_count) {
+            args[arg++] = join_words(expander, from, i);
+        } else {
+            diag_error(line_no, "Error: Too many arguments to macro '%s'\n", macro->name);
+            break;
+        }
+    }
+    for (; arg < macro->param_count; arg++) {
+        if (!macro->defaults[arg]) {
+            diag_error(line_no, "Error: Missing argument '%s' to macro '%s'\n", macro->params[arg], macro->name);
+        }
+        args[arg] = strdup(macro->defaults[arg] ? macro->defaults[arg] : "");
+    }
+
+    macro_frame_t *frame = push_frame(expander, line_no);
+    if (!frame) {
+        free_args(args, macro->param_count);
+        return;
+    }
+    frame->macro = macro;
+    frame->args = args;
+    frame->expansion = expander->expansions++;
+    frame->first = frame->cursor = macro->body_first;
+    frame->end = macro->body_end;
+}
+
+// `.rept count` up to the matching `.endr`
+static void begin_repeat(macro_expander_t *expander, macro_frame_t *frame, int line_no) {
+    int body_first = frame->cursor;
+    int body_end = find_block_end(expander->source, body_first, frame->end, ".rept", ".endr");
+    if (body_end < 0) {
+        diag_error(line_no, "Error: .rept without a matching .endr\n");
+        frame->cursor = frame->end;
+        return;
+    }
+    frame->cursor = line_after(expander->source, body_end);
+
+    int64_t count;
+    if (!evaluate_words(expander, 1, line_no, &count)) return;
+    if (count < 0 || count > UINT32_MAX) {
+        diag_error(line_no, "Error: Repeat count %" PRId64 " out of range\n", count);
+        return;
+    }
+    if (count == 0 || body_first == body_end) return;
+
+    macro_frame_t *repeat = push_frame(expander, line_no);
+    if (!repeat) return;
+    repeat->first = repeat->cursor = body_first;
+    repeat->end = body_end;
+    repeat->remaining = count - 1;
+}
+
+// `.equ name, value` or `.set name, value`; either may redefine a constant
+static void define_constant(macro_expander_t *expander, int line_no) {
+    char *name = word(expander, 1);
+    if (expander->word_count < 3 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        diag_error(line_no, "Error: Expected a name and a value after %s\n", word(expander, 0));
+        return;
+    }
+
+    int64_t value;
+    if (!evaluate_words(expander, 2, line_no, &value)) return;
+
+    uint32_t index = symbol_table_get(expander->constants, name);
+    if (index == NOT_FOUND) {
+        if (expander->value_count >= expander->value_capacity) {
+            expander->value_capacity = expander->value_capacity ? expander->value_capacity * 2 : MACRO_INITIAL_CAPACITY;
+            expander->values = realloc(expander->values, expander->value_capacity * sizeof(int64_t));
+            assert(expander->values != NULL);
+        }
+        index = expander->value_count++;
+        symbol_table_append(expander->constants, name, index);
+    }
+    expander->values[index] = value;
+}
+
+// Carries out the line in the words if it is a definition, repetition
+// or macro call, returning false if it is left for the parser
+static bool expand_directive(macro_expander_t *expander, macro_frame_t *frame, int line_no) {
+    char *head = word(expander, 0);
+
+    if (strcmp(head, ".macro") == 0) {
+        define_macro(expander, frame, line_no);
+    } else if (strcmp(head, ".rept") == 0) {
+        begin_repeat(expander, frame, line_no);
+    } else if (strcmp(head, ".equ") == 0 || strcmp(head, ".set") == 0) {
+        define_constant(expander, line_no);
+    } else if (strcmp(head, ".endm") == 0 || strcmp(head, ".endr") == 0) {
+        diag_error(line_no, "Error: %s without a matching block\n", head);
+    } else {
+        uint32_t index = symbol_table_get(expander->macro_names, head);
+        if (index == NOT_FOUND) return false;
+        call_macro(expander, &expander->macros[index], line_no);
+    }
+    return true;
+}
+
+// Writes the words out as a line for the parser, evaluating immediates, literal constants,
+// `.int` and data values and replacing constants used as operands
+static void write_line(macro_expander_t *expander, token_list_t line, int line_no) {
+    expander->line_length = 0;
+
+    if (strcmp(word(expander, 0), ".int") == 0 && expander->word_count > 1) {
+        char *value = join_words(expander, 1, expander->word_count);
+        line_append(expander, ".int ", 5);
+        append_value(expander, value, line_no);
+        free(value);
+    } else {
+        bool data = is_data_directive(word(expander, 0));
+        for (int i = 0; i < expander->word_count; i++) {
+            char *text = word(expander, i);
+            if (i > 0) line_append(expander, " ", 1);
+
+            if (data && i > 0) {
+                append_value(expander, text, line_no);
+            } else if (text[0] == '#' || (i > 0 && text[0] == '=')) {
+                line_append(expander, text, 1);
+                append_value(expander, text + 1, line_no);
+            } else if (i > 0 && symbol_table_find(expander->constants, text)) {
+                append_value(expander, text, line_no);
+            } else {
+                line_append(expander, text, strlen(text));
+            }
+        }
+    }
+
+    // The tokeniser needs a spare zero byte past the end
+    line_append(expander, "\n", 1);
+    expander->line[expander->line_length] = '\0';
+    tokenise_into(line, expander->line, expander->line_length, line_no);
+}
+
+bool macro_expander_next_line(macro_expander_t *expander, token_list_t line) {
+    while (expander->depth > 0) {
+        macro_frame_t *frame = &expander->frames[expander->depth - 1];
+        if (frame->cursor >= frame->end) {
+            if (frame->remaining > 0) {
+                frame->remaining--;
+                frame->cursor = frame->first;
+            } else {
+                pop_frame(expander);
+            }
+            continue;
+        }
+
+        int first = frame->cursor;
+        frame->cursor = read_words(expander, first) + 1;
+        if (expander->word_count == 0) continue;
+
+        // Expanded lines keep the line number of the body line they come from
+        int line_no = expander->source->tokens[first].line;
+        if (expand_directive(expander, frame, line_no)) continue;
+
+        write_line(expander, line, line_no);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,171 @@
+#ifndef MACROS_H
+#define MACROS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tokens.h"
+#include "symbol_table.h"
+
+// Deepest nesting of macro calls and repetitions, which stops a macro
+// that calls itself
+#define MACRO_MAX_DEPTH 256
+
+#define MACRO_INITIAL_CAPACITY 16
+
+/**
+ * @struct macro_t
+ * @brief A macro defined with `.macro`, whose body is a range of source tokens
+ *
+ * @var name Name the macro is called by
+ * @var param_count Number of parameters
+ * @var params Parameter names, referred to in the body as `\name`
+ * @var defaults Value of each parameter when a call leaves it out, or NULL
+ * @var body_first Index of the first token of the body
+ * @var body_end Index of the `.endm` directive ending the body
+ */
+
+typedef struct {
+    char *name;
+    int param_count;
+    char **params;
+    char **defaults;
+    int body_first;
+    int body_end;
+} macro_t;
+
+/**
+ * @struct macro_frame_t
+ * @brief One level of expansion: the source itself, a macro call or a `.rept`
+ *
+ * @var macro Macro being expanded, or NULL for the source and repetitions
+ * @var args Arguments of a macro call, one per parameter
+ * @var expansion Number of the macro call, which `\@` expands to
+ * @var first Index of the first token of the lines being expanded
+ * @var end Index just past the last of those tokens
+ * @var cursor Index of the next line to expand
+ * @var remaining Times the lines are repeated after this pass
+ */
+
+typedef struct {
+    const macro_t *macro;
+    char **args;
+    uint32_t expansion;
+    int first;
+    int end;
+    int cursor;
+    uint32_t remaining;
+} macro_frame_t;
+
+/**
+ * @struct macro_expander_t
+ * @brief Expands macros, repetitions and constants one line at a time
+ *
+ * Only the stack of calls and repetitions being expanded is held, so a
+ * long `.rept` costs no more memory than a single pass of its body. Each
+ * line is rewritten into `line`, with its arguments and constants
+ * substituted and its expressions evaluated, and tokenised again
+ *
+ * @var source Token list of the whole source, which outlives the expander
+ * @var frames Stack of the expansions in progress
+ * @var depth Number of frames on the stack
+ * @var macros Macros defined so far
+ * @var macro_count Number of macros defined
+ * @var macro_capacity Capacity of `macros`
+ * @var macro_names Index in `macros` of each macro name
+ * @var constants Index in `values` of each `.equ` or `.set` name
+ * @var values Values of the constants
+ * @var value_count Number of constants
+ * @var value_capacity Capacity of `values`
+ * @var expansions Number of macro calls expanded so far
+ * @var words The words of the line being expanded, one after another
+ * @var word_starts Offset of each word in `words`
+ * @var word_commas Whether a comma comes before each word
+ * @var word_count Number of words in the line
+ * @var line Text of the expanded line, handed to the tokeniser
+ */
+
+typedef struct {
+    token_list_t source;
+    macro_frame_t frames[MACRO_MAX_DEPTH];
+    int depth;
+    macro_t *macros;
+    int macro_count;
+    int macro_capacity;
+    symbol_table macro_names;
+    symbol_table constants;
+    int64_t *values;
+    uint32_t value_count;
+    uint32_t value_capacity;
+    uint32_t expansions;
+    char *words;
+    size_t words_length;
+    size_t words_capacity;
+    size_t *word_starts;
+    bool *word_commas;
+    int word_count;
+    int word_capacity;
+    char *line;
+    size_t line_length;
+    size_t line_capacity;
+} macro_expander_t;
+
+/**
+ * @brief Checks whether a source needs expanding before it is parsed
+ *
+ * True if it uses `.macro`, `.rept`, `.equ` or `.set`, or has an
+ * immediate or `.int` value that is an expression rather than a number.
+ * Other sources are parsed straight from their tokens
+ *
+ * @param tokens Token list of the whole source
+ * @return true if the source must go through a macro_expander_t
+ */
+
+bool macros_needed(token_list_t tokens);
+
+/**
+ * @brief Checks the text of a source for the directives that define macros and constants
+ *
+ * Unlike macros_needed this works before tokenising, so a source can be
+ * kept whole rather than split into chunks that would not see the
+ * definitions made in other chunks
+ *
+ * @param source Assembly source text
+ * @param len Length of the source in bytes
+ * @return true if the source may define macros, repetitions or constants
+ */
+
+bool macros_in_source(const char *source, size_t len);
+
+/**
+ * @brief Creates an expander over the tokens of a whole source
+ *
+ * @param source Token list of the source, which must outlive the expander
+ * @return Pointer to the new expander
+ */
+
+macro_expander_t *macro_expander_create(token_list_t source);
+
+/**
+ * @brief Expands the next line that holds a label, instruction or data directive
+ *
+ * The line replaces the tokens of `line`, which point into a buffer
+ * that the following call reuses. Definitions, repetitions and macro
+ * calls are carried out on the way, reporting their errors as diagnostics
+ *
+ * @param expander Pointer to the expander
+ * @param line Token list that receives the line's tokens, then end of file
+ * @return true if a line was expanded, false at the end of the source
+ */
+
+bool macro_expander_next_line(macro_expander_t *expander, token_list_t line);
+
+/**
+ * @brief Frees an expander and the macros it defined
+ *
+ * @param expander Pointer to the expander to free
+ */
+
+void macro_expander_free(macro_expander_t *expander);
+
+#endif
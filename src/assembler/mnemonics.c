@@ -0,0 +1,18 @@
+#include <string.h>
+#include "mnemonics.h"
+#include "mnemonic_hash.h" // generated: MNEMONIC_HASH_SEED, MNEMONIC_HASH_SIZE, mnemonic_slots
+
+const mnemonic_t mnemonic_table[MNEMONIC_COUNT] = {
+#define MNEMONIC(id, name, form, encoding, opc, N, canonical) \
+    [MN_##id] = { name, form, encoding, opc, N, &mnemonic_table[MN_##canonical] },
+#include "mnemonics.def"
+#undef MNEMONIC
+};
+
+const mnemonic_t *lookup_mnemonic(const char *str) {
+    int index = mnemonic_slots[mnemonic_hash(str, MNEMONIC_HASH_SEED) & (MNEMONIC_HASH_SIZE - 1)];
+    if (index < 0 || strcmp(mnemonic_table[index].name, str) != 0) {
+        return NULL;
+    }
+    return &mnemonic_table[index];
+}
@@ -0,0 +1,115 @@
+#ifndef MNEMONICS_H
+#define MNEMONICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @enum mnemonic_form_t
+ * @brief Operand layout the parser expects after a mnemonic
+ */
+
+typedef enum {
+    FORM_MULTIPLY,              // rd, rn, rm, ra
+    FORM_TWO_OPERAND,           // rd, rn, <operand>
+    FORM_ONE_OPERAND_W_DEST,    // rd, <operand>
+    FORM_TWO_OPERAND_WO_DEST,   // rn, <operand>
+    FORM_BRANCH,                // <label> or xn
+    FORM_LOAD,                  // rt, <address>
+    FORM_STORE                  // rt, <address>
+} mnemonic_form_t;
+
+/**
+ * @enum mnemonic_encoding_t
+ * @brief Encoding group whose opc bits the descriptor carries
+ */
+
+typedef enum {
+    ENC_ARITHMETIC,
+    ENC_LOGICAL,
+    ENC_MULTIPLY,
+    ENC_WIDE_MOVE,
+    ENC_BRANCH,
+    ENC_BRANCH_COND,
+    ENC_BRANCH_REG,
+    ENC_LOAD_STORE
+} mnemonic_encoding_t;
+
+/**
+ * @enum mnemonic_id_t
+ * @brief Index of each descriptor in `mnemonic_table`
+ */
+
+typedef enum {
+#define MNEMONIC(id, name, form, encoding, opc, N, canonical) MN_##id,
+#include "mnemonics.def"
+#undef MNEMONIC
+    MNEMONIC_COUNT
+} mnemonic_id_t;
+
+/**
+ * @struct mnemonic_t
+ * @brief Descriptor of a supported mnemonic
+ *
+ * There is one descriptor per mnemonic, so descriptors can be compared by
+ * pointer. Aliases (e.g. "cmp") point `canonical` at the instruction they
+ * assemble to ("subs"); every other descriptor points it at itself
+ *
+ * @var name Mnemonic as written in the source
+ * @var form Operand layout the parser expects
+ * @var encoding Encoding group the opc bits belong to
+ * @var opc opc bits (cond bits for conditional branches)
+ * @var N N bit of logical instructions
+ * @var canonical Descriptor of the instruction that is actually encoded
+ */
+
+typedef struct mnemonic {
+    const char *name;
+    mnemonic_form_t form;
+    mnemonic_encoding_t encoding;
+    uint8_t opc;
+    uint8_t N;
+    const struct mnemonic *canonical;
+} mnemonic_t;
+
+extern const mnemonic_t mnemonic_table[MNEMONIC_COUNT];
+
+/**
+ * @brief Hash used by the generated perfect hash table
+ *
+ * Shared with the generator, which searches for a seed under which every
+ * mnemonic lands in its own slot
+ *
+ * @param str Null terminated mnemonic
+ * @param seed Seed picked by the generator
+ * @return 32-bit hash
+ */
+
+static inline uint32_t mnemonic_hash(const char *str, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (; *str; str++) {
+        hash = (hash ^ (unsigned char)*str) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * @brief Looks up the descriptor of a mnemonic
+ *
+ * A single hash and string compare, with no probing
+ *
+ * @param str Null terminated mnemonic
+ * @return Pointer to the descriptor, or NULL if the mnemonic is not supported
+ */
+
+const mnemonic_t *lookup_mnemonic(const char *str);
+
+/**
+ * @brief Returns true if the descriptor is an alias of another instruction
+ */
+
+static inline bool mnemonic_is_alias(const mnemonic_t *mnemonic) {
+    return mnemonic->canonical != mnemonic;
+}
+
+#endif
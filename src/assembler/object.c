@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "object.h"
+
+#define OBJECT_HEADER_WORDS 5
+
+// Appends a null terminated name to the object's string table and
+// returns its offset
+static uint32_t add_string(object_t *object, uint32_t *capacity, const char *str) {
+    uint32_t length = strlen(str) + 1;
+    if (object->string_size + length > *capacity) {
+        while (object->string_size + length > *capacity) *capacity *= 2;
+        object->strings = realloc(object->strings, *capacity);
+        assert(object->strings != NULL);
+    }
+    uint32_t offset = object->string_size;
+    memcpy(object->strings + offset, str, length);
+    object->string_size += length;
+    return offset;
+}
+
+static bool is_address_literal(const instruction_t *instr) {
+    return instr->type == INSTR_LOAD_STORE && instr->address.type == LITERAL
+        && instr->address.value.literal.label == NULL;
+}
+
+object_t *object_build(instruction_t *instructions, int instruction_count, symbol_table symbols, fixup_list_t fixups) {
+    object_t *object = calloc(1, sizeof(object_t));
+    assert(object != NULL);
+
+    // Data may end the text part way through a word, so it is padded
+    // with zeros to the next one
+    uint32_t text_size = encoded_size(instructions, instruction_count);
+    object->text_words = (text_size + 3) / 4;
+    object->text = calloc(object->text_words ? object->text_words : 1, sizeof(uint32_t));
+    assert(object->text != NULL);
+    if (!copy_encoded_instructions((uint8_t *)object->text, instructions, instruction_count)) {
+        object_free(object);
+        return NULL;
+    }
+
+    // At most one undefined symbol and one relocation per fixup, plus a
+    // relocation for every literal that loads from an absolute address
+    int address_literals = 0;
+    for (int i = 0; i < instruction_count; i++) {
+        if (is_address_literal(&instructions[i])) address_literals++;
+    }
+    object->symbols = malloc(sizeof(object_symbol_t) * (symbols->len + fixups->count + 1));
+    object->relocations = malloc(sizeof(object_relocation_t) * (fixups->count + address_literals + 1));
+    uint32_t string_capacity = 256;
+    object->strings = malloc(string_capacity);
+    assert(object->symbols != NULL && object->relocations != NULL && object->strings != NULL);
+
+    for (uint32_t i = 0; i < symbols->capacity; i++) {
+        symbol_entry_t *entry = &symbols->entries[i];
+        // Internal labels are only ever referred to from this object, and
+        // would clash with those of the other objects
+        if (entry->dist == 0 || strncmp(entry->key, ".L", 2) == 0) continue;
+        object->symbols[object->symbol_count++] = (object_symbol_t) {
+            .name = add_string(object, &string_capacity, entry->key),
+            .value = entry->value,
+            .defined = 1
+        };
+    }
+
+    // Each undefined label gets a single symbol, however often it is used
+    symbol_table undefined = symbol_table_create();
+    for (int i = 0; i < fixups->count; i++) {
+        fixup_t *fixup = &fixups->fixups[i];
+        if (fixup->resolved) continue;
+
+        uint32_t symbol = symbol_table_get(undefined, (char *)fixup->label);
+        if (symbol == NOT_FOUND) {
+            symbol = object->symbol_count++;
+            object->symbols[symbol] = (object_symbol_t) {
+                .name = add_string(object, &string_capacity, fixup->label),
+                .value = 0,
+                .defined = 0
+            };
+            symbol_table_append(undefined, (char *)fixup->label, symbol);
+        }
+        object->relocations[object->relocation_count++] = (object_relocation_t) {
+            .offset = instructions[fixup->instr_index].instr_address,
+            .symbol = symbol,
+            .kind = fixup->kind,
+            .addend = 0
+        };
+    }
+    symbol_table_free(undefined);
+
+    // Address literals were encoded relative to an object placed at 0
+    for (int i = 0; i < instruction_count; i++) {
+        if (!is_address_literal(&instructions[i])) continue;
+        object->relocations[object->relocation_count++] = (object_relocation_t) {
+            .offset = instructions[i].instr_address,
+            .symbol = OBJECT_NO_SYMBOL,
+            .kind = FIXUP_IMM19,
+            .addend = instructions[i].address.value.literal.int_directive
+        };
+    }
+
+    return object;
+}
+
+bool object_write(FILE *file, const object_t *object) {
+    uint32_t header[OBJECT_HEADER_WORDS] = {
+        OBJECT_MAGIC, object->text_words, object->symbol_count,
+        object->relocation_count, object->string_size
+    };
+    return fwrite(header, sizeof(header), 1, file) == 1
+        && fwrite(object->text, sizeof(uint32_t), object->text_words, file) == object->text_words
+        && fwrite(object->symbols, sizeof(object_symbol_t), object->symbol_count, file) == object->symbol_count
+        && fwrite(object->relocations, sizeof(object_relocation_t), object->relocation_count, file) == object->relocation_count
+        && fwrite(object->strings, 1, object->string_size, file) == object->string_size;
+}
+
+// Checks every offset and index in a loaded object is in bounds
+static bool object_is_valid(const object_t *object) {
+    if (object->string_size > 0 && object->strings[object->string_size - 1] != '\0') return false;
+
+    uint32_t text_size = object->text_words * 4;
+    for (uint32_t i = 0; i < object->symbol_count; i++) {
+        const object_symbol_t *symbol = &object->symbols[i];
+        if (symbol->name >= object->string_size) return false;
+        if (symbol->defined && (symbol->value > text_size || symbol->value % 4 != 0)) return false;
+    }
+    for (uint32_t i = 0; i < object->relocation_count; i++) {
+        const object_relocation_t *reloc = &object->relocations[i];
+        if (reloc->offset >= text_size || reloc->offset % 4 != 0) return false;
+        if (reloc->symbol != OBJECT_NO_SYMBOL && reloc->symbol >= object->symbol_count) return false;
+        if (reloc->kind != FIXUP_IMM26 && reloc->kind != FIXUP_IMM19) return false;
+    }
+    return true;
+}
+
+object_t *object_load(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        perror("Failed to open object");
+        return NULL;
+    }
+
+    uint32_t header[OBJECT_HEADER_WORDS];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != OBJECT_MAGIC) {
+        fprintf(stderr, "Invalid object %s\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    // The counts must add up to the file's size before anything is allocated
+    fseek(file, 0, SEEK_END);
+    uint64_t expected = sizeof(header) + (uint64_t)header[1] * sizeof(uint32_t)
+        + (uint64_t)header[2] * sizeof(object_symbol_t)
+        + (uint64_t)header[3] * sizeof(object_relocation_t) + header[4];
+    if ((uint64_t)ftell(file) != expected) {
+        fprintf(stderr, "Truncated object %s\n", filename);
+        fclose(file);
+        return NULL;
+    }
+    fseek(file, sizeof(header), SEEK_SET);
+
+    object_t *object = calloc(1, sizeof(object_t));
+    assert(object != NULL);
+    object->text_words = header[1];
+    object->symbol_count = header[2];
+    object->relocation_count = header[3];
+    object->string_size = header[4];
+    object->text = malloc(sizeof(uint32_t) * object->text_words + 1);
+    object->symbols = malloc(sizeof(object_symbol_t) * object->symbol_count + 1);
+    object->relocations = malloc(sizeof(object_relocation_t) * object->relocation_count + 1);
+    object->strings = malloc(object->string_size + 1);
+    assert(object->text && object->symbols && object->relocations && object->strings);
+
+    bool ok = fread(object->text, sizeof(uint32_t), object->text_words, file) == object->text_words
+        && fread(object->symbols, sizeof(object_symbol_t), object->symbol_count, file) == object->symbol_count
+        && fread(object->relocations, sizeof(object_relocation_t), object->relocation_count, file) == object->relocation_count
+        && fread(object->strings, 1, object->string_size, file) == object->string_size
+        && object_is_valid(object);
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "Malformed object %s\n", filename);
+        object_free(object);
+        return NULL;
+    }
+    return object;
+}
+
+void object_free(object_t *object) {
+    if (!object) return;
+    free(object->text);
+    free(object->symbols);
+    free(object->relocations);
+    free(object->strings);
+    free(object);
+}
@@ -0,0 +1,113 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "instruction_representation.h"
+#include "symbol_table.h"
+#include "fixups.h"
+
+#define OBJECT_MAGIC 0x314F4241 // "ABO1"
+#define OBJECT_NO_SYMBOL (UINT32_MAX)
+
+/**
+ * @struct object_symbol_t
+ * @brief A label defined in an object, or one it refers to but leaves to the linker
+ *
+ * @var name Offset of the label's name in the string table
+ * @var value Address of the label within the object's text, if defined
+ * @var defined Whether the object defines the label
+ */
+
+typedef struct {
+    uint32_t name;
+    uint32_t value;
+    uint32_t defined;
+} object_symbol_t;
+
+/**
+ * @struct object_relocation_t
+ * @brief An instruction field the linker fills in once the text is placed
+ *
+ * The target is the address of `symbol` plus `addend`, or just `addend`
+ * for absolute targets (`ldr` of an address literal) with no symbol
+ *
+ * @var offset Address of the instruction within the object's text
+ * @var symbol Index of the target symbol, or OBJECT_NO_SYMBOL
+ * @var kind Field the word offset to the target goes into (a fixup_kind_t)
+ * @var addend Constant added to the target address
+ */
+
+typedef struct {
+    uint32_t offset;
+    uint32_t symbol;
+    uint32_t kind;
+    int32_t addend;
+} object_relocation_t;
+
+/**
+ * @struct object_t
+ * @brief A relocatable object: assembled text plus what is needed to place it
+ *
+ * On disk an object is a header of the magic number and the four counts
+ * below, followed by the text words, the symbols, the relocations and
+ * the string table of null terminated symbol names, in that order.
+ * Branches between labels of the same object are already encoded, as
+ * they do not change when the text is moved
+ */
+
+typedef struct {
+    uint32_t *text;
+    uint32_t text_words;
+    object_symbol_t *symbols;
+    uint32_t symbol_count;
+    object_relocation_t *relocations;
+    uint32_t relocation_count;
+    char *strings;
+    uint32_t string_size;
+} object_t;
+
+/**
+ * @brief Builds an object from assembled instructions
+ *
+ * Every label becomes a defined symbol. References still waiting in the
+ * fixup list become relocations against undefined symbols. The text is
+ * padded with zeros to a whole number of words
+ *
+ * @param instructions Array of encoded instructions
+ * @param instruction_count Number of instructions
+ * @param symbols Labels defined by the source
+ * @param fixups Fixups of the assembly, unresolved ones included
+ * @return object_t* Newly allocated object, freed with object_free, or NULL if an included file could not be read
+ */
+
+object_t *object_build(instruction_t *instructions, int instruction_count, symbol_table symbols, fixup_list_t fixups);
+
+/**
+ * @brief Writes an object to a file
+ *
+ * @param file File pointer opened in binary write mode, left open
+ * @param object Object to write
+ * @return true on success, false on failure
+ */
+
+bool object_write(FILE *file, const object_t *object);
+
+/**
+ * @brief Loads and validates an object file
+ *
+ * @param filename Path to the object
+ * @return object_t* Loaded object, or NULL if it is missing or malformed
+ */
+
+object_t *object_load(const char *filename);
+
+/**
+ * @brief Frees an object
+ * @param object Object to free
+ */
+
+void object_free(object_t *object);
+
+#endif
@@ -1,7 +1,14 @@
+#include <pthread.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <inttypes.h>
 #include "parser.h"
+#include "encoding_functions.h"
+#include "macros.h"
+#include "layout.h"
 
 
-parser_state_t *create_parser_state(void) {
+parser_state_t *create_parser_state_in_arena(arena_t *arena) {
     parser_state_t *state = malloc(sizeof(parser_state_t));
 
     if (!state) {
@@ -14,62 +21,90 @@ parser_state_t *create_parser_state(void) {
     state->instruction_count = 0;
     state->instruction_capacity = INITIAL_INSTRUCTION_CAPACITY;
 
-    state->instructions = malloc(sizeof(instruction_t*) * state->instruction_capacity);
+    state->instructions = malloc(sizeof(instruction_t) * state->instruction_capacity);
     assert(state->instructions != NULL);
 
     state->pc = 0;
     state->current_line = 1;
+    state->arena = arena;
+    state->owns_arena = false;
+    state->symbols = symbol_table_create_in_arena(state->arena);
+    state->fixups = fixup_list_create(state->arena);
+    state->defer_encoding = false;
+    state->relocatable = false;
+    state->includes_files = false;
+    state->sink = NULL;
+    state->sink_context = NULL;
+    state->first_index = 0;
+    state->pool = (literal_pool_t) { .lookup = symbol_table_create_in_arena(state->arena) };
+    state->after_jump = false;
+    state->internal_labels = 0;
+    return state;
+}
+
+parser_state_t *create_parser_state(void) {
+    parser_state_t *state = create_parser_state_in_arena(arena_create());
+    state->owns_arena = true;
     return state;
 }
 
-void add_instruction_to_parser_state(parser_state_t *state, instruction_t *instr) {
+instruction_t *add_instruction_to_parser_state(parser_state_t *state) {
     if (state->instruction_count+1 >= state->instruction_capacity) {
         state->instruction_capacity *= 2;
-        state->instructions = realloc(state->instructions, state->instruction_capacity * sizeof(instruction_t *));
+        state->instructions = realloc(state->instructions, state->instruction_capacity * sizeof(instruction_t));
         assert(state->instructions != NULL);
     }
-    state->instructions[state->instruction_count++] = instr;
+    instruction_t *instr = &state->instructions[state->instruction_count++];
+    init_instruction(instr);
+    return instr;
+}
+
+char *new_internal_label(parser_state_t *state, const char *kind) {
+    char name[64];
+    int length = snprintf(name, sizeof(name), ".L%s%d", kind, state->internal_labels++);
+    return arena_strndup(state->arena, name, length);
 }
 
 void free_parser_state(parser_state_t *parser) {
     if (!parser) return;
+    free(parser->instructions);
+    free(parser->pool.entries);
+    symbol_table_free(parser->pool.lookup);
+    symbol_table_free(parser->symbols);
+    free_fixup_list(parser->fixups);
+    // Labels in instructions and fixups point into the token source
     free_token_list(parser->tokens);
-     // Free instructions
-    for (int i = 0; i < parser->instruction_count; i++) {
-        if (parser->instructions[i]) {
-            free_instruction(parser->instructions[i]);
-        }
+    // Symbol keys are interned in the arena, so it goes last
+    if (parser->owns_arena) {
+        arena_destroy(parser->arena);
     }
-    free(parser->instructions);
     free(parser);
 }
 
-void parse_dp(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
-    char *opc = mnemonic->value;
-    
-    if (IS_DP_MULTIPLY(opc)) {
+void parse_dp(instruction_t *instr, token_list_t tokens, const mnemonic_t *mnemonic) {
+    if (mnemonic->form == FORM_MULTIPLY) {
         // First, get the registers as tokens
         token_t *rd_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after multiply mnemonic\n"
+                "Expected a register token after multiply mnemonic"
             );
         token_t *rn_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after first register in multiply\n"
+                "Expected a register token after first register in multiply"
             );
         token_t *rm_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after second register in multiply\n"
+                "Expected a register token after second register in multiply"
             );
         token_t *ra_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after third register in multiply\n"
+                "Expected a register token after third register in multiply"
             );
         // Then, create `reg_t` structs for each register token defined above
-        reg_t rd = string_to_reg_t(rd_tok->value);
-        reg_t rn = string_to_reg_t(rn_tok->value);
-        reg_t rm = string_to_reg_t(rm_tok->value);
-        reg_t ra = string_to_reg_t(ra_tok->value);
+        reg_t rd = string_to_reg_t(token_text(tokens, rd_tok));
+        reg_t rn = string_to_reg_t(token_text(tokens, rn_tok));
+        reg_t rm = string_to_reg_t(token_text(tokens, rm_tok));
+        reg_t ra = string_to_reg_t(token_text(tokens, ra_tok));
 
         // Set up the instruction
         instr->type = INSTR_MULTIPLY;
@@ -77,28 +112,28 @@ void parse_dp(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
         instr->rn = rn;
         instr->rm = rm;
         instr->ra = ra;
-    } else if (IS_DP_TWO_OPERAND(opc)) {
+    } else if (mnemonic->form == FORM_TWO_OPERAND) {
          // First, get the registers as tokens
         token_t *rd_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after two operand mnemonic\n"
+                "Expected a register token after two operand mnemonic"
             );
         token_t *rn_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after first register in two operand instruction\n"
+                "Expected a register token after first register in two operand instruction"
             );
        
         operand_t operand = parse_operand(tokens, instr);
 
         // Then, create `reg_t` structs for each register token defined above
-        reg_t rd = string_to_reg_t(rd_tok->value);
-        reg_t rn = string_to_reg_t(rn_tok->value);
+        reg_t rd = string_to_reg_t(token_text(tokens, rd_tok));
+        reg_t rn = string_to_reg_t(token_text(tokens, rn_tok));
 
         instr->rd = rd;
         instr->rn = rn;
         // if it is an alias, then parse accordingly
-        if (IS_OPC_ALIAS(opc)) {
-            strncpy(instr->mnemonic, resolve_alias_mnemonic(opc), sizeof(instr->mnemonic));
+        if (mnemonic_is_alias(mnemonic)) {
+            strncpy(instr->mnemonic, mnemonic->canonical->name, sizeof(instr->mnemonic));
             reg_t rm = operand.value.reg;
             reg_t rzr = {.type = (rd.type == REG_X || rd.type == REG_XZR) ? REG_XZR : REG_WZR, .number = 31};
             instr->type = INSTR_MULTIPLY;
@@ -107,30 +142,30 @@ void parse_dp(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
             return;
         }
         instr->operand = operand;
-    } else if (IS_DP_ONE_OPERAND_W_DEST(opc)) {
+    } else if (mnemonic->form == FORM_ONE_OPERAND_W_DEST) {
         // deal with aliases
         // First, get the registers as tokens
         token_t *rd_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after two operand mnemonic\n"
+                "Expected a register token after two operand mnemonic"
             );
         // Then, create `reg_t` structs for each register token defined above
-        reg_t rd = string_to_reg_t(rd_tok->value);
+        reg_t rd = string_to_reg_t(token_text(tokens, rd_tok));
         instr->rd = rd;
 
         // The next token is an operand, which is either:
         operand_t operand = parse_operand(tokens, instr);
         
-        if (IS_OPC_ALIAS(opc)) {
-            strncpy(instr->mnemonic, resolve_alias_mnemonic(opc), sizeof(instr->mnemonic));
+        if (mnemonic_is_alias(mnemonic)) {
+            strncpy(instr->mnemonic, mnemonic->canonical->name, sizeof(instr->mnemonic));
             reg_t rzr = {.type = (rd.type == REG_X || rd.type == REG_XZR) ? REG_XZR : REG_WZR, .number = 31};
-            if (strcmp(opc, "mov") == 0) {
+            if (mnemonic == &mnemonic_table[MN_MOV]) {
                 reg_t rm = operand.value.reg;
                 instr->rm = rm;
             } 
             instr->rn = rzr;
         }
-        if (IS_WIDE_MOVE(opc)) {
+        if (mnemonic->encoding == ENC_WIDE_MOVE) {
             instr->type = INSTR_WIDE_MOVE;
             if (operand.type == OP_IMM) {
                 instr->imm16 = operand.value.imm;
@@ -142,19 +177,19 @@ void parse_dp(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
                 
         }
         instr->operand = operand;
-    } else if (IS_DP_TWO_OPERAND_WO_DEST(opc)) {
+    } else if (mnemonic->form == FORM_TWO_OPERAND_WO_DEST) {
         // First, get the registers as tokens
         token_t *rn_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after two operand mnemonic\n"
+                "Expected a register token after two operand mnemonic"
             );
         // The next token is an operand, which is either:
         operand_t operand = parse_operand(tokens, instr);
         // Then, create `reg_t` structs for each register token defined above
-        reg_t rn = string_to_reg_t(rn_tok->value);
+        reg_t rn = string_to_reg_t(token_text(tokens, rn_tok));
         instr->operand = operand;
-        if (IS_OPC_ALIAS(opc)) {
-            strncpy(instr->mnemonic, resolve_alias_mnemonic(opc), sizeof(instr->mnemonic));
+        if (mnemonic_is_alias(mnemonic)) {
+            strncpy(instr->mnemonic, mnemonic->canonical->name, sizeof(instr->mnemonic));
             reg_t rzr = {.type = (rn.type == REG_X || rn.type == REG_XZR) ? REG_XZR : REG_WZR, .number = 31};
             instr->rd =  rzr;
             instr->rn = rn;
@@ -166,39 +201,41 @@ void parse_dp(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
     }
 }
 
-void parse_branch(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
-    char *opc = mnemonic->value;
+void parse_branch(instruction_t *instr, token_list_t tokens, const mnemonic_t *mnemonic) {
     instr->type = INSTR_BRANCH;
 
-    if (strcmp(opc, "br") == 0) {
+    if (mnemonic->encoding == ENC_BRANCH_REG) {
         token_t *xn = current_token(tokens);
-        instr->rn = string_to_reg_t(xn->value);
+        instr->rn = string_to_reg_t(token_text(tokens, xn));
         advance(tokens);
         return;
     }
     // parse the literal
     token_t *literal_token = current_token(tokens);
+    if (literal_token->type == TOKEN_NEWLINE || literal_token->type == TOKEN_EOF) {
+        token_error(tokens, literal_token, "Expected a label to branch to");
+        return;
+    }
     advance(tokens);
-    instr->branch_label = literal_token->value;
+    instr->branch_label = token_text(tokens, literal_token);
     return;
 }
 
-void parse_load_store(instruction_t *instr, token_list_t tokens, token_t *mnemonic) {
-    char *opc = mnemonic->value;
+void parse_load_store(instruction_t *instr, token_list_t tokens, const mnemonic_t *mnemonic) {
 
     token_t *rt_tok
             = expect(tokens, TOKEN_REGISTER, 
-                "Expected a register token after load/store mnemonic\n"
+                "Expected a register token after load/store mnemonic"
             );
-    reg_t rt = string_to_reg_t(rt_tok->value);
+    reg_t rt = string_to_reg_t(token_text(tokens, rt_tok));
     instr->rt = rt;
 
     // Set the addressing mode
-    if (strcmp(opc, "ldr") == 0) {
+    if (mnemonic->form == FORM_LOAD) {
         // check if the address is 
         addressing_mode_t addr = parse_addressing_mode(tokens, LOAD);
         instr->address = addr;
-    } else if (strcmp(opc, "str") == 0) {
+    } else if (mnemonic->form == FORM_STORE) {
         addressing_mode_t addr = parse_addressing_mode(tokens, STORE);
         instr->address = addr;
     } else {
@@ -207,36 +244,348 @@ void parse_load_store(instruction_t *instr, token_list_t tokens, token_t *mnemon
     instr->type = INSTR_LOAD_STORE;
 }
 
-void parse_instructions(parser_state_t *parser_state) {
-    token_list_t tokens = parser_state->tokens;
+// Hands the instructions before the oldest pending fixup to the sink and
+// drops them, once there are enough of them or `all` is set
+static void flush_final_instructions(parser_state_t *parser_state, bool all) {
+    int oldest = oldest_pending_fixup(parser_state->fixups);
+    int count = (all || oldest < 0) ? parser_state->instruction_count : oldest - parser_state->first_index;
+    if (count == 0 || (!all && count < STREAM_FLUSH_THRESHOLD)) return;
+
+    parser_state->sink(parser_state->sink_context, parser_state->instructions, count);
+
+    parser_state->instruction_count -= count;
+    memmove(parser_state->instructions, &parser_state->instructions[count],
+        parser_state->instruction_count * sizeof(instruction_t));
+    parser_state->first_index += count;
+}
+
+// Lines made by macro expansion are tokenised in a buffer that the next
+// line reuses, so the label names an instruction keeps are interned
+static void keep_label_names(parser_state_t *parser_state, instruction_t *instr) {
+    if (instr->branch_label) {
+        instr->branch_label = (char *)arena_intern(parser_state->arena, instr->branch_label);
+    }
+    literal_t *literal = &instr->address.value.literal;
+    if (instr->type == INSTR_LOAD_STORE && instr->address.type == LITERAL && literal->label) {
+        literal->label = (char *)arena_intern(parser_state->arena, literal->label);
+    }
+}
+
+// Widths in bytes of the directives that list data values
+static const struct {
+    const char *name;
+    uint32_t width;
+} data_lists[] = {
+    { ".byte", 1 }, { ".hword", 2 }, { ".quad", 8 }
+};
+
+// Largest power of two `.align` takes
+#define MAX_ALIGN_POWER 16
+
+// Moves past the rest of a line that could not be parsed
+static void skip_line(token_list_t tokens) {
+    while (current_token(tokens)->type != TOKEN_NEWLINE && current_token(tokens)->type != TOKEN_EOF) {
+        advance(tokens);
+    }
+}
+
+static bool at_line_end(token_list_t tokens) {
+    token_type_t type = current_token(tokens)->type;
+    return type == TOKEN_NEWLINE || type == TOKEN_EOF;
+}
+
+// Moves past the rest of a statement with a syntax error, and its newline
+static void skip_statement(token_list_t tokens) {
+    skip_line(tokens);
+    match(tokens, TOKEN_NEWLINE);
+}
+
+// Reads a number that fits in `width` bytes, signed or unsigned
+static bool parse_data_value(const char *text, uint32_t width, uint64_t *value) {
+    char *end;
+    errno = 0;
+    if (text[0] == '-') {
+        int64_t signed_value = strtoll(text, &end, 0);
+        *value = (uint64_t)signed_value;
+        if (width < 8 && signed_value < -(INT64_C(1) << (width * 8 - 1))) return false;
+    } else {
+        *value = strtoull(text, &end, 0);
+        if (width < 8 && *value >> (width * 8) != 0) return false;
+    }
+    return end != text && *end == '\0' && errno == 0;
+}
+
+// Parses the values of a `.byte`, `.hword` or `.quad` into little endian
+// bytes kept in the arena
+static void parse_data_list(parser_state_t *parser_state, instruction_t *instr, token_list_t tokens,
+        const char *directive, uint32_t width) {
+    int first = tokens->current;
+    uint32_t count = 0;
+    for (; !at_line_end(tokens); advance(tokens)) count++;
+    tokens->current = first;
+
+    instr->size = count * width;
+    instr->data = arena_alloc(parser_state->arena, instr->size ? instr->size : 1);
+    for (uint32_t i = 0; i < count; i++) {
+        const char *text = token_text(tokens, advance(tokens));
+        uint64_t value = 0;
+        if (!parse_data_value(text, width, &value)) {
+            diag_error_at(instr->line, instr->column, "Error: Invalid %s value '%s'\n", directive, text);
+        }
+        for (uint32_t byte = 0; byte < width; byte++) {
+            instr->data[i * width + byte] = (uint8_t)(value >> (byte * 8));
+        }
+    }
+}
+
+// Sizes an `.incbin` from the file as it is now. Its contents are only
+// read when the output is written, straight into the output
+static void parse_incbin(parser_state_t *parser_state, instruction_t *instr, token_list_t tokens) {
+    const token_t *token = advance(tokens);
+    const char *path = token_text(tokens, token);
+    size_t length = token->length;
+    if (length >= 2 && path[0] == '"' && path[length - 1] == '"') {
+        path++;
+        length -= 2;
+    }
+    char *file = arena_strndup(parser_state->arena, path, length);
+    parser_state->includes_files = true;
+
+    struct stat st;
+    if (stat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+        diag_error_at(instr->line, instr->column, "Error: Cannot include '%s'\n", file);
+    } else if ((uint64_t)st.st_size > UINT32_MAX - parser_state->pc) {
+        diag_error_at(instr->line, instr->column, "Error: '%s' does not fit in the address space\n", file);
+    } else {
+        instr->data_file = file;
+        instr->size = st.st_size;
+    }
+}
+
+// Parses one of the directives that lay out data of any size. The pc is
+// left wherever the data ends, so nothing but data needs to follow it
+static void parse_data(parser_state_t *parser_state, instruction_t *instr, token_list_t tokens, const char *directive) {
+    instr->type = INSTR_DATA;
+    instr->size = 0;
+
+    for (size_t i = 0; i < sizeof(data_lists) / sizeof(data_lists[0]); i++) {
+        if (strcmp(directive, data_lists[i].name) == 0) {
+            parse_data_list(parser_state, instr, tokens, directive, data_lists[i].width);
+            return;
+        }
+    }
+
+    if (strcmp(directive, ".incbin") == 0 && !at_line_end(tokens)) {
+        parse_incbin(parser_state, instr, tokens);
+        return;
+    }
+
+    // `.space` and `.align` are filled with zeros
+    uint64_t value = 0;
+    const char *text = at_line_end(tokens) ? "" : token_text(tokens, advance(tokens));
+    bool valid = parse_data_value(text, 4, &value) && at_line_end(tokens);
+    if (strcmp(directive, ".space") == 0 && valid && value <= UINT32_MAX - parser_state->pc) {
+        instr->size = value;
+    } else if (strcmp(directive, ".align") == 0 && valid && value <= MAX_ALIGN_POWER) {
+        uint32_t alignment = UINT32_C(1) << value;
+        instr->size = (alignment - parser_state->pc % alignment) % alignment;
+        instr->directive_value = alignment;
+    } else if (strcmp(directive, ".space") == 0 || strcmp(directive, ".align") == 0
+            || strcmp(directive, ".incbin") == 0) {
+        diag_error_at(instr->line, instr->column, "Error: Invalid %s operand '%s'\n", directive, text);
+    } else {
+        diag_error_at(instr->line, instr->column, "Error: Unknown directive '%s'\n", directive);
+    }
+    skip_line(tokens);
+}
+
+// Records a label at `address` and patches any instructions that jumped
+// ahead to it
+static void define_label(parser_state_t *parser_state, char *label, uint32_t address) {
+    symbol_table_append(parser_state->symbols, label, address);
+    if (!parser_state->defer_encoding) {
+        resolve_fixups(parser_state->fixups, label, address,
+            parser_state->instructions, parser_state->first_index);
+    }
+}
+
+// Gives the instruction just added its address and moves the pc past it.
+// It is encoded straight away, unless the caller encodes everything
+// afterwards, and may be handed to the sink, so `instr` is not valid after
+static void place_instruction(parser_state_t *parser_state, instruction_t *instr) {
+    instr->instr_address = parser_state->pc;
+    parser_state->pc += instr->size;
+    parser_state->after_jump = instr->type == INSTR_BRANCH
+        && (instr->desc == &mnemonic_table[MN_B] || instr->desc == &mnemonic_table[MN_BR]);
+
+    if (!parser_state->defer_encoding) {
+        int index = parser_state->first_index + parser_state->instruction_count - 1;
+        encode_instruction(instr, index, parser_state->symbols, parser_state->fixups);
+    }
+    if (parser_state->sink) {
+        flush_final_instructions(parser_state, false);
+    }
+}
+
+// LITERAL POOLS
 
+// Points an `ldr rt, =value` at its constant in the pool, adding the
+// constant unless the pool already holds it at the same width
+static void use_literal_pool(parser_state_t *parser_state, instruction_t *instr) {
+    literal_pool_t *pool = &parser_state->pool;
+    literal_t *literal = &instr->address.value.literal;
+    const char *text = literal->label + 1;
+    uint32_t size = instr->rt.type == REG_X ? 8 : 4;
+
+    uint64_t value = 0;
+    if (!parse_data_value(text, size, &value)) {
+        diag_error_at(instr->line, instr->column, "Error: Invalid literal constant '%s'\n", text);
+    }
+
+    char key[32];
+    snprintf(key, sizeof(key), "%" PRIu32 ":%" PRIx64, size, value);
+    uint32_t index = symbol_table_get(pool->lookup, key);
+    if (index == NOT_FOUND) {
+        if (pool->count == pool->capacity) {
+            pool->capacity = pool->capacity ? pool->capacity * 2 : 16;
+            pool->entries = realloc(pool->entries, pool->capacity * sizeof(pool_entry_t));
+            assert(pool->entries != NULL);
+        }
+        if (pool->count == 0) pool->first_use = parser_state->pc;
+
+        index = pool->count++;
+        pool->entries[index] = (pool_entry_t) {
+            .value = value,
+            .size = size,
+            .label = new_internal_label(parser_state, "pool")
+        };
+        pool->size += size;
+        symbol_table_append(pool->lookup, key, index);
+    }
+    literal->label = pool->entries[index].label;
+}
+
+// Whether the pool has to be placed now for its first load to still reach
+// it, allowing for a branch over it and padding to a word
+static bool literal_pool_due(const parser_state_t *parser_state) {
+    const literal_pool_t *pool = &parser_state->pool;
+    return pool->count > 0 && (uint64_t)parser_state->pc + 2 * PC_INC + pool->size + LITERAL_POOL_MARGIN
+        >= (uint64_t)pool->first_use + LITERAL_LOAD_REACH;
+}
+
+// Places the constants gathered so far as one run of data at the next word,
+// wide ones first, and starts a new pool. With `jump_over`, code that would
+// fall into the pool branches over it
+static void place_literal_pool(parser_state_t *parser_state, bool jump_over) {
+    literal_pool_t *pool = &parser_state->pool;
+    if (pool->count == 0) return;
+
+    char *after = NULL;
+    if (jump_over && !parser_state->after_jump) {
+        after = new_internal_label(parser_state, "skip");
+        instruction_t *jump = add_instruction_to_parser_state(parser_state);
+        jump->type = INSTR_BRANCH;
+        jump->desc = &mnemonic_table[MN_B];
+        strncpy(jump->mnemonic, jump->desc->name, sizeof(jump->mnemonic));
+        jump->branch_label = after;
+        jump->line = parser_state->current_line;
+        place_instruction(parser_state, jump);
+    }
+
+    instruction_t *data = add_instruction_to_parser_state(parser_state);
+    data->type = INSTR_DATA;
+    data->line = parser_state->current_line;
+    uint32_t padding = (PC_INC - parser_state->pc % PC_INC) % PC_INC;
+    data->size = padding + pool->size;
+    data->data = arena_alloc(parser_state->arena, data->size);
+    memset(data->data, 0, padding);
+
+    uint32_t offset = padding;
+    for (uint32_t size = 8; size >= 4; size -= 4) {
+        for (int i = 0; i < pool->count; i++) {
+            pool_entry_t *entry = &pool->entries[i];
+            if (entry->size != size) continue;
+            for (uint32_t byte = 0; byte < size; byte++) {
+                data->data[offset + byte] = (uint8_t)(entry->value >> (byte * 8));
+            }
+            define_label(parser_state, entry->label, parser_state->pc + offset);
+            offset += size;
+        }
+    }
+    place_instruction(parser_state, data);
+    if (after) {
+        define_label(parser_state, after, parser_state->pc);
+    }
+
+    pool->count = 0;
+    pool->size = 0;
+    symbol_table_free(pool->lookup);
+    pool->lookup = symbol_table_create_in_arena(parser_state->arena);
+}
+
+// Parses and encodes the statements in `tokens` up to its end of file
+// token. `transient` is set when the tokens' text does not outlive them
+static void parse_statements(parser_state_t *parser_state, token_list_t tokens, bool transient) {
     // Loop until we see an end of file token, which
     // indicates we consumed all the tokens in a file
     while (!match(tokens, TOKEN_EOF)) {
+        parser_state->current_line = current_token(tokens)->line;
+        tokens->failed = false;
 
         // If we encounter a label, advance the current
         // token and ...
         if (match(tokens, TOKEN_LABEL)) {
-            // Label already added to symbol table in pass 1, just expect
-            // a new line after the label token and consume that token too
-            // to continue with the next instruction
+            // The label refers to the next instruction, so record it at the
+            // current pc and patch any instructions that jumped ahead to it
+            char *label = token_text(tokens, &tokens->tokens[tokens->current - 1]);
+            define_label(parser_state, label, parser_state->pc);
+
+            // Then expect a new line after the label token and consume that
+            // token too to continue with the next instruction
             expect(tokens, TOKEN_NEWLINE, "Expected newline after label");
+            if (tokens->failed) skip_statement(tokens);
             continue;
         }
 
-        instruction_t *instr = create_instruction();
+        // `.ltorg` places the literal pool here, where the code does not
+        // fall into it
+        if (current_token(tokens)->type == TOKEN_DIRECTIVE
+                && strcmp(token_text(tokens, current_token(tokens)), ".ltorg") == 0) {
+            advance(tokens);
+            expect(tokens, TOKEN_NEWLINE, "Expected newline after directive");
+            if (tokens->failed) {
+                skip_statement(tokens);
+            } else {
+                place_literal_pool(parser_state, false);
+            }
+            continue;
+        }
+
+        instruction_t *instr = add_instruction_to_parser_state(parser_state);
+        instr->line = current_token(tokens)->line;
+        instr->column = token_column(tokens, current_token(tokens));
 
         // If a directive token is encountered, advance the 
         // current token and ...
         if (match(tokens, TOKEN_DIRECTIVE)) {
-            // the directive value is now the current
-            // token (match advances the cursor)
-            token_t *dir_value = current_token(tokens);
-            // advance to expect a new line after the value
-            advance(tokens);
-            // Set instruction's fields
-            instr->type = INSTR_DIRECTIVE;
-            instr->directive_value = string_to_immediate(dir_value->value);
+            const char *directive = token_text(tokens, &tokens->tokens[tokens->current - 1]);
+            if (strcmp(directive, ".int") == 0) {
+                // the directive value is now the current
+                // token (match advances the cursor)
+                token_t *dir_value = current_token(tokens);
+                // advance to expect a new line after the value, unless
+                // the value is missing
+                if (at_line_end(tokens)) {
+                    token_error(tokens, dir_value, "Expected a value after .int");
+                } else {
+                    advance(tokens);
+                }
+                // Set instruction's fields
+                instr->type = INSTR_DIRECTIVE;
+                instr->directive_value = string_to_immediate(token_text(tokens, dir_value));
+            } else {
+                parse_data(parser_state, instr, tokens, directive);
+            }
         }
         // We expect a mnemonic token now... 
         else {
@@ -244,43 +593,302 @@ void parse_instructions(parser_state_t *parser_state) {
             // so that it points to the token after the instruction mnemonic
             token_t *mnemonic_tok = expect(tokens, TOKEN_MNEMONIC, "Expected instruction mnemonic");
             // Set instruction's mnemonic value to the token's value
-            strncpy(instr->mnemonic, mnemonic_tok->value, sizeof(instr->mnemonic));
+            strncpy(instr->mnemonic, token_text(tokens, mnemonic_tok), sizeof(instr->mnemonic));
+
+            // One hash lookup gives the mnemonic's class, alias target
+            // and opc bits for both the parser and the encoder
+            const mnemonic_t *mnemonic = tokens->failed ? NULL : lookup_mnemonic(instr->mnemonic);
+            if (!mnemonic) {
+                token_error(tokens, mnemonic_tok, "Unknown instruction mnemonic");
+                skip_statement(tokens);
+                parser_state->instruction_count--;
+                continue;
+            }
+            instr->desc = mnemonic->canonical;
 
             // Now, the current token points to the token after the 
             // instruction mnemonic
 
             // Parse the relevant instruction type
-            if (IS_DP_MNEMONIC(instr->mnemonic)) {
-                parse_dp(instr, tokens, mnemonic_tok);
-            } else if (IS_BRANCHING_MNEMONIC(instr->mnemonic)) {
-                parse_branch(instr, tokens, mnemonic_tok);
-            } else if (IS_LOAD_STORE_MNEMONIC(instr->mnemonic)) {
-                parse_load_store(instr, tokens, mnemonic_tok);
+            if (mnemonic->form == FORM_BRANCH) {
+                parse_branch(instr, tokens, mnemonic);
+            } else if (mnemonic->form == FORM_LOAD || mnemonic->form == FORM_STORE) {
+                parse_load_store(instr, tokens, mnemonic);
             } else {
-                fprintf(stderr, "Unknown instruction mnemonic: %s\n", instr->mnemonic);
-                exit(1);
+                parse_dp(instr, tokens, mnemonic);
             }
         }
 
         // After each instruction (mnemonic or directive), expect a new line ...
-        expect(tokens, TOKEN_NEWLINE, "Expected newline after instruction or directive");
-        
-        // Save the parsed instruction to parser state, incrementing
-        // isntruction address and parser pc
-        instr->instr_address = parser_state->pc;
-        parser_state->pc += PC_INC;
-        add_instruction_to_parser_state(parser_state, instr);
+        if (!tokens->failed) {
+            expect(tokens, TOKEN_NEWLINE, "Expected newline after instruction or directive");
+        }
+
+        // A statement with a syntax error is dropped, and parsing carries
+        // on from the next line so every error is reported in one pass
+        if (tokens->failed) {
+            skip_statement(tokens);
+            parser_state->instruction_count--;
+            continue;
+        }
+
+        literal_t *literal = &instr->address.value.literal;
+        if (instr->type == INSTR_LOAD_STORE && instr->address.type == LITERAL
+                && literal->label && literal->label[0] == '=') {
+            use_literal_pool(parser_state, instr);
+        }
+        if (transient) {
+            keep_label_names(parser_state, instr);
+        }
+
+        place_instruction(parser_state, instr);
+        if (literal_pool_due(parser_state)) {
+            place_literal_pool(parser_state, true);
+        }
+    }
+}
+
+
+int parse_instructions(parser_state_t *parser_state) {
+    parser_state->fixups->relax_branches = parser_state->sink == NULL;
+
+    if (macros_needed(parser_state->tokens)) {
+        // Lines are expanded one at a time and parsed straight away, so
+        // a long repetition is never held in full
+        macro_expander_t *expander = macro_expander_create(parser_state->tokens);
+        token_list_t line = token_list_create();
+        while (macro_expander_next_line(expander, line)) {
+            parse_statements(parser_state, line, true);
+        }
+        free_token_list(line);
+        macro_expander_free(expander);
+    } else {
+        parse_statements(parser_state, parser_state->tokens, false);
+    }
+    place_literal_pool(parser_state, false);
+
+    // Branches left unpatched for being out of reach are relaxed, which
+    // moves the code after them, so everything that refers to an address
+    // is encoded again against a fresh fixup list
+    if (parser_state->fixups->relaxations > 0) {
+        relax_branches(parser_state);
+        free_fixup_list(parser_state->fixups);
+        parser_state->fixups = fixup_list_create(parser_state->arena);
+        for (int i = 0; i < parser_state->instruction_count; i++) {
+            instruction_t *instr = &parser_state->instructions[i];
+            if (instr->type == INSTR_BRANCH || (instr->type == INSTR_LOAD_STORE && instr->address.type == LITERAL)) {
+                encode_instruction(instr, i, parser_state->symbols, parser_state->fixups);
+            }
+        }
+    }
+
+    // In a relocatable object, references to labels defined elsewhere
+    // stay in the fixup list to become relocations
+    int unresolved = parser_state->relocatable ? 0 : report_unresolved_fixups(parser_state->fixups,
+        parser_state->instructions, parser_state->first_index);
+    if (parser_state->sink) {
+        flush_final_instructions(parser_state, true);
+    }
+    return unresolved;
+}
+
+// Sizes the symbol table for every label in the tokens up front
+static void reserve_labels(parser_state_t *parser_state) {
+    uint32_t label_count = 0;
+    for (int i = 0; i < parser_state->tokens->count; i++) {
+        if (parser_state->tokens->tokens[i].type == TOKEN_LABEL) label_count++;
     }
+    symbol_table_reserve(parser_state->symbols, label_count);
 }
 
-void parse(parser_state_t *parser_state, FILE *in_file) {
+int parse(parser_state_t *parser_state, FILE *in_file) {
     // PARSING FLOW:
     //      1. Tokenise
-    //      2. Parse
-    //      3. Encode
+    //      2. Parse and encode, patching forward label references
+    free_token_list(parser_state->tokens);
     parser_state->tokens = tokenise(in_file);
-    parse_instructions(parser_state);
+    reserve_labels(parser_state);
+
+    int unresolved = parse_instructions(parser_state);
+    fclose(in_file);
+    return unresolved;
+}
+
+int parse_buffer(parser_state_t *parser_state, const char *source, size_t len) {
+    free_token_list(parser_state->tokens);
+    parser_state->tokens = tokenise_string(source, len);
+    reserve_labels(parser_state);
+    return parse_instructions(parser_state);
+}
+
+typedef struct {
+    char *source;
+    size_t len;
+    int first_line;
+    const char *file;       // Source file the diagnostics refer to
+    diag_list_t diags;      // Errors in the chunk, reported in chunk order
+    parser_state_t *state;
+} parse_chunk_t;
+
+// Tokenises and parses one chunk as if it were a file of its own, so its
+// instructions and labels have addresses relative to the chunk's start
+static void *parse_chunk(void *arg) {
+    parse_chunk_t *chunk = arg;
+    const char *file = diag_file();
+    diag_list_t *sink = diag_set_sink(&chunk->diags);
+    diag_set_file(chunk->file);
+
+    parser_state_t *state = create_parser_state();
+    state->defer_encoding = true;
+
+    free_token_list(state->tokens);
+    state->tokens = tokenise_buffer(chunk->source, chunk->len, chunk->first_line);
+    reserve_labels(state);
+    parse_instructions(state);
+
+    chunk->state = state;
+    diag_set_sink(sink);
+    diag_set_file(file);
+    return NULL;
+}
+
+// Appends a parsed chunk to the end of `merged`, moving its instructions
+// and labels up to the address the chunk starts at
+static void merge_chunk(parser_state_t *merged, parser_state_t *chunk) {
+    uint32_t base = merged->pc;
+
+    // Keep one spare slot, as add_instruction_to_parser_state does
+    int needed = merged->instruction_count + chunk->instruction_count + 1;
+    if (needed > merged->instruction_capacity) {
+        while (merged->instruction_capacity < needed) merged->instruction_capacity *= 2;
+        merged->instructions = realloc(merged->instructions, merged->instruction_capacity * sizeof(instruction_t));
+        assert(merged->instructions != NULL);
+    }
+
+    instruction_t *dest = &merged->instructions[merged->instruction_count];
+    memcpy(dest, chunk->instructions, chunk->instruction_count * sizeof(instruction_t));
+    for (int i = 0; i < chunk->instruction_count; i++) {
+        dest[i].instr_address += base;
+
+        // Data lists and included file names live in the chunk's arena,
+        // which goes with the chunk
+        if (dest[i].data) {
+            dest[i].data = memcpy(arena_alloc(merged->arena, dest[i].size), dest[i].data, dest[i].size);
+        }
+        if (dest[i].data_file) {
+            dest[i].data_file = arena_strndup(merged->arena, dest[i].data_file, strlen(dest[i].data_file));
+        }
+    }
+    merged->instruction_count += chunk->instruction_count;
+    merged->pc += chunk->pc;
+    merged->includes_files |= chunk->includes_files;
+
+    symbol_table labels = chunk->symbols;
+    for (uint32_t i = 0; i < labels->capacity; i++) {
+        symbol_entry_t *entry = &labels->entries[i];
+        if (entry->dist != 0) {
+            symbol_table_append(merged->symbols, (char *)entry->key, entry->value + base);
+        }
+    }
+}
+
+// Whether `.align` appears anywhere in the source
+static bool mentions_align(const char *source, size_t len) {
+    const size_t length = strlen(".align");
+    for (const char *p = source; (p = memchr(p, '.', source + len - p)) != NULL; p++) {
+        if ((size_t)(source + len - p) >= length && memcmp(p, ".align", length) == 0) return true;
+    }
+    return false;
+}
+
+int parse_parallel(parser_state_t *parser_state, FILE *in_file, int threads) {
+    // PARSING FLOW:
+    //      1. Load the source and split it at line boundaries
+    //      2. Tokenise and parse every chunk on its own thread
+    //      3. Merge the chunks in order; the address each chunk starts
+    //         at is the instruction count of the chunks before it
+    free_token_list(parser_state->tokens);
+    parser_state->tokens = token_list_load(in_file);
+    parser_state->defer_encoding = true;
     fclose(in_file);
+
+    char *src = parser_state->tokens->source;
+    size_t len = parser_state->tokens->source_len;
+
+    // A macro or constant defined in one chunk would be missing from the
+    // chunks after it, padding to an alignment depends on where the chunk
+    // starts and literal pools are placed by distance, so such sources are
+    // parsed whole
+    if (macros_in_source(src, len) || mentions_align(src, len) || memchr(src, '=', len)) {
+        tokenise_into(parser_state->tokens, src, len, 1);
+        reserve_labels(parser_state);
+        parse_instructions(parser_state);
+        return 0;
+    }
+
+    int chunk_count = threads;
+    if ((size_t)chunk_count > len / PARSE_MIN_CHUNK_SIZE) chunk_count = len / PARSE_MIN_CHUNK_SIZE;
+    if (chunk_count < 1) chunk_count = 1;
+
+    parse_chunk_t *chunks = calloc(chunk_count, sizeof(parse_chunk_t));
+    assert(chunks != NULL);
+
+    // Every chunk but the last ends just after a newline, so words are
+    // never terminated in place across a chunk boundary
+    size_t start = 0;
+    int line = 1;
+    int n = 0;
+    for (; n < chunk_count && start < len; n++) {
+        size_t end = start + (len - start) / (chunk_count - n);
+        char *newline = memchr(src + end, '\n', len - end);
+        end = (n < chunk_count - 1 && newline) ? (size_t)(newline - src) + 1 : len;
+
+        chunks[n] = (parse_chunk_t) {
+            .source = src + start,
+            .len = end - start,
+            .first_line = line,
+            .file = diag_file()
+        };
+        diag_list_init(&chunks[n].diags);
+        for (char *p = src + start; (p = memchr(p, '\n', src + end - p)) != NULL; p++) {
+            line++;
+        }
+        start = end;
+    }
+    chunk_count = n;
+
+    // The calling thread parses the first chunk itself
+    pthread_t *pool = malloc(chunk_count * sizeof(pthread_t));
+    bool *started = calloc(chunk_count, sizeof(bool));
+    assert(pool != NULL && started != NULL);
+    for (int i = 1; i < chunk_count; i++) {
+        started[i] = pthread_create(&pool[i], NULL, parse_chunk, &chunks[i]) == 0;
+    }
+    for (int i = 0; i < chunk_count; i++) {
+        if (started[i]) {
+            pthread_join(pool[i], NULL);
+        } else {
+            parse_chunk(&chunks[i]);
+        }
+    }
+
+    uint32_t label_count = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        label_count += chunks[i].state->symbols->len;
+    }
+    symbol_table_reserve(parser_state->symbols, label_count);
+
+    for (int i = 0; i < chunk_count; i++) {
+        merge_chunk(parser_state, chunks[i].state);
+        free_parser_state(chunks[i].state);
+        diag_list_report(&chunks[i].diags);
+        diag_list_free(&chunks[i].diags);
+    }
+
+    free(started);
+    free(pool);
+    free(chunks);
+    return 0;
 }
 
 operand_t parse_operand(token_list_t tokens, instruction_t *instr) {
@@ -292,15 +900,15 @@ operand_t parse_operand(token_list_t tokens, instruction_t *instr) {
         token_t *shift_token = current_token(tokens);
         if (shift_token->type == TOKEN_SHIFT) {
             advance(tokens);
-            token_t *shift_value_tok = expect(tokens, TOKEN_IMMEDIATE, "Expected immediate shift value\n");
-            uint32_t shift_amt = string_to_immediate(shift_value_tok->value);
+            token_t *shift_value_tok = expect(tokens, TOKEN_IMMEDIATE, "Expected immediate shift value");
+            uint32_t shift_amt = string_to_immediate(token_text(tokens, shift_value_tok));
             operand = (operand_t) {.type = OP_SHIFTED_REG, .value.shifted_reg = {
-                .reg = string_to_reg_t(curr_token->value),
-                .sh_type = string_to_shift_type(shift_token->value),
+                .reg = string_to_reg_t(token_text(tokens, curr_token)),
+                .sh_type = string_to_shift_type(token_text(tokens, shift_token)),
                 .shift_amount = shift_amt
             }};
         } else {
-            operand = (operand_t) {.type = OP_REG, .value.reg = string_to_reg_t(curr_token->value)};
+            operand = (operand_t) {.type = OP_REG, .value.reg = string_to_reg_t(token_text(tokens, curr_token))};
         }
     } 
     else if (curr_token->type == TOKEN_IMMEDIATE) {
@@ -309,22 +917,24 @@ operand_t parse_operand(token_list_t tokens, instruction_t *instr) {
         token_t *shift_token = current_token(tokens);
         if (shift_token->type == TOKEN_SHIFT) {
             advance(tokens);
-            token_t *shift_value_tok = expect(tokens, TOKEN_IMMEDIATE, "Expected immediate shift value\n");
-            uint32_t shift_amt = string_to_immediate(shift_value_tok->value);
+            token_t *shift_value_tok = expect(tokens, TOKEN_IMMEDIATE, "Expected immediate shift value");
+            uint32_t shift_amt = string_to_immediate(token_text(tokens, shift_value_tok));
             operand = (operand_t) {.type = OP_SHIFTED_IMM, .value.shifted_imm = {
-                .imm = string_to_immediate(curr_token->value),
-                .sh_type = string_to_shift_type(shift_token->value),
+                .imm = string_to_immediate(token_text(tokens, curr_token)),
+                .sh_type = string_to_shift_type(token_text(tokens, shift_token)),
                 .shift_amount = shift_amt
             }};
         } else {
-            operand = (operand_t) {.type = OP_IMM, .value.imm = string_to_immediate(curr_token->value)};
+            operand = (operand_t) {.type = OP_IMM, .value.imm = string_to_immediate(token_text(tokens, curr_token))};
         }
+    } else {
+        token_error(tokens, curr_token, "Expected a register or an immediate operand");
     }
     return operand;
 }
 
 addressing_mode_t parse_addressing_mode(token_list_t tokens, dt_type type) {
-    addressing_mode_t addr;
+    addressing_mode_t addr = {0};
     addr.dt = type;
     token_t *current_tok = current_token(tokens);
     if (type == LOAD && current_tok->type == TOKEN_LITERAL) {
@@ -332,10 +942,10 @@ addressing_mode_t parse_addressing_mode(token_list_t tokens, dt_type type) {
         // literal can be either an integer or a label
         literal_t lit_val = {0};
         // if current_tok[0] == # --> integer else label
-        if (isdigit(current_tok->value[0])) {
-            lit_val.int_directive = string_to_immediate(current_tok->value);
+        if (isdigit(token_text(tokens, current_tok)[0])) {
+            lit_val.int_directive = string_to_immediate(token_text(tokens, current_tok));
         } else {
-            lit_val.label = current_tok->value;
+            lit_val.label = token_text(tokens, current_tok);
         }
         addr.value.literal = lit_val;
         addr.type = LITERAL;
@@ -343,8 +953,8 @@ addressing_mode_t parse_addressing_mode(token_list_t tokens, dt_type type) {
         return addr;
     }  
     expect(tokens, TOKEN_LBRACKET, "Expected '[' after rt in load/store instruction");
-    token_t *xn_tok = expect(tokens, TOKEN_REGISTER, "Expected a register in addressing mode\n");
-    reg_t xn = string_to_reg_t(xn_tok->value);
+    token_t *xn_tok = expect(tokens, TOKEN_REGISTER, "Expected a register in addressing mode");
+    reg_t xn = string_to_reg_t(token_text(tokens, xn_tok));
     if (current_token(tokens)->type == TOKEN_RBRACKET) {
         if (peek_next(tokens)->type == TOKEN_IMMEDIATE) {
             // post-indexed addressing mode
@@ -352,7 +962,7 @@ addressing_mode_t parse_addressing_mode(token_list_t tokens, dt_type type) {
             token_t *simm_tok = current_token(tokens);
             addr.type = POST_IND;
             addr.value.pre_post_indexed.xn = xn;
-            addr.value.pre_post_indexed.simm = string_to_immediate(simm_tok->value);
+            addr.value.pre_post_indexed.simm = string_to_immediate(token_text(tokens, simm_tok));
             advance(tokens);
             return addr;
         } else if (peek_next(tokens)->type == TOKEN_NEWLINE) {
@@ -363,14 +973,14 @@ addressing_mode_t parse_addressing_mode(token_list_t tokens, dt_type type) {
             advance(tokens);
             return addr;
         } else {
-            fprintf(stderr, "Error, invalud addressing mode");
-            exit(EXIT_FAILURE);
+            token_error(tokens, current_token(tokens), "Invalid addressing mode");
+            return addr;
         }
     } 
     if (current_token(tokens)->type == TOKEN_REGISTER) {
         // register offset
         token_t *xm_tok = current_token(tokens);
-        reg_t xm = string_to_reg_t(xm_tok->value);
+        reg_t xm = string_to_reg_t(token_text(tokens, xm_tok));
         advance(tokens);
         expect(tokens, TOKEN_RBRACKET, "Expected ']' after xm in register offset addressing mode");
         addr.type = REGISTER;
@@ -388,18 +998,19 @@ addressing_mode_t parse_addressing_mode(token_list_t tokens, dt_type type) {
             advance(tokens);
             addr.type = PRE_IND;
             addr.value.pre_post_indexed.xn = xn;
-            addr.value.pre_post_indexed.simm = string_to_immediate(immtok->value);
+            addr.value.pre_post_indexed.simm = string_to_immediate(token_text(tokens, immtok));
             return addr;
         }
         if (curr_tok->type == TOKEN_NEWLINE) {
             // Unsinged offset
             addr.type = UNSIGNED_IMM_OFFSET;
             addr.value.unsigned_offset.xn = xn;
-            addr.value.unsigned_offset.imm = string_to_immediate(immtok->value);
+            addr.value.unsigned_offset.imm = string_to_immediate(token_text(tokens, immtok));
         } else {
-            fprintf(stderr, "Error: invalid addresing mode");
-            exit(EXIT_FAILURE);
-        }  
+            token_error(tokens, curr_tok, "Invalid addressing mode");
+        }
+        return addr;
     }
+    token_error(tokens, current_token(tokens), "Expected ']', a register or an immediate in addressing mode");
     return addr;
 }
@@ -7,102 +7,118 @@
 #include "assemble_utils.h"
 #include "symbol_table.h"
 #include "tokens.h"
+#include "fixups.h"
+#include "arena.h"
 
 #define PC_INC 0x4
 
 #define INITIAL_INSTRUCTION_CAPACITY 256
 
-/**
- * @def IS_DP_MULTIPLY(opc)
- * @brief Check if the opcode is a multiply type data processing instruction
- */
+// Smallest slice of source worth parsing on a thread of its own
+#define PARSE_MIN_CHUNK_SIZE (64 * 1024)
 
-#define IS_DP_MULTIPLY(opc) ( \
-    strcmp((opc), "madd")  == 0 || strcmp((opc), "msub") == 0 \
-)
+// Fewest final instructions worth handing to the sink at once when streaming
+#define STREAM_FLUSH_THRESHOLD 4096
 
-/**
- * @def IS_DP_TWO_OPERAND(opc)
- * @brief Check if the opcode is a two operand data processing instruction
- */
+// Furthest a literal load reaches either way, in bytes
+#define LITERAL_LOAD_REACH (1 << 20)
 
-#define IS_DP_TWO_OPERAND(opc) ( \
-    strcmp((opc), "add")  == 0 || strcmp((opc), "adds") == 0 || \
-    strcmp((opc), "sub")  == 0 || strcmp((opc), "subs") == 0 || \
-    strcmp((opc), "and")  == 0 || strcmp((opc), "ands") == 0 || \
-    strcmp((opc), "bic")  == 0 || strcmp((opc), "bics") == 0 || \
-    strcmp((opc), "eor")  == 0 || strcmp((opc), "eon") == 0 || \
-    strcmp((opc), "orr")  == 0 || strcmp((opc), "mul") == 0 || \
-    strcmp((opc), "orn")  == 0 || strcmp((opc), "mneg")  == 0 \
-)
+// Room left between a literal pool and the end of its first load's reach,
+// for the statement that goes past the limit before the pool is placed
+#define LITERAL_POOL_MARGIN (64 * 1024)
 
 /**
- * @def IS_DP_ONE_OPERAND_W_DEST(opc)
- * @brief Check if the opcode is a one operand data processing instruction with a destination register
- */
-
-#define IS_DP_ONE_OPERAND_W_DEST(opc) ( \
-    strcmp((opc), "neg")  == 0 || strcmp((opc), "negs") == 0 || \
-    strcmp((opc), "mvn")  == 0 || strcmp((opc), "mov") == 0 || \
-    strcmp((opc), "movz")  == 0 || strcmp((opc), "movk") == 0 || \
-    strcmp((opc), "movn")  == 0 \
-)
-
-
-/**
- * @def IS_DP_TWO_OPERAND_WO_DEST(opc)
- * @brief Check if the opcode is a two operand data processing instruction without a destination register
+ * @brief Receives instructions whose encodings are final while parsing continues
+ *
+ * @param context Pointer given to the parser along with the sink
+ * @param instructions Run of instructions, in address order
+ * @param instruction_count Number of instructions in the run
  */
 
-#define IS_DP_TWO_OPERAND_WO_DEST(opc) ( \
-    strcmp((opc), "cmp")  == 0 || strcmp((opc), "cmn") == 0 || \
-    strcmp((opc), "tst")  == 0 \
-)
-
+typedef void (*instruction_sink_t)(void *, instruction_t *, int);
 
 /**
- * @def IS_OPC_ALIAS(opc)
- * @brief Check if the opcode is an alias instruction
+ * @struct pool_entry_t
+ * @brief A constant loaded with `ldr rt, =value`, waiting to be placed in a literal pool
+ *
+ * @var value Constant to place
+ * @var size Width of the constant in bytes, 8 for an x register and 4 for a w register
+ * @var label Internal label the loads refer to, defined where the constant is placed
  */
 
-#define IS_OPC_ALIAS(opc) ( \
-    strcmp((opc), "cmp")  == 0 || strcmp((opc), "cmn") == 0 || \
-    strcmp((opc), "neg")  == 0 || strcmp((opc), "negs") == 0 || \
-    strcmp((opc), "tst")  == 0 || strcmp((opc), "mvn") == 0 || \
-    strcmp((opc), "mov")  == 0 || strcmp((opc), "mul") == 0 || \
-    strcmp((opc), "mneg")  == 0 \
-)
+typedef struct {
+    uint64_t value;
+    uint32_t size;
+    char *label;
+} pool_entry_t;
 
 /**
- * @def IS_WIDE_MOVE(opc)
- * @brief Check if the opcode is a wide move instruction
+ * @struct literal_pool_t
+ * @brief Constants loaded since the last literal pool was placed
+ *
+ * @var entries Dynamic array of the distinct constants
+ * @var count Number of constants
+ * @var capacity Current capacity of the entries array
+ * @var size Bytes the constants take up
+ * @var first_use Address of the earliest load waiting on the pool
+ * @var lookup Index of each constant in `entries`, keyed by its width and value
  */
 
-#define IS_WIDE_MOVE(opc) ( \
-    strcmp((opc), "movz")  == 0 || strcmp((opc), "movk") == 0 || \
-    strcmp((opc), "movn")  == 0 \
-)
-
+typedef struct {
+    pool_entry_t *entries;
+    int count;
+    int capacity;
+    uint32_t size;
+    uint32_t first_use;
+    symbol_table lookup;
+} literal_pool_t;
 
 /**
  * @struct parser_state_t
  * @brief Holds the state of the parser during assembly instruction parsing
  *
  * @var tokens List of tokens being parsed
- * @var instructions Dynamic array of pointers to parsed instructions
+ * @var instructions Dynamic array of parsed instructions, stored by value
  * @var instruction_count Number of instructions parsed so far
  * @var instruction_capacity Current capacity of the instructions array
  * @var pc Program counter (address) for the current instruction
  * @var current_line Current line number in the input source file
+ * @var symbols Labels defined so far and their addresses
+ * @var fixups Label references still waiting for their label to be defined
+ * @var arena Arena holding the strings of this assembly, freed in one go
+ * @var owns_arena Whether the arena was created with the state and is freed with it
+ * @var defer_encoding Only parse and record labels, leaving encoding to a later stage
+ * @var relocatable Leave references to undefined labels to the linker rather than reporting them
+ * @var includes_files Whether `.incbin` pulled in other files, so the output depends on more than the source
+ * @var sink Optional destination for instructions as soon as their encoding is final
+ * @var sink_context Pointer passed through to `sink`
+ * @var first_index Index in the whole program of `instructions[0]`, which moves on as
+ *      instructions are handed to the sink and dropped
+ * @var pool Constants from `ldr rt, =value` not yet placed in the output
+ * @var after_jump Whether the last instruction placed never falls through to the next
+ * @var internal_labels Number of internal labels made so far, to keep their names apart
  */
 
 typedef struct {
     token_list_t tokens; // list of tokens
-    instruction_t **instructions; // instruction array
+    instruction_t *instructions; // instruction array
     int instruction_count; 
     int instruction_capacity;
     uint32_t pc;
     int current_line;
+    symbol_table symbols;
+    fixup_list_t fixups;
+    arena_t *arena;
+    bool owns_arena;
+    bool defer_encoding;
+    bool relocatable;
+    bool includes_files;
+    instruction_sink_t sink;
+    void *sink_context;
+    int first_index;
+    literal_pool_t pool;
+    bool after_jump;
+    int internal_labels;
 } parser_state_t;
 
 /**
@@ -113,12 +129,41 @@ typedef struct {
 parser_state_t *create_parser_state(void);
 
 /**
- * @brief Adds an instruction to the parser state's instruction array
+ * @brief Creates a parser state whose strings and symbols live in an existing arena
+ *
+ * The arena outlives the state, so it can be reset and reused for the
+ * next assembly rather than being created and destroyed each time
+ *
+ * @param arena Arena to allocate from, not freed with the state
+ * @return Pointer to the newly created parser_state_t
+ */
+
+parser_state_t *create_parser_state_in_arena(arena_t *);
+
+/**
+ * @brief Adds a new, initialized instruction to the parser state's instruction array
+ *
+ * The returned pointer is only valid until the next instruction is added,
+ * as the array may be moved when it grows
+ *
  * @param state Pointer to the parser state
- * @param instr Pointer to the instruction to add
+ * @return Pointer to the new instruction in the array
  */
 
-void add_instruction_to_parser_state(parser_state_t *, instruction_t *);
+instruction_t *add_instruction_to_parser_state(parser_state_t *);
+
+/**
+ * @brief Makes a label name of the assembler's own, such as `.Lpool3`
+ *
+ * Internal labels start with `.L`, which no source label can, and are left
+ * out of object files
+ *
+ * @param state Pointer to the parser state
+ * @param kind What the label is for, put between `.L` and its number
+ * @return Name of the label, kept in the state's arena
+ */
+
+char *new_internal_label(parser_state_t *, const char *);
 
 /**
  * @brief Frees all memory associated with the parser state
@@ -128,46 +173,96 @@ void add_instruction_to_parser_state(parser_state_t *, instruction_t *);
 void free_parser_state(parser_state_t *);
 
 /**
- * @brief Parses all instructions from the current tokens in the parser state
+ * @brief Parses and encodes all instructions from the current tokens in the parser state
+ *
+ * Labels are added to the symbol table as they are reached and each
+ * instruction is encoded as soon as it is parsed. References to labels
+ * further down are left as fixups and patched when the label is defined.
+ * With `defer_encoding` set, instructions are only parsed and the caller
+ * encodes them once the symbol table is complete.
+ *
+ * With a `sink`, runs of instructions are handed over and dropped as soon
+ * as no earlier instruction waits on a label, so only the instructions
+ * from the oldest pending forward reference onwards stay in memory. The
+ * array is empty once parsing is done
+ *
+ * Sources that use macros, repetitions, constants or expressions are
+ * expanded a line at a time on the way (see macros.h)
+ *
+ * The constants of `ldr rt, =value` are gathered into literal pools. A pool
+ * is placed at `.ltorg`, at the end of the source, or, behind a branch over
+ * it, once the code after its first load gets close to the load's reach.
+ * Without a sink, conditional branches whose label turns out to be out of
+ * reach are relaxed once everything is parsed (see layout.h) and the
+ * instructions encoded again
+ *
+ * @param state Pointer to the parser state
+ * @return Number of label references that were never resolved, 0 when relocatable
+ */
+
+int parse_instructions(parser_state_t *);
+
+/**
+ * @brief Tokenises, parses and encodes instructions from a given input FILE stream in one pass
  * @param state Pointer to the parser state
+ * @param input FILE pointer to the input stream
+ * @return Number of label references that were never resolved
  */
 
-void parse_instructions(parser_state_t *);
+int parse(parser_state_t *, FILE *);
 
 /**
- * @brief Parses instructions from a given input FILE stream
+ * @brief Tokenises, parses and encodes an assembly source held in memory in one pass
  * @param state Pointer to the parser state
+ * @param source Assembly source text, copied by the tokeniser
+ * @param len Length of the source in bytes
+ * @return Number of label references that were never resolved
+ */
+
+int parse_buffer(parser_state_t *, const char *, size_t);
+
+/**
+ * @brief Tokenises and parses an input FILE stream in chunks across several threads
+ *
+ * The source is split at line boundaries and every chunk is parsed into a
+ * parser state of its own. The chunks are then merged in order, with their
+ * instructions and labels moved to the address the chunk starts at. Encoding
+ * is left to the caller, e.g. with `encode_instructions_parallel`
+ *
+ * @param state Pointer to the parser state to merge the chunks into
  * @param input FILE pointer to the input stream
+ * @param threads Maximum number of chunks to parse at once
+ * @return Number of label references that were never resolved, always 0 as nothing is encoded
  */
 
-void parse(parser_state_t *, FILE *);
+int parse_parallel(parser_state_t *, FILE *, int);
 
 /**
  * @brief Parses a data processing instruction from tokens
  * @param instr Pointer to the instruction to fill
  * @param tokens List of tokens representing the instruction
- * @param current_token Pointer to the current token being parsed
+ * @param mnemonic Descriptor of the instruction's mnemonic
  */
 
-void parse_dp(instruction_t *, token_list_t, token_t *);
+void parse_dp(instruction_t *, token_list_t, const mnemonic_t *);
 
 /**
  * @brief Parse a branch instruction from tokens
  * @param instr Pointer to the instruction to fill
  * @param tokens List of tokens representing the instruction
- * @param current_token Pointer to the current token being parsed
+ * @param mnemonic Descriptor of the instruction's mnemonic
  */
 
-void parse_branch(instruction_t *, token_list_t, token_t *);
+void parse_branch(instruction_t *, token_list_t, const mnemonic_t *);
 
 /**
  * @brief Parses a load store instruction from tokens
  * @param instr Pointer to the instruction to fill
  * @param tokens List of tokens representing the instruction
- * @param current_token Pointer to the current token being parsed
+ * @param mnemonic Descriptor of the instruction's mnemonic
  */
 
-void parse_load_store(instruction_t *, token_list_t, token_t *);
+void parse_load_store(instruction_t *, token_list_t, const mnemonic_t *);
 
 /**
  * @brief Parses an operand from a list of tokens
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "peephole.h"
+#include "layout.h"
+
+// A register's value, when the wide moves before it in the same block
+// say what it is
+typedef struct {
+    bool known;
+    uint64_t value;
+} register_value_t;
+
+typedef struct {
+    parser_state_t *state;
+    bool *removed;          // Instructions dropped by the current pass
+    uint32_t *labels;       // Sorted addresses of every label
+    uint32_t label_count;
+    bool can_remove;
+    peephole_stats_t stats;
+} peephole_t;
+
+static bool is_x(reg_t reg) {
+    return reg.type == REG_X || reg.type == REG_XZR || reg.type == REG_SP;
+}
+
+static uint64_t width_mask(reg_t reg) {
+    return is_x(reg) ? UINT64_MAX : UINT32_MAX;
+}
+
+static bool same_register(reg_t a, reg_t b) {
+    return is_x(a) == is_x(b) && a.number == b.number;
+}
+
+static bool has_mnemonic(const instruction_t *instr, mnemonic_id_t id) {
+    return instr->desc == &mnemonic_table[id];
+}
+
+static void set_mnemonic(instruction_t *instr, mnemonic_id_t id) {
+    instr->desc = &mnemonic_table[id];
+    strncpy(instr->mnemonic, instr->desc->name, sizeof(instr->mnemonic));
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool is_label_at(const peephole_t *p, uint32_t address) {
+    return bsearch(&address, p->labels, p->label_count, sizeof(uint32_t), compare_addresses) != NULL;
+}
+
+static void collect_labels(peephole_t *p) {
+    symbol_table symbols = p->state->symbols;
+    p->labels = malloc(sizeof(uint32_t) * (symbols->len ? symbols->len : 1));
+    assert(p->labels != NULL);
+
+    p->label_count = 0;
+    for (uint32_t i = 0; i < symbols->capacity; i++) {
+        if (symbols->entries[i].dist != 0) p->labels[p->label_count++] = symbols->entries[i].value;
+    }
+    qsort(p->labels, p->label_count, sizeof(uint32_t), compare_addresses);
+}
+
+// WIDE MOVES
+
+static bool valid_wide_move(const instruction_t *instr) {
+    return instr->shift_amount % 16 == 0 && instr->shift_amount < (is_x(instr->rd) ? 64 : 32);
+}
+
+// Value a wide move leaves in its register, given the value before it
+static uint64_t wide_move_value(const instruction_t *instr, uint64_t before) {
+    uint64_t field = (uint64_t)instr->imm16 << instr->shift_amount;
+    uint64_t value;
+    if (has_mnemonic(instr, MN_MOVZ)) {
+        value = field;
+    } else if (has_mnemonic(instr, MN_MOVN)) {
+        value = ~field;
+    } else {
+        value = (before & ~((uint64_t)0xFFFF << instr->shift_amount)) | field;
+    }
+    return value & width_mask(instr->rd);
+}
+
+// Index of the only halfword of `bits` that is not zero, 0 if they all
+// are, or -1 if there is more than one
+static int single_halfword(uint64_t bits, int halfwords) {
+    int found = -1;
+    for (int h = 0; h < halfwords; h++) {
+        if (((bits >> (16 * h)) & 0xFFFF) == 0) continue;
+        if (found >= 0) return -1;
+        found = h;
+    }
+    return found < 0 ? 0 : found;
+}
+
+// Turns `instr` into the one movz or movn that loads `value`, if there is one
+static bool load_with_one_move(instruction_t *instr, uint64_t value) {
+    int halfwords = is_x(instr->rd) ? 4 : 2;
+    uint64_t inverse = ~value & width_mask(instr->rd);
+
+    int h = single_halfword(value, halfwords);
+    mnemonic_id_t id = MN_MOVZ;
+    if (h < 0) {
+        h = single_halfword(inverse, halfwords);
+        id = MN_MOVN;
+        value = inverse;
+    }
+    if (h < 0) return false;
+
+    set_mnemonic(instr, id);
+    instr->imm16 = (uint16_t)(value >> (16 * h));
+    instr->shift_amount = 16 * h;
+    return true;
+}
+
+// Folds a movz or movn followed by a movk of the same register into one
+// move, when the constant they build only needs one
+static bool fold_wide_moves(instruction_t *first, const instruction_t *second) {
+    if (first->type != INSTR_WIDE_MOVE || second->type != INSTR_WIDE_MOVE) return false;
+    if (!(has_mnemonic(first, MN_MOVZ) || has_mnemonic(first, MN_MOVN)) || !has_mnemonic(second, MN_MOVK)) {
+        return false;
+    }
+    if (!same_register(first->rd, second->rd) || !valid_wide_move(first) || !valid_wide_move(second)) {
+        return false;
+    }
+    return load_with_one_move(first, wide_move_value(second, wide_move_value(first, 0)));
+}
+
+// OTHER REWRITES
+
+// `mov xN, xN`, i.e. `orr xN, xzr, xN`. The w form is kept, as it clears
+// the upper half of the register
+static bool is_move_to_itself(const instruction_t *instr) {
+    return instr->type == INSTR_DATA_PROC_REG && has_mnemonic(instr, MN_ORR)
+        && instr->rn.type == REG_XZR && instr->operand.type == OP_REG
+        && instr->rd.type == REG_X && instr->operand.value.reg.type == REG_X
+        && instr->rd.number == instr->operand.value.reg.number;
+}
+
+static bool branches_to_next(const instruction_t *instr, symbol_table symbols) {
+    if (!instr->desc || !instr->branch_label) return false;
+    if (instr->desc->encoding != ENC_BRANCH && instr->desc->encoding != ENC_BRANCH_COND) return false;
+
+    uint32_t target = symbol_table_get(symbols, instr->branch_label);
+    return target != NOT_FOUND && target == instr->instr_address + instr->size;
+}
+
+static int power_of_two(uint64_t value) {
+    if (value == 0 || (value & (value - 1)) != 0) return -1;
+    int shift = 0;
+    while (value >>= 1) shift++;
+    return shift;
+}
+
+// madd or msub rd, rn, rm, ra with rn or rm known to hold 2^k becomes
+// add or sub rd, ra, <the other>, lsl #k
+static bool reduce_multiply(instruction_t *instr, const register_value_t *values) {
+    reg_t factors[2] = { instr->rm, instr->rn };
+    for (int i = 0; i < 2; i++) {
+        if (factors[i].number < 0 || factors[i].number >= 31 || !values[factors[i].number].known) continue;
+
+        int shift = power_of_two(values[factors[i].number].value & width_mask(factors[i]));
+        if (shift < 0) continue;
+
+        bool subtract = instr->desc->opc == mnemonic_table[MN_MSUB].opc;
+        instr->type = INSTR_DATA_PROC_REG;
+        set_mnemonic(instr, subtract ? MN_SUB : MN_ADD);
+        instr->rn = instr->ra;
+        instr->operand = (operand_t) {.type = OP_SHIFTED_REG, .value.shifted_reg = {
+            .reg = factors[1 - i],
+            .sh_type = LSL,
+            .shift_amount = shift
+        }};
+        return true;
+    }
+    return false;
+}
+
+static void forget(register_value_t *values, reg_t reg) {
+    if (reg.number >= 0 && reg.number < 31) values[reg.number].known = false;
+}
+
+// One pass over the instructions, rewriting them in place and marking the
+// ones to drop. Returns how many were marked
+static int rewrite_pass(peephole_t *p) {
+    instruction_t *instrs = p->state->instructions;
+    int count = p->state->instruction_count;
+    int removed = 0;
+
+    // Register 31 is the zero register or sp, and is never tracked
+    register_value_t values[32] = {0};
+
+    for (int i = 0; i < count; i++) {
+        instruction_t *instr = &instrs[i];
+        if (p->removed[i]) continue;
+
+        // Anything may jump to a label, so nothing is known past one
+        if (is_label_at(p, instr->instr_address)) {
+            memset(values, 0, sizeof(values));
+        }
+
+        switch (instr->type) {
+            case INSTR_WIDE_MOVE: {
+                // The movk must not be a branch target of its own
+                for (int next = i + 1; p->can_remove && next < count
+                        && !is_label_at(p, instrs[next].instr_address)
+                        && fold_wide_moves(instr, &instrs[next]); next++) {
+                    p->removed[next] = true;
+                    p->stats.folded_moves++;
+                    removed++;
+                }
+
+                if (instr->rd.number >= 31) break;
+                register_value_t *value = &values[instr->rd.number];
+                if (!valid_wide_move(instr) || (has_mnemonic(instr, MN_MOVK) && !value->known)) {
+                    value->known = false;
+                } else {
+                    value->value = wide_move_value(instr, value->value);
+                    value->known = true;
+                }
+                break;
+            }
+            case INSTR_MULTIPLY: {
+                if (reduce_multiply(instr, values)) p->stats.reduced_multiplies++;
+                forget(values, instr->rd);
+                break;
+            }
+            case INSTR_DATA_PROC_REG: {
+                if (p->can_remove && is_move_to_itself(instr)) {
+                    p->removed[i] = true;
+                    p->stats.removed_moves++;
+                    removed++;
+                }
+                forget(values, instr->rd);
+                break;
+            }
+            case INSTR_DATA_PROC_IMM: {
+                forget(values, instr->rd);
+                break;
+            }
+            case INSTR_LOAD_STORE: {
+                if (instr->address.dt == LOAD) forget(values, instr->rt);
+                if (instr->address.type == PRE_IND || instr->address.type == POST_IND) {
+                    forget(values, instr->address.value.pre_post_indexed.xn);
+                }
+                break;
+            }
+            case INSTR_BRANCH: {
+                if (p->can_remove && branches_to_next(instr, p->state->symbols)) {
+                    p->removed[i] = true;
+                    p->stats.removed_branches++;
+                    removed++;
+                }
+                memset(values, 0, sizeof(values));
+                break;
+            }
+            default: {
+                memset(values, 0, sizeof(values));
+                break;
+            }
+        }
+    }
+    return removed;
+}
+
+// A literal loaded from a numeric address would no longer point where it
+// did once the code in front of it shrinks
+static bool loads_from_addresses(const parser_state_t *state) {
+    for (int i = 0; i < state->instruction_count; i++) {
+        const instruction_t *instr = &state->instructions[i];
+        if (instr->type == INSTR_LOAD_STORE && instr->address.type == LITERAL
+                && instr->address.value.literal.label == NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+peephole_stats_t peephole_optimise(parser_state_t *state) {
+    assert(state->defer_encoding);
+
+    peephole_t p = { .state = state, .can_remove = !loads_from_addresses(state) };
+    int removed;
+    do {
+        collect_labels(&p);
+        p.removed = calloc(state->instruction_count + 1, sizeof(bool));
+        assert(p.removed != NULL);
+
+        removed = rewrite_pass(&p);
+        if (removed > 0) layout_update(state, p.removed);
+
+        free(p.removed);
+        free(p.labels);
+    } while (removed > 0);
+
+    return p.stats;
+}
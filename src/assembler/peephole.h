@@ -0,0 +1,43 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdbool.h>
+#include "parser.h"
+
+/**
+ * @struct peephole_stats_t
+ * @brief What one run of the peephole optimiser changed
+ *
+ * @var folded_moves `movz`+`movk` pairs folded into a single wide move
+ * @var removed_moves `mov xN, xN` no-ops removed
+ * @var reduced_multiplies Multiplies by a power of two turned into a shifted `add` or `sub`
+ * @var removed_branches Branches to the next instruction removed
+ */
+
+typedef struct {
+    int folded_moves;
+    int removed_moves;
+    int reduced_multiplies;
+    int removed_branches;
+} peephole_stats_t;
+
+/**
+ * @brief Rewrites parsed instructions into fewer and cheaper ones before encoding
+ *
+ * Runs between parsing and encoding, so the parser state must have been
+ * parsed with `defer_encoding` set. Instructions that are removed take
+ * their space with them: the instructions after them move up and every
+ * label is moved to the instruction it was in front of, with `.align`
+ * padding worked out again. The passes repeat until nothing changes, as
+ * removing instructions can leave a branch pointing at the next one.
+ *
+ * Addresses are assumed to be referred to only through labels, so nothing
+ * is removed from a source that loads a literal from a numeric address
+ *
+ * @param state Pointer to the parser state, not yet encoded
+ * @return What was changed
+ */
+
+peephole_stats_t peephole_optimise(parser_state_t *);
+
+#endif
@@ -1,200 +1,151 @@
 #include "symbol_table.h"
 
 
-static uint64_t hash_string(char *str) {
-    if (str == NULL) return HASH_STRING_NULL_OUTPUT;
-
-    uint64_t result = 0;
-    for (int i = 0; str[i] != '\0'; i++) {
-        result += (result * STRING_HASH_BASE + str[i]);
+// FNV-1a with a final avalanche, so the low bits used for the slot index
+// depend on every character
+static uint64_t hash_string(const char *str) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (; *str; str++) {
+        hash = (hash ^ (unsigned char)*str) * 0x100000001b3;
     }
-    return result;  
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    return hash;
 }
 
-static struct bucket bucket_create(void) {
-    struct bucket new;
-    new.capacity = BUCKET_INITIAL_CAPACITY;
-    new.len = 0;
-    new.pairs = malloc(sizeof(struct pair) * new.capacity);
-
-    return new;
+static symbol_entry_t *entries_create(uint32_t capacity) {
+    // dist = 0 marks every slot as empty
+    symbol_entry_t *entries = calloc(capacity, sizeof(symbol_entry_t));
+    assert(entries != NULL);
+    return entries;
 }
 
-symbol_table symbol_table_create(void) {
+symbol_table symbol_table_create_in_arena(arena_t *arena) {
     symbol_table new = malloc(sizeof(struct symbol_table));
+    assert(new != NULL);
     new->capacity = SYMBOL_TABLE_INITIAL_CAPACITY;
     new->len = 0; // 0 elements initially
-    new->buckets = malloc(sizeof(struct bucket) * new->capacity);
-    assert(new->buckets != NULL);
-
-    for (int i = 0; i < new->capacity; i++) {
-        new->buckets[i] = bucket_create();
-    }
+    new->entries = entries_create(new->capacity);
+    new->arena = arena;
+    new->owns_arena = false;
 
     return new;
 }
 
-static void bucket_resize(bucket buck) {
-    if (buck == NULL) return;
-
-    // Return if we don't need to resize
-    if (buck->len < buck->capacity) return;
-
-    buck->capacity *= BUCKET_RESIZE_RATE;
-    buck->pairs = realloc(buck->pairs, sizeof(struct pair) * buck->capacity);
-
-    return;
+symbol_table symbol_table_create(void) {
+    symbol_table new = symbol_table_create_in_arena(arena_create());
+    new->owns_arena = true;
+    return new;
 }
 
-static void bucket_append(bucket buck, pair pr) {
-    if (pr == NULL) return;
-
-    bucket_resize(buck);
-
-    for (int i = 0; i < buck->len; i++) {
-        if (strcmp(buck->pairs[i].key, pr->key) == 0) {
-            free(pr->key);
-            buck->pairs[i].value = pr->value;
-            return;
+// Robin Hood insertion of a key known not to be in the table: whenever the
+// entry being placed is further from home than the slot's occupant, they
+// swap and the occupant carries on probing
+static void insert_entry(symbol_entry_t *entries, uint32_t mask, symbol_entry_t entry) {
+    uint32_t i = entry.hash & mask;
+    entry.dist = 1;
+
+    while (entries[i].dist != 0) {
+        if (entries[i].dist < entry.dist) {
+            symbol_entry_t displaced = entries[i];
+            entries[i] = entry;
+            entry = displaced;
         }
+        i = (i + 1) & mask;
+        entry.dist++;
     }
-
-    buck->pairs[buck->len].key = pr->key;
-    buck->pairs[buck->len].value = pr->value;
-    buck->len++;
-
-    return;
+    entries[i] = entry;
 }
 
-static bool bucket_find(bucket buck, char *key) {
-    if (key == NULL) return false;
+static void symbol_table_rehash(symbol_table table, uint32_t new_capacity) {
+    symbol_entry_t *entries = entries_create(new_capacity);
 
-    for (int i = 0; i < buck->len; i++) {
-        if (strcmp(buck->pairs[i].key, key) == 0) {
-            return true;
+    // Stored hashes mean no key is hashed again
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].dist != 0) {
+            insert_entry(entries, new_capacity - 1, table->entries[i]);
         }
     }
-    return false;
-}
-
-static uint32_t bucket_get(bucket buck, char *key) {
-    if (key == NULL) return NOT_FOUND;
 
-    for (int i = 0; i < buck->len; i++) {
-        if (strcmp(buck->pairs[i].key, key) == 0) {
-            return buck->pairs[i].value;
-        }
-    }
-    return NOT_FOUND;
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = new_capacity;
 }
 
-static void bucket_free(bucket buck) {
-    if (buck == NULL) return;
-
-    for(int i = 0; i < buck->len; i++) {
-        free(buck->pairs[i].key);
-    }
-    free(buck->pairs);
-    return;
+static bool fits(uint32_t count, uint32_t capacity) {
+    return (uint64_t)count * SYMBOL_TABLE_MAX_LOAD_DEN <= (uint64_t)capacity * SYMBOL_TABLE_MAX_LOAD_NUM;
 }
 
-static void symbol_table_resize(symbol_table table) {
-    if (table == NULL) return;
-
-    // Return if we don't need to resize
-    if (table->len < table->capacity * SYMBOL_TABLE_LOAD_FACTOR) return;
-
-    int newCapacity = table->capacity * SYMBOL_TABLE_RESIZE_RATE;
-
-    bucket newBuckets = malloc(sizeof(struct bucket) * newCapacity);
+void symbol_table_reserve(symbol_table table, uint32_t count) {
+    uint32_t capacity = table->capacity;
+    while (!fits(count, capacity)) capacity *= 2;
 
-    for (int i = 0; i < newCapacity; i++) {
-        newBuckets[i] = bucket_create();
+    if (capacity != table->capacity) {
+        symbol_table_rehash(table, capacity);
     }
+}
 
-    for (int i = 0; i < table->capacity; i++) {
-        struct bucket curBucket = table->buckets[i];
-
-        for (int j = 0; j < curBucket.len; j++) {
-            int strHash = hash_string(curBucket.pairs[j].key);
-            int bucketIndex = strHash % newCapacity;
-
-            struct pair newPair = {
-                .key = strdup(curBucket.pairs[j].key),
-                .value = curBucket.pairs[j].value
-            };
+// Returns the entry holding `key`, or NULL. The probe stops as soon as it
+// reaches a slot whose occupant is closer to home than the key would be
+static symbol_entry_t *find_entry(symbol_table table, const char *key, uint64_t hash) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t i = hash & mask;
 
-            bucket_append(&newBuckets[bucketIndex], &newPair);
+    for (uint32_t dist = 1; table->entries[i].dist >= dist; dist++) {
+        symbol_entry_t *entry = &table->entries[i];
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return entry;
         }
+        i = (i + 1) & mask;
     }
-
-    // Free the old buckets
-    for (int i = 0; i < table->capacity; i++) {
-        bucket_free(&table->buckets[i]);
-    }
-    free(table->buckets);
-
-
-    table->capacity = newCapacity;
-    table->buckets = newBuckets;
-
-    return;
+    return NULL;
 }
 
 void symbol_table_append(symbol_table table, char *key, uint32_t value) {
     if (key == NULL) return;
 
-    uint64_t strHash = hash_string(key);
+    uint64_t hash = hash_string(key);
 
-    table->len++;
-    uint64_t bucketIndex = strHash % table->capacity;
+    // Existing keys just have their value updated
+    symbol_entry_t *existing = find_entry(table, key, hash);
+    if (existing) {
+        existing->value = value;
+        return;
+    }
+
+    if (!fits(table->len + 1, table->capacity)) {
+        symbol_table_rehash(table, table->capacity * 2);
+    }
 
-    struct pair newPair = {
-        .key = strdup(key),
+    symbol_entry_t entry = {
+        .key = arena_strndup(table->arena, key, strlen(key)),
+        .hash = hash,
         .value = value
     };
-    assert(newPair.key != NULL);
-
-    bucket_append(&table->buckets[bucketIndex], &newPair);
-
-    symbol_table_resize(table);
-    return;
+    insert_entry(table->entries, table->capacity - 1, entry);
+    table->len++;
 }
 
 bool symbol_table_find(symbol_table table, char *key) {
     if (key == NULL) return false;
 
-    uint64_t strHash = hash_string(key);
-    uint64_t bucketIndex = strHash % table->capacity;
-
-    if (bucket_find(&table->buckets[bucketIndex], key)) {
-        return true;
-    }
-
-    return false;
+    return find_entry(table, key, hash_string(key)) != NULL;
 }
 
 uint32_t symbol_table_get(symbol_table table, char *key) {
     if (key == NULL) return NOT_FOUND;
 
-    uint64_t strHash = hash_string(key);
-    uint64_t bucketIndex = strHash % table->capacity;
-    
-    if (bucket_find(&table->buckets[bucketIndex], key)) {
-            return bucket_get(&table->buckets[bucketIndex], key);
-    }
-
-    return NOT_FOUND;
+    symbol_entry_t *entry = find_entry(table, key, hash_string(key));
+    return entry ? entry->value : NOT_FOUND;
 }
 
 void symbol_table_free(symbol_table table) {
     if (table == NULL) return;
 
-    for (int i = 0; i < table->capacity; i++) {
-        bucket_free(&table->buckets[i]);
+    free(table->entries);
+    if (table->owns_arena) {
+        arena_destroy(table->arena);
     }
-    free(table->buckets);
     free(table);
-
-    return;
 }
@@ -6,77 +6,93 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdbool.h>
+#include "arena.h"
 
-#define SYMBOL_TABLE_INITIAL_CAPACITY 4
-#define BUCKET_INITIAL_CAPACITY 4
+#define SYMBOL_TABLE_INITIAL_CAPACITY 16 // Must be a power of two
 
-#define SYMBOL_TABLE_LOAD_FACTOR 0.75
-#define SYMBOL_TABLE_RESIZE_RATE 2
-
-#define BUCKET_RESIZE_RATE 2
-
-#define STRING_HASH_BASE 255
+// Grow once the table is 7/8 full; Robin Hood probing keeps probe
+// lengths short even at high load
+#define SYMBOL_TABLE_MAX_LOAD_NUM 7
+#define SYMBOL_TABLE_MAX_LOAD_DEN 8
 
 #define NOT_FOUND (UINT32_MAX)
-#define HASH_STRING_NULL_OUTPUT 0
 
 /**
- * @struct pair
- * @brief A simple pair struct
- * 
- * Holds strings as keys and uint32_ts as values
+ * @struct symbol_entry
+ * @brief A slot of the symbol table
+ *
+ * The key's full hash is stored so lookups only compare strings on a hash
+ * match and growing never rehashes a key. `dist` is the distance from the
+ * key's home slot plus one, so 0 marks an empty slot
  */
 
-struct pair {
-    char *key;
+typedef struct symbol_entry {
+    const char *key;
+    uint64_t hash;
     uint32_t value;
-};
-typedef struct pair *pair;
-
-
-/**
- * @struct bucket
- * @brief A container holding multiple pairs to handle collisions
- * 
- * Contains an array of pairs, its capacity, and current length
- */
-
-struct bucket {
-    int capacity;
-    int len;
-    pair pairs;
-};
-typedef struct bucket *bucket;
-
+    uint32_t dist;
+} symbol_entry_t;
 
 /**
  * @struct symbol_table
- * @brief The main hash map structure
- * 
- * Holds an array of buckets, with its total capacity and number of entries
+ * @brief Flat open addressing hash map from strings to uint32_ts
+ *
+ * Collisions are resolved with Robin Hood linear probing: an inserted key
+ * takes the slot of any key that is closer to its own home slot, which
+ * keeps probe lengths even and lets lookups stop early on a miss
+ *
+ * @var capacity Number of slots (a power of two)
+ * @var len Number of keys stored
+ * @var entries Slot array
+ * @var arena Arena the keys are interned in
+ * @var owns_arena Whether the arena was created by the table
  */
 
 struct symbol_table {
-    int capacity;
-    int len;
-    bucket buckets;
+    uint32_t capacity;
+    uint32_t len;
+    symbol_entry_t *entries;
+    arena_t *arena;
+    bool owns_arena;
 };
 typedef struct symbol_table *symbol_table;
 
 /**
  * @brief Creates a new, empty symbol table
  * 
- * Allocates and initializes the symbol table with default capacity
+ * Allocates and initializes the symbol table with default capacity.
+ * Keys are interned in an arena owned by the table
  * 
  * @return symbol_table Pointer to the newly created symbol table
  */
 
 extern symbol_table symbol_table_create(void);
 
+/**
+ * @brief Creates a new, empty symbol table whose keys live in an arena
+ * 
+ * Keys are interned in the given arena, so they are released together
+ * with the arena rather than the table
+ * 
+ * @param arena Arena the keys are interned in
+ * @return symbol_table Pointer to the newly created symbol table
+ */
+
+extern symbol_table symbol_table_create_in_arena(arena_t *);
+
+/**
+ * @brief Grows the table so that `count` keys fit without resizing
+ * 
+ * @param table Pointer to the symbol table
+ * @param count Expected number of keys, e.g. the number of labels
+ */
+
+extern void symbol_table_reserve(symbol_table, uint32_t);
+
 /**
  * @brief Inserts or updates a key-value pair in the symbol table
  * 
- * Copies the key string and associates it with the given value
+ * Interns the key string and associates it with the given value
  * Resizes the table if necessary
  * 
  * @param table Pointer to the symbol table
@@ -110,7 +126,8 @@ extern uint32_t symbol_table_get(symbol_table, char *);
 /**
  * @brief Frees all resources used by the symbol table
  * 
- * Frees all keys, pairs, buckets, and finally the symbol table itself
+ * Frees the slots, the keys if the table owns its arena, and finally the
+ * symbol table itself
  * 
  * @param table Pointer to the symbol table to free
  */
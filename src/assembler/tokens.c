@@ -1,114 +1,197 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tokens.h"
+#include "diagnostics.h"
 
-#define MAX_LINE_LEN 256
+#define READ_CHUNK_SIZE 4096
 
-token_list_t tokenise(FILE *in) {
-    char line[MAX_LINE_LEN];
-    token_list_t list = token_list_create();
+// Maps a regular file privately and writable, with one spare zero byte
+// past the end so the last token can be terminated in place
+static bool map_source(token_list_t list, int fd, size_t size) {
+    size_t map_size = size + 1;
+    char *reserve = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserve == MAP_FAILED) return false;
 
-    while(fgets(line, MAX_LINE_LEN, in)) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
-        }
-        bool is_blank = true;
-        for (size_t i = 0; i < strlen(line); i++) {
-            if (!isspace(line[i])) {
-            is_blank = false;
-            break;
-            }
-        }
+    if (mmap(reserve, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(reserve, map_size);
+        return false;
+    }
 
-        if (!is_blank) {
-            token_line(line, list);
-            token_t newline = { .type = TOKEN_NEWLINE, .value = strdup("\n") };
-            token_list_add(list, newline);
-        }
+    list->source = reserve;
+    list->source_len = size;
+    list->source_size = map_size;
+    return true;
+}
 
+static void read_source(token_list_t list, FILE *in) {
+    size_t capacity = READ_CHUNK_SIZE, len = 0;
+    char *buf = malloc(capacity);
+    assert(buf != NULL);
+
+    size_t n;
+    while ((n = fread(buf + len, 1, capacity - len - 1, in)) > 0) {
+        len += n;
+        if (capacity - len - 1 == 0) {
+            capacity *= 2;
+            buf = realloc(buf, capacity);
+            assert(buf != NULL);
+        }
     }
+    buf[len] = '\0';
 
-    token_t eof = { .type = TOKEN_EOF, .value = "\0" };
-    token_list_add(list, eof);
-
-    return list;
+    list->source = buf;
+    list->source_len = len;
+    list->source_size = 0;
 }
 
-void token_line(const char *line, token_list_t list) {
-    const char *ptr = line;
+static bool is_delimiter(char c) {
+    return c == '\0' || isspace(c) || c == ',' || c == '[' || c == ']' || c == '!';
+}
 
-    while (*ptr != '\0') {
+static void add_token(token_list_t list, token_type_t type, size_t offset, size_t length, int line) {
+    token_t token = { .type = type, .offset = offset, .length = length, .after_comma = list->comma, .line = line };
+    token_list_add(list, token);
+    list->comma = false;
+}
 
-        bool saw_newline = false;
-        while (isspace(*ptr)) {
-            if (*ptr == '\n') {
-                saw_newline = true;
+// Handles a single delimiter character, ending the line on a newline.
+// Lines without any tokens do not get a newline token
+static void add_delimiter(token_list_t list, char c, size_t offset, int *line_no, int *line_start) {
+    switch (c) {
+        case '[':
+            add_token(list, TOKEN_LBRACKET, offset, 1, *line_no);
+            break;
+        case ']':
+            add_token(list, TOKEN_RBRACKET, offset, 1, *line_no);
+            break;
+        case '!':
+            add_token(list, TOKEN_EXCLAMATION, offset, 1, *line_no);
+            break;
+        case ',':
+            list->comma = true;
+            break;
+        case '\n':
+            if (list->count > *line_start) {
+                add_token(list, TOKEN_NEWLINE, offset, 1, *line_no);
             }
-            ptr++;
-        }
-        if (saw_newline) {
-            token_t newline = { .type = TOKEN_NEWLINE, .value = strdup("\\n") };
-            token_list_add(list, newline);
-        }
+            (*line_no)++;
+            *line_start = list->count;
+            list->comma = false;
+            break;
+        default:
+            break;
+    }
+}
 
-        if (*ptr == '\0') break;
+// Classifies the null terminated word at `offset` and adds it as a token
+static void add_word(token_list_t list, size_t offset, size_t length, int line_no) {
+    char *val = list->source + offset;
+
+    if (val[0] == '.') {
+        add_token(list, TOKEN_DIRECTIVE, offset, length, line_no);
+    } else if (val[0] == '#') {
+        add_token(list, TOKEN_IMMEDIATE, offset + 1, length - 1, line_no); // skip the '#'
+    } else if (is_register(val)) {
+        add_token(list, TOKEN_REGISTER, offset, length, line_no);
+    } else if (is_shift(val)) {
+        add_token(list, TOKEN_SHIFT, offset, length, line_no);
+    } else if (is_mnemonic(val)) {
+        add_token(list, TOKEN_MNEMONIC, offset, length, line_no);
+    } else if (is_label(val)) {
+        val[length - 1] = '\0'; // remove trailing ':'
+        add_token(list, TOKEN_LABEL, offset, length - 1, line_no);
+    } else {
+        add_token(list, TOKEN_LITERAL, offset, length, line_no);
+    }
+}
 
-        if (*ptr == '[') {
-            token_t tok = {TOKEN_LBRACKET, strdup("[")};
-            token_list_add(list, tok);
-            ptr++;
-            continue;
-        }
-        else if (*ptr == ']') {
-            token_t tok = {TOKEN_RBRACKET, strdup("]")};
-            token_list_add(list, tok);
-            ptr++;
-            continue;
-        }
-        else if (*ptr == '!') {
-            token_t tok = {TOKEN_EXCLAMATION, strdup("!")};
-            token_list_add(list, tok);
-            ptr++;
-            continue;
-        }
-        else if (*ptr == ',') {
-            ptr++;
+token_list_t token_list_load(FILE *in) {
+    token_list_t list = token_list_create();
+
+    struct stat st;
+    int fd = fileno(in);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0
+            || !map_source(list, fd, st.st_size)) {
+        read_source(list, in);
+    }
+    list->owns_source = true;
+    return list;
+}
+
+// Tokenises the list's whole source, numbering lines from `line_no`
+static void tokenise_source(token_list_t list, int line_no) {
+    char *src = list->source;
+    size_t len = list->source_len;
+    int line_start = 0;
+    list->comma = false;
+
+    size_t i = 0;
+    while (i < len) {
+        if (is_delimiter(src[i])) {
+            add_delimiter(list, src[i], i, &line_no, &line_start);
+            i++;
             continue;
         }
 
-        const char *start = ptr;
-        while (*ptr && !isspace(*ptr) && *ptr != ',' && *ptr != '[' && *ptr != ']' && *ptr != '!') {
-            ptr++;
-        }
-        
-        int len = ptr - start;
-        char *val = strndup(start,len);
-
-        token_t token;
-
-        if (val[0] == '.') {
-            token.type = TOKEN_DIRECTIVE;
-        } else if (val[0] == '#') {
-            token.type = TOKEN_IMMEDIATE;
-            memmove(val, val + 1, strlen(val)); // remove the '#'
-        } else if (is_register(val)) {
-            token.type = TOKEN_REGISTER;
-        } else if (is_shift(val)) {
-            token.type = TOKEN_SHIFT;
-        } else if (is_mnemonic(val)) {
-            token.type = TOKEN_MNEMONIC;
-        } else if (is_label(val)) {
-            token.type = TOKEN_LABEL;
-            val[strlen(val) - 1] = '\0'; // remove trailing ':'
-        } else {
-            token.type = TOKEN_LITERAL;
+        size_t start = i;
+        while (!is_delimiter(src[i])) i++;
+
+        // Terminate the word in place; the delimiter it overwrites is
+        // handled straight away. src[len] is always a spare zero byte
+        char delim = src[i];
+        src[i] = '\0';
+        add_word(list, start, i - start, line_no);
+        if (i < len) {
+            add_delimiter(list, delim, i, &line_no, &line_start);
+            i++;
         }
+    }
 
-        token.value = val;
-        token_list_add(list, token);
+    // The last line may not end in a newline
+    if (list->count > line_start) {
+        add_token(list, TOKEN_NEWLINE, len, 0, line_no);
     }
+    add_token(list, TOKEN_EOF, len, 0, line_no);
+}
+
+token_list_t tokenise(FILE *in) {
+    token_list_t list = token_list_load(in);
+    tokenise_source(list, 1);
+    return list;
+}
 
-    // token_t newline = { .type = TOKEN_NEWLINE, .value = strdup("\\n") };
-    // token_list_add(list, newline);
+token_list_t tokenise_string(const char *source, size_t len) {
+    token_list_t list = token_list_create();
+    list->source = malloc(len + 1);
+    assert(list->source != NULL);
+    memcpy(list->source, source, len);
+    list->source[len] = '\0';
+    list->source_len = len;
+    list->owns_source = true;
+    tokenise_source(list, 1);
+    return list;
+}
+
+token_list_t tokenise_buffer(char *source, size_t len, int first_line) {
+    token_list_t list = token_list_create();
+    list->source = source;
+    list->source_len = len;
+    tokenise_source(list, first_line);
+    return list;
+}
+
+void tokenise_into(token_list_t list, char *source, size_t len, int first_line) {
+    list->count = 0;
+    list->current = 0;
+    list->failed = false;
+    list->source = source;
+    list->source_len = len;
+    tokenise_source(list, first_line);
+}
+
+char *token_text(token_list_t list, const token_t *token) {
+    return list->source + token->offset;
 }
 
 bool is_label(const char *str) {
@@ -149,7 +232,7 @@ bool is_immediate(const char *str) {
 }
 
 bool is_mnemonic(const char *str) {
-    return IS_MNEMONIC(str);
+    return lookup_mnemonic(str) != NULL;
 }
 
 bool is_shift(const char *val) {
@@ -166,7 +249,13 @@ token_list_t token_list_create() {
     list->capacity = 256;
     list->current = 0;
     list->tokens = malloc(list->capacity * sizeof(token_t));
-    assert(list != NULL);
+    assert(list->tokens != NULL);
+    list->source = NULL;
+    list->source_len = 0;
+    list->source_size = 0;
+    list->owns_source = false;
+    list->failed = false;
+    list->comma = false;
     return list;
 }
 
@@ -174,15 +263,18 @@ void token_list_add(token_list_t list, token_t token) {
     if (list->count >= list->capacity) {
         list->capacity *= 2;
         list->tokens = realloc(list->tokens, list->capacity * sizeof(token_t));
-        assert(list != NULL);
+        assert(list->tokens != NULL);
     }
     list->tokens[list->count++] = token;
 }
 
 void free_token_list(token_list_t list) {
-    // for (int i = 0; i < list->count; i++) {
-    //     free(list->tokens[i].value);
-    // }
+    // Lists from tokenise_buffer only borrow their source
+    if (list->owns_source && list->source_size > 0) {
+        munmap(list->source, list->source_size);
+    } else if (list->owns_source) {
+        free(list->source);
+    }
     free(list->tokens);
     free(list);
 }
@@ -204,7 +296,7 @@ token_t *advance(token_list_t list) {
 }
 
 token_t *current_token(token_list_t list) {
-    token_t token_obj = { .type = TOKEN_EOF, .value = NULL };
+    static token_t token_obj = { .type = TOKEN_EOF };
     return (list->current < list->count) ? &list->tokens[list->current] : &token_obj;
 }
 
@@ -216,12 +308,46 @@ token_t *peek_next(token_list_t list) {
     return NULL; // No next token
 }
 
+int token_column(token_list_t list, const token_t *token) {
+    int index = list->count;
+    if (token >= list->tokens && token < list->tokens + list->count) {
+        index = token - list->tokens;
+    }
+
+    // The line starts after the last newline token before this one, or
+    // after the blank lines that follow it, which have no tokens
+    size_t start = 0;
+    for (int i = index - 1; i >= 0; i--) {
+        if (list->tokens[i].type == TOKEN_NEWLINE) {
+            start = list->tokens[i].offset + 1;
+            break;
+        }
+    }
+    if (token->offset < start) return 1;
+    for (size_t i = start; i < token->offset; i++) {
+        if (list->source[i] == '\n') start = i + 1;
+    }
+    return token->offset - start + 1;
+}
+
+void token_error(token_list_t list, const token_t *token, const char *msg) {
+    if (list->failed) return;
+    list->failed = true;
+
+    int column = token_column(list, token);
+    if (token->type == TOKEN_NEWLINE || token->type == TOKEN_EOF) {
+        diag_error_at(token->line, column, "Error: %s, found the end of the line\n", msg);
+    } else {
+        diag_error_at(token->line, column, "Error: %s, found '%.*s'\n",
+            msg, (int)token->length, token_text(list, token));
+    }
+}
+
 token_t *expect(token_list_t list, token_type_t type, const char *msg) {
     token_t *tok = current_token(list);
-    if (!tok || tok->type != type) {
-        fprintf(stderr, "Error (found '%s', %s)\n",
-                msg, tok ? tok->value : "EOF");
-        exit(EXIT_FAILURE);
+    if (tok->type != type) {
+        token_error(list, tok, msg);
+        return tok;
     }
     advance(list);
     return tok;
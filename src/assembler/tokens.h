@@ -7,54 +7,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
-
-/**
- * @brief Checks if the instruction is a data-processing mnemonic
- */
-
-#define IS_DP_MNEMONIC(instr) ( \
-    strcmp((instr), "add")  == 0 || strcmp((instr), "adds") == 0 || \
-    strcmp((instr), "sub")  == 0 || strcmp((instr), "subs") == 0 || \
-    strcmp((instr), "cmp")  == 0 || strcmp((instr), "cmn")  == 0 || \
-    strcmp((instr), "neg")  == 0 || strcmp((instr), "negs") == 0 || \
-    strcmp((instr), "and")  == 0 || strcmp((instr), "ands") == 0 || \
-    strcmp((instr), "bic")  == 0 || strcmp((instr), "bics") == 0 || \
-    strcmp((instr), "eor")  == 0 || strcmp((instr), "eon")  == 0 || \
-    strcmp((instr), "orr")  == 0 || strcmp((instr), "orn")  == 0 || \
-    strcmp((instr), "tst")  == 0 || strcmp((instr), "mvn")  == 0 || \
-    strcmp((instr), "mov")  == 0 || strcmp((instr), "movn") == 0 || \
-    strcmp((instr), "movk") == 0 || strcmp((instr), "movz") == 0 || \
-    strcmp((instr), "madd") == 0 || strcmp((instr), "msub") == 0 || \
-    strcmp((instr), "mul")  == 0 || strcmp((instr), "mneg") == 0 \
-)
-
-/**
- * @brief Checks if the instruction is a branching mnemonic
- */
-
-#define IS_BRANCHING_MNEMONIC(instr) ( \
-    strcmp((instr), "b")  == 0 || strcmp((instr), "br") == 0 || \
-    strcmp((instr), "b.eq")  == 0 || strcmp((instr), "b.ne") == 0 || \
-    strcmp((instr), "b.ge")  == 0 || strcmp((instr), "b.lt")  == 0 || \
-    strcmp((instr), "b.gt")  == 0 || strcmp((instr), "b.le") == 0 || \
-    strcmp((instr), "b.al")  == 0 \
-)
-
-/**
- * @brief Checks if the instruction is a load/store mnemonic
- */
-
-#define IS_LOAD_STORE_MNEMONIC(instr) ( \
-    strcmp((instr), "str")  == 0 || strcmp((instr), "ldr") == 0 \
-)
-
-/**
- * @brief Checks if the instruction is any recognized mnemonic
- */
-
-#define IS_MNEMONIC(instr) ( \
-    IS_BRANCHING_MNEMONIC(instr) || IS_DP_MNEMONIC(instr) || IS_LOAD_STORE_MNEMONIC(instr) \
-)
+#include <stdint.h>
+#include "mnemonics.h"
 
 /**
  * @enum token_type_t
@@ -78,17 +32,28 @@ typedef enum {
 
 /**
  * @struct token_t
- * @brief Represents a single token with its type and string value
+ * @brief Represents a single token as a slice of the source buffer
+ *
+ * Word tokens are null terminated in place, so `token_text` can be used
+ * as a C string. Punctuation and newline tokens are not terminated
  */
 
 typedef struct {
     token_type_t type;
-    char *value;
+    uint32_t offset; // Start of the token in the source buffer
+    uint32_t length : 31;
+    uint32_t after_comma : 1; // A comma separates it from the token before
+    int line;
 } token_t;
 
 /**
  * @struct token_list
  * @brief Dynamic array structure holding a list of tokens and parsing state
+ *
+ * The list usually owns the source buffer its tokens point into, so
+ * strings taken from tokens (e.g. branch labels) live until the list is
+ * freed. Lists made by `tokenise_buffer` borrow a slice of another list's
+ * source instead
  */
 
 struct token_list {
@@ -96,12 +61,22 @@ struct token_list {
     int count;
     int capacity;
     int current;  // Current token index for parsing
+    char *source; // Private mapping (or copy) of the source file
+    size_t source_len;
+    size_t source_size; // Size of the mapping, 0 if the source was read into the heap
+    bool owns_source;
+    bool failed;  // A syntax error was reported in the statement being parsed
+    bool comma;   // A comma was seen since the last token was added
 };
 
 typedef struct token_list *token_list_t;
 
 /**
  * @brief Tokenizes the input assembly file stream into a list of tokens
+ *
+ * Regular files are mapped privately with `mmap` rather than read, other
+ * streams (e.g. pipes) are read into a single buffer. Tokens are emitted
+ * as slices of that buffer without any per-token allocation
  * 
  * @param in FILE pointer to the assembly source input stream
  * @return token_list_t Dynamically allocated list of tokens
@@ -110,13 +85,70 @@ typedef struct token_list *token_list_t;
 token_list_t tokenise(FILE *in);
 
 /**
- * @brief Tokenizes a single line of assembly source and adds tokens to the list
- * 
- * @param line Null terminated string of the line to tokenize
- * @param list Token list to add tokens to
+ * @brief Tokenizes an assembly source held in memory
+ *
+ * The source is copied, so the caller's buffer is left untouched and
+ * need not outlive the list
+ *
+ * @param source Assembly source text
+ * @param len Length of the source in bytes
+ * @return token_list_t Dynamically allocated list of tokens
+ */
+
+token_list_t tokenise_string(const char *source, size_t len);
+
+/**
+ * @brief Loads an assembly source without tokenising it
+ *
+ * The source is mapped or read exactly as `tokenise` does, so that slices
+ * of it can be tokenised separately with `tokenise_buffer`
+ *
+ * @param in FILE pointer to the assembly source input stream
+ * @return token_list_t Token list owning the source, with no tokens
  */
 
-void token_line(const char *line, token_list_t list);
+token_list_t token_list_load(FILE *in);
+
+/**
+ * @brief Tokenizes a slice of a source buffer owned by another token list
+ *
+ * Words are terminated in place, so the slice must end in a delimiter or
+ * just before the source's spare zero byte, and no two lists may share a
+ * slice. The buffer must outlive the returned list
+ *
+ * @param source Start of the slice
+ * @param len Length of the slice in bytes
+ * @param first_line Source line number the slice starts on
+ * @return token_list_t Dynamically allocated list of tokens
+ */
+
+token_list_t tokenise_buffer(char *source, size_t len, int first_line);
+
+/**
+ * @brief Tokenizes a buffer into an existing list, replacing its tokens
+ *
+ * Lets lines made by macro expansion reuse one list and token array
+ * from line to line. The list's ownership of its source is unchanged,
+ * and the buffer must end in a spare zero byte, as it is terminated in
+ * place like any other source
+ *
+ * @param list Token list to refill
+ * @param source Start of the buffer
+ * @param len Length of the buffer in bytes, not counting the spare byte
+ * @param first_line Source line number the tokens are given
+ */
+
+void tokenise_into(token_list_t list, char *source, size_t len, int first_line);
+
+/**
+ * @brief Returns the text of a token
+ *
+ * @param list Token list the token belongs to
+ * @param token Token to get the text of
+ * @return char* Pointer into the source buffer, null terminated for word tokens
+ */
+
+char *token_text(token_list_t list, const token_t *token);
 
 /**
  * @brief Creates a new, empty token list with initial capacity
@@ -127,7 +159,7 @@ void token_line(const char *line, token_list_t list);
 token_list_t token_list_create(void);
 
 /**
- * @brief Frees all memory used by the token list, including token strings
+ * @brief Frees all memory used by the token list, including the source buffer if it owns it
  * 
  * @param list Token list to free
  */
@@ -181,17 +213,46 @@ token_t *peek_next(token_list_t list);
 token_t *current_token(token_list_t list);
 
 /**
- * @brief Expects the current token to be of a specific type, exits with error if not
- * Advances the token pointer if matched
- * 
+ * @brief Expects the current token to be of a specific type
+ *
+ * Advances the token pointer if matched. Otherwise reports a syntax error
+ * with `token_error` and leaves the pointer where it is, so the caller can
+ * carry on to the end of the statement and skip it
+ *
  * @param list Token list parser state
  * @param type Expected token type
- * @param msg Error message to print if expectation fails
- * @return token_t* Pointer to the matched token
+ * @param msg Error message to report if expectation fails
+ * @return token_t* Pointer to the matched token, or to the current token if it did not match
  */
 
 token_t *expect(token_list_t list, token_type_t type, const char *msg);
 
+/**
+ * @brief Reports a syntax error at a token, with the text found there
+ *
+ * Only the first error in a statement is reported, as the rest usually
+ * follow from it. Sets `failed` until the parser clears it for the next
+ * statement
+ *
+ * @param list Token list the token belongs to
+ * @param token Token the error points at
+ * @param msg What was expected, without a trailing newline
+ */
+
+void token_error(token_list_t list, const token_t *token, const char *msg);
+
+/**
+ * @brief Column a token starts at on its line, counting from 1
+ *
+ * Worked out from the source when needed, as only errors need it
+ *
+ * @param list Token list the token belongs to
+ * @param token Token to locate
+ * @return int Column of the token
+ */
+
+int token_column(token_list_t list, const token_t *token);
+
 /**
  * @brief Returns true if the string matches the pattern for a label token
  * 
@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "parser.h"
+#include "layout.h"
+#include "encoding_functions.h"
+#include "assemble_utils.h"
+#include "diagnostics.h"
+
+#define DEFAULT_REPEATS 3
+
+/**
+ * Times the assembler's phases separately on a source, e.g. one written by
+ * asmgen.c: tokenising, parsing (with branch relaxation), encoding against
+ * the complete symbol table and writing the binary out. This is the
+ * deferred encoding path `assemble -j` and `-O` take, run on one thread so
+ * that each phase is measured on its own. Each phase keeps its fastest of
+ * the repeats and reports lines per second and the peak RSS once it is done.
+ */
+
+typedef enum { PHASE_TOKENISE, PHASE_PARSE, PHASE_ENCODE, PHASE_OUTPUT, NUM_PHASES } phase_t;
+
+static const char *phase_names[NUM_PHASES] = { "tokenise", "parse", "encode", "output" };
+
+typedef enum { FORMAT_JSON, FORMAT_CSV } output_format_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static long count_lines(FILE *in) {
+    long lines = 0;
+    int c, last = '\n';
+    while ((c = fgetc(in)) != EOF) {
+        if (c == '\n') lines++;
+        last = c;
+    }
+    if (last != '\n') lines++;
+    rewind(in);
+    return lines;
+}
+
+// Assembles the source once, recording the time each phase took and the
+// peak RSS after it. Returns false if the source did not assemble
+static bool assemble_once(const char *path, double seconds[NUM_PHASES], long rss[NUM_PHASES]) {
+    FILE *in = fopen(path, "r");
+    FILE *out = fopen("/dev/null", "wb");
+    if (!in || !out) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    parser_state_t *state = create_parser_state();
+    state->defer_encoding = true;
+
+    double start = now_seconds();
+    token_list_t tokens = tokenise(in);
+    seconds[PHASE_TOKENISE] = now_seconds() - start;
+    rss[PHASE_TOKENISE] = peak_rss_kb();
+
+    // As parse() does, the symbol table is sized for every label up front
+    start = now_seconds();
+    free_token_list(state->tokens);
+    state->tokens = tokens;
+    uint32_t labels = 0;
+    for (int i = 0; i < tokens->count; i++) {
+        if (tokens->tokens[i].type == TOKEN_LABEL) labels++;
+    }
+    symbol_table_reserve(state->symbols, labels);
+    int unresolved = parse_instructions(state);
+    relax_branches(state);
+    seconds[PHASE_PARSE] = now_seconds() - start;
+    rss[PHASE_PARSE] = peak_rss_kb();
+
+    start = now_seconds();
+    encode_instructions(state->instructions, state->instruction_count, state->symbols);
+    seconds[PHASE_ENCODE] = now_seconds() - start;
+    rss[PHASE_ENCODE] = peak_rss_kb();
+
+    start = now_seconds();
+    bool written = write_encoded_instructions(out, state->instructions, state->instruction_count);
+    written = fflush(out) == 0 && written;
+    seconds[PHASE_OUTPUT] = now_seconds() - start;
+    rss[PHASE_OUTPUT] = peak_rss_kb();
+
+    fclose(in);
+    fclose(out);
+    free_parser_state(state);
+    return written && unresolved == 0 && diag_error_count() == 0;
+}
+
+static void report(const char *source, const char *phase, long lines, double seconds, long rss,
+        output_format_t format) {
+    double lines_per_sec = seconds > 0 ? lines / seconds : 0;
+    if (format == FORMAT_JSON) {
+        printf("{\"source\": \"%s\", \"phase\": \"%s\", \"lines\": %ld, \"seconds\": %.6f, "
+            "\"lines_per_sec\": %.0f, \"peak_rss_kb\": %ld}\n",
+            source, phase, lines, seconds, lines_per_sec, rss);
+    } else {
+        printf("%s,%s,%ld,%.6f,%.0f,%ld\n", source, phase, lines, seconds, lines_per_sec, rss);
+    }
+}
+
+static int usage(void) {
+    printf("Usage: ./asmbench [--repeat <n>] [--format json|csv] <source.s>...\n");
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    int repeats = DEFAULT_REPEATS;
+    output_format_t format = FORMAT_JSON;
+    int first_source = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+            if (repeats < 1) return usage();
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "json") == 0) {
+                format = FORMAT_JSON;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                format = FORMAT_CSV;
+            } else {
+                return usage();
+            }
+        } else if (argv[i][0] != '-') {
+            first_source = i;
+            break;
+        } else {
+            return usage();
+        }
+    }
+
+    if (first_source == argc) {
+        return usage();
+    }
+
+    if (format == FORMAT_CSV) {
+        printf("source,phase,lines,seconds,lines_per_sec,peak_rss_kb\n");
+    }
+
+    for (int s = first_source; s < argc; s++) {
+        const char *path = argv[s];
+        FILE *in = fopen(path, "r");
+        if (!in) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+        long lines = count_lines(in);
+        fclose(in);
+        diag_set_file(path);
+
+        // Peak RSS only grows, so it is taken from the first run, where
+        // it still shows what each phase adds
+        double best[NUM_PHASES], total_best = 0;
+        long rss[NUM_PHASES], first_rss[NUM_PHASES];
+        for (int r = 0; r < repeats; r++) {
+            double seconds[NUM_PHASES];
+            if (!assemble_once(path, seconds, r == 0 ? first_rss : rss)) {
+                fprintf(stderr, "Benchmark %s failed to assemble\n", path);
+                return EXIT_FAILURE;
+            }
+            double total = 0;
+            for (int p = 0; p < NUM_PHASES; p++) {
+                if (r == 0 || seconds[p] < best[p]) best[p] = seconds[p];
+                total += seconds[p];
+            }
+            if (r == 0 || total < total_best) total_best = total;
+        }
+
+        for (int p = 0; p < NUM_PHASES; p++) {
+            report(path, phase_names[p], lines, best[p], first_rss[p], format);
+        }
+        report(path, "total", lines, total_best, first_rss[NUM_PHASES - 1], format);
+        fflush(stdout);
+    }
+    return EXIT_SUCCESS;
+}
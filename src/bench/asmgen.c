@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define DEFAULT_LINES 1000000
+#define BLOCK_LINES 16
+#define BRANCH_BLOCKS 32
+#define LITERAL_BACK_WORDS 1024
+
+/**
+ * Writes a random but valid assembly source of a given number of lines for
+ * the assembler benchmark (asmbench.c). Every line is drawn from the forms
+ * the parser takes: arithmetic and logical instructions with immediates and
+ * shifted registers, their aliases, multiplies, wide moves, branches to
+ * labels and registers, loads and stores in every addressing mode, constant
+ * loads from literal pools and `.int` data. A label opens every block of
+ * lines, and branches and literal loads only refer to labels a few blocks
+ * away, so nothing is out of reach whatever the length. The same seed
+ * always gives the same source.
+ */
+
+typedef struct {
+    FILE *out;
+    uint64_t random;
+    int block;          // Block the current line is in
+    int blocks;         // Blocks in the whole source, each opening with a label
+    uint64_t pc;        // Address of the next line, counting pool constants as they are loaded
+} generator_t;
+
+static uint64_t next_random(generator_t *g) {
+    g->random ^= g->random << 13;
+    g->random ^= g->random >> 7;
+    g->random ^= g->random << 17;
+    return g->random;
+}
+
+// Uniform in [0, n)
+static uint32_t pick(generator_t *g, uint32_t n) {
+    return next_random(g) % n;
+}
+
+static const char *const shifts[] = { "lsl", "lsr", "asr", "ror" };
+static const char *const conditions[] = { "eq", "ne", "ge", "lt", "gt", "le", "al" };
+static const char *const arithmetic[] = { "add", "adds", "sub", "subs" };
+static const char *const logical[] = { "and", "bic", "orr", "orn", "eor", "eon", "ands", "bics" };
+static const char *const wide_moves[] = { "movz", "movn", "movk" };
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+// A general purpose register of the given width, or now and then the zero
+// register when `zero` allows it
+static void reg(generator_t *g, char *buf, bool wide, bool zero) {
+    uint32_t number = pick(g, zero ? 32 : 31);
+    if (number == 31) {
+        strcpy(buf, wide ? "xzr" : "wzr");
+    } else {
+        sprintf(buf, "%c%u", wide ? 'x' : 'w', number);
+    }
+}
+
+// Base register of an address, which may be the stack pointer
+static void base_reg(generator_t *g, char *buf) {
+    uint32_t number = pick(g, 32);
+    if (number == 31) {
+        strcpy(buf, "sp");
+    } else {
+        sprintf(buf, "x%u", number);
+    }
+}
+
+// `, <shift> #<amount>`, or nothing. Arithmetic instructions cannot rotate
+static void shift(generator_t *g, char *buf, bool wide, bool rotate) {
+    uint32_t choice = pick(g, rotate ? 5 : 4);
+    if (choice == 0) {
+        buf[0] = '\0';
+    } else {
+        sprintf(buf, ", %s #%u", shifts[choice - 1], pick(g, wide ? 64 : 32));
+    }
+}
+
+// FORMS
+
+static void gen_arithmetic_imm(generator_t *g) {
+    bool wide = pick(g, 2);
+    char rd[4], rn[4];
+    reg(g, rd, wide, false);
+    reg(g, rn, wide, false);
+    fprintf(g->out, "%s %s, %s, #%u%s\n", arithmetic[pick(g, COUNT(arithmetic))], rd, rn,
+        pick(g, 4096), pick(g, 2) ? ", lsl #12" : "");
+}
+
+static void gen_arithmetic_reg(generator_t *g) {
+    bool wide = pick(g, 2);
+    char rd[4], rn[4], rm[4], sh[16];
+    reg(g, rd, wide, false);
+    reg(g, rn, wide, false);
+    reg(g, rm, wide, true);
+    shift(g, sh, wide, false);
+    fprintf(g->out, "%s %s, %s, %s%s\n", arithmetic[pick(g, COUNT(arithmetic))], rd, rn, rm, sh);
+}
+
+static void gen_logical(generator_t *g) {
+    bool wide = pick(g, 2);
+    char rd[4], rn[4], rm[4], sh[16];
+    reg(g, rd, wide, true);
+    reg(g, rn, wide, true);
+    reg(g, rm, wide, true);
+    shift(g, sh, wide, true);
+    fprintf(g->out, "%s %s, %s, %s%s\n", logical[pick(g, COUNT(logical))], rd, rn, rm, sh);
+}
+
+// cmp, cmn and tst leave out the destination, neg, negs, mov and mvn the
+// first source
+static void gen_alias(generator_t *g) {
+    bool wide = pick(g, 2);
+    char r1[4], r2[4], sh[16];
+    reg(g, r1, wide, false);
+    reg(g, r2, wide, true);
+    switch (pick(g, 8)) {
+        case 0: fprintf(g->out, "cmp %s, #%u\n", r1, pick(g, 4096)); break;
+        case 1: shift(g, sh, wide, false); fprintf(g->out, "cmn %s, %s%s\n", r1, r2, sh); break;
+        case 2: shift(g, sh, wide, false); fprintf(g->out, "cmp %s, %s%s\n", r1, r2, sh); break;
+        case 3: shift(g, sh, wide, false); fprintf(g->out, "neg %s, %s%s\n", r1, r2, sh); break;
+        case 4: shift(g, sh, wide, false); fprintf(g->out, "negs %s, %s%s\n", r1, r2, sh); break;
+        case 5: shift(g, sh, wide, true); fprintf(g->out, "tst %s, %s%s\n", r1, r2, sh); break;
+        case 6: fprintf(g->out, "mov %s, %s\n", r1, r2); break;
+        default: shift(g, sh, wide, true); fprintf(g->out, "mvn %s, %s%s\n", r1, r2, sh); break;
+    }
+}
+
+static void gen_multiply(generator_t *g) {
+    bool wide = pick(g, 2);
+    char rd[4], rn[4], rm[4], ra[4];
+    reg(g, rd, wide, false);
+    reg(g, rn, wide, false);
+    reg(g, rm, wide, false);
+    reg(g, ra, wide, true);
+    switch (pick(g, 4)) {
+        case 0: fprintf(g->out, "madd %s, %s, %s, %s\n", rd, rn, rm, ra); break;
+        case 1: fprintf(g->out, "msub %s, %s, %s, %s\n", rd, rn, rm, ra); break;
+        case 2: fprintf(g->out, "mul %s, %s, %s\n", rd, rn, rm); break;
+        default: fprintf(g->out, "mneg %s, %s, %s\n", rd, rn, rm); break;
+    }
+}
+
+static void gen_wide_move(generator_t *g) {
+    bool wide = pick(g, 2);
+    char rd[4];
+    reg(g, rd, wide, false);
+    uint32_t hw = pick(g, wide ? 4 : 2);
+    fprintf(g->out, "%s %s, #0x%x", wide_moves[pick(g, COUNT(wide_moves))], rd, pick(g, 0x10000));
+    if (hw > 0) fprintf(g->out, ", lsl #%u", hw * 16);
+    fputc('\n', g->out);
+}
+
+// A label a few blocks either side of the current one
+static int nearby_block(generator_t *g) {
+    int first = g->block > BRANCH_BLOCKS ? g->block - BRANCH_BLOCKS : 0;
+    int last = g->block + BRANCH_BLOCKS < g->blocks ? g->block + BRANCH_BLOCKS : g->blocks - 1;
+    return first + pick(g, last - first + 1);
+}
+
+static void gen_branch(generator_t *g) {
+    char rn[4];
+    switch (pick(g, 3)) {
+        case 0:
+            fprintf(g->out, "b blk%d\n", nearby_block(g));
+            break;
+        case 1:
+            fprintf(g->out, "b.%s blk%d\n", conditions[pick(g, COUNT(conditions))], nearby_block(g));
+            break;
+        default:
+            reg(g, rn, true, false);
+            fprintf(g->out, "br %s\n", rn);
+            break;
+    }
+}
+
+// Every addressing mode: zero and unsigned offsets, pre and post-index,
+// register offsets, and for loads literals at a label or an address
+static void gen_load_store(generator_t *g) {
+    bool wide = pick(g, 2);
+    bool load = pick(g, 2);
+    const char *op = load ? "ldr" : "str";
+    char rt[4], xn[4], xm[4];
+    reg(g, rt, wide, !load);
+    base_reg(g, xn);
+    uint32_t scale = wide ? 8 : 4;
+
+    switch (pick(g, load ? 7 : 5)) {
+        case 0: fprintf(g->out, "%s %s, [%s]\n", op, rt, xn); break;
+        case 1: fprintf(g->out, "%s %s, [%s, #%u]\n", op, rt, xn, pick(g, 4096) * scale); break;
+        case 2: fprintf(g->out, "%s %s, [%s, #%d]!\n", op, rt, xn, (int)pick(g, 512) - 256); break;
+        case 3: fprintf(g->out, "%s %s, [%s], #%d\n", op, rt, xn, (int)pick(g, 512) - 256); break;
+        case 4:
+            reg(g, xm, true, true);
+            fprintf(g->out, "%s %s, [%s, %s]\n", op, rt, xn, xm);
+            break;
+        case 5: fprintf(g->out, "ldr %s, blk%d\n", rt, nearby_block(g)); break;
+        default: {
+            // Somewhere in the code just behind, which is always in reach
+            uint64_t back = (uint64_t)pick(g, LITERAL_BACK_WORDS) * 4;
+            fprintf(g->out, "ldr %s, 0x%llx\n", rt, (unsigned long long)(g->pc > back ? g->pc - back : 0));
+            break;
+        }
+    }
+}
+
+// Every constant is new, so each takes a slot in the next literal pool
+static void gen_literal_pool_load(generator_t *g) {
+    bool wide = pick(g, 2);
+    char rt[4];
+    reg(g, rt, wide, false);
+    uint64_t value = next_random(g);
+    if (wide) {
+        fprintf(g->out, "ldr %s, =0x%llx\n", rt, (unsigned long long)value);
+    } else {
+        fprintf(g->out, "ldr %s, =0x%x\n", rt, (uint32_t)value);
+    }
+    g->pc += wide ? 8 : 4;
+}
+
+static void gen_data(generator_t *g) {
+    fprintf(g->out, ".int 0x%x\n", (uint32_t)next_random(g));
+}
+
+typedef void (*form_t)(generator_t *);
+
+// Weighted roughly like real code: mostly data processing and memory
+static const form_t forms[] = {
+    gen_arithmetic_imm, gen_arithmetic_imm, gen_arithmetic_reg, gen_arithmetic_reg,
+    gen_logical, gen_logical, gen_alias, gen_alias, gen_multiply, gen_wide_move,
+    gen_branch, gen_branch, gen_load_store, gen_load_store, gen_load_store,
+    gen_literal_pool_load, gen_data
+};
+
+static void generate(generator_t *g, long lines) {
+    g->blocks = (int)((lines + BLOCK_LINES - 1) / BLOCK_LINES);
+    for (long line = 0; line < lines; line++) {
+        if (line % BLOCK_LINES == 0) {
+            g->block = (int)(line / BLOCK_LINES);
+            fprintf(g->out, "blk%d:\n", g->block);
+            continue;
+        }
+        forms[pick(g, COUNT(forms))](g);
+        g->pc += 4;
+    }
+}
+
+static int usage(void) {
+    printf("Usage: ./asmgen [--lines <n>] [--seed <n>] [<out.s>]\n");
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    long lines = DEFAULT_LINES;
+    uint64_t seed = 0;
+    const char *out_name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            lines = atol(argv[++i]);
+            if (lines < 1) return usage();
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-' && !out_name) {
+            out_name = argv[i];
+        } else {
+            return usage();
+        }
+    }
+
+    FILE *out = out_name ? fopen(out_name, "w") : stdout;
+    if (!out) {
+        perror("Failed to open output");
+        return EXIT_FAILURE;
+    }
+
+    // xorshift never leaves zero, so the seed only perturbs a fixed state
+    generator_t g = { .out = out, .random = 0x9E3779B97F4A7C15 ^ (seed * 0xBF58476D1CE4E5B9) };
+    if (g.random == 0) g.random = 1;
+    generate(&g, lines);
+
+    if (fclose(out) != 0) {
+        perror("Failed to write output");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
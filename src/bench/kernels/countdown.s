@@ -0,0 +1,5 @@
+        movz    x0, #0x40, lsl #16
+loop:
+        subs    x0, x0, #1
+        b.ne    loop
+        and     x0, x0, x0
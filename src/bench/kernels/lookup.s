@@ -0,0 +1,32 @@
+        b       start
+table:
+        .int    0x9e3779b9
+        .int    0x7f4a7c15
+        .int    0xf39cc060
+        .int    0x5ced1a45
+        .int    0x1b873593
+        .int    0xcc9e2d51
+        .int    0x85ebca6b
+        .int    0xc2b2ae35
+        .int    0x27d4eb2f
+        .int    0x165667b1
+        .int    0xd3a2646c
+        .int    0xfd7046c5
+        .int    0xb55a4f09
+        .int    0x61c88647
+        .int    0x2545f491
+        .int    0x4f6cdd1d
+start:
+        movz    x1, #4
+        movz    x0, #0x8, lsl #16
+        movz    x2, #0
+        movz    x5, #0
+        movz    x6, #0x3c
+lookup:
+        ldr     w3, [x1, x2]
+        add     x5, x5, x3
+        add     x2, x2, #4
+        and     x2, x2, x6
+        subs    x0, x0, #1
+        b.ne    lookup
+        and     x0, x0, x0
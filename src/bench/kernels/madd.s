@@ -0,0 +1,12 @@
+        movz    x0, #0x10, lsl #16
+        movz    x1, #3
+        movz    x2, #5
+        movz    x3, #0
+mac:
+        madd    x3, x1, x2, x3
+        madd    x3, x3, x2, x1
+        msub    x4, x3, x1, x2
+        add     x1, x1, #1
+        subs    x0, x0, #1
+        b.ne    mac
+        and     x0, x0, x0
@@ -0,0 +1,13 @@
+        movz    x5, #32
+outer:
+        movz    x1, #0x1, lsl #16
+        movz    x2, #0x8, lsl #16
+        movz    x3, #0x2000
+copy:
+        ldr     x4, [x1], #8
+        str     x4, [x2], #8
+        subs    x3, x3, #1
+        b.ne    copy
+        subs    x5, x5, #1
+        b.ne    outer
+        and     x0, x0, x0
@@ -0,0 +1,32 @@
+        movz    x1, #0x1, lsl #16
+        movz    x2, #768
+        movz    x3, #12345
+        movz    x5, #0x4e6d
+        movk    x5, #0x41c6, lsl #16
+        movz    x6, #12345
+fill:
+        madd    x3, x3, x5, x6
+        str     w3, [x1], #4
+        subs    x2, x2, #1
+        b.ne    fill
+        movz    x9, #768
+outer:
+        subs    x9, x9, #1
+        b.eq    done
+        movz    x10, #0
+        movz    x1, #0x1, lsl #16
+inner:
+        ldr     w6, [x1]
+        ldr     w7, [x1, #4]
+        cmp     w6, w7
+        b.le    noswap
+        str     w7, [x1]
+        str     w6, [x1, #4]
+noswap:
+        add     x1, x1, #4
+        add     x10, x10, #1
+        cmp     x10, x9
+        b.lt    inner
+        b       outer
+done:
+        and     x0, x0, x0
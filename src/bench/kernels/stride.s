@@ -0,0 +1,19 @@
+        .equ    STRIDE, 8
+        .macro  step rd, base, off=0
+        ldr     \rd, [\base, #\off]
+        madd    x2, \rd, \rd, x2
+        .endm
+        .macro  advance base, by
+        add     \base, \base, #\by
+        .endm
+        movz    x0, #0x4, lsl #16
+        movz    x2, #0
+walk:
+        movz    x1, #0x1, lsl #16
+        .rept   8
+        step    x3, x1, STRIDE * 2
+        advance x1, (STRIDE * 2 + 8)
+        .endr
+        subs    x0, x0, #1
+        b.ne    walk
+        and     x0, x0, x0
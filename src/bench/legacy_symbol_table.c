@@ -0,0 +1,199 @@
+#include "legacy_symbol_table.h"
+
+
+static uint64_t hash_string(char *str) {
+    if (str == NULL) return LEGACY_HASH_STRING_NULL_OUTPUT;
+
+    uint64_t result = 0;
+    for (int i = 0; str[i] != '\0'; i++) {
+        result += (result * LEGACY_STRING_HASH_BASE + str[i]);
+    }
+    return result;  
+}
+
+static struct legacy_bucket bucket_create(void) {
+    struct legacy_bucket new;
+    new.capacity = LEGACY_BUCKET_INITIAL_CAPACITY;
+    new.len = 0;
+    new.pairs = malloc(sizeof(struct legacy_pair) * new.capacity);
+
+    return new;
+}
+
+legacy_symbol_table legacy_symbol_table_create(void) {
+    legacy_symbol_table new = malloc(sizeof(struct legacy_symbol_table));
+    new->capacity = LEGACY_SYMBOL_TABLE_INITIAL_CAPACITY;
+    new->len = 0; // 0 elements initially
+    new->buckets = malloc(sizeof(struct legacy_bucket) * new->capacity);
+    assert(new->buckets != NULL);
+
+    for (int i = 0; i < new->capacity; i++) {
+        new->buckets[i] = bucket_create();
+    }
+
+    return new;
+}
+
+static void bucket_resize(legacy_bucket buck) {
+    if (buck == NULL) return;
+
+    // Return if we don't need to resize
+    if (buck->len < buck->capacity) return;
+
+    buck->capacity *= LEGACY_BUCKET_RESIZE_RATE;
+    buck->pairs = realloc(buck->pairs, sizeof(struct legacy_pair) * buck->capacity);
+
+    return;
+}
+
+// Appends a legacy_pair whose key is known not to be in the legacy_bucket yet
+static void bucket_append(legacy_bucket buck, legacy_pair pr) {
+    if (pr == NULL) return;
+
+    bucket_resize(buck);
+
+    buck->pairs[buck->len].key = pr->key;
+    buck->pairs[buck->len].value = pr->value;
+    buck->len++;
+
+    return;
+}
+
+static bool bucket_find(legacy_bucket buck, char *key) {
+    if (key == NULL) return false;
+
+    for (int i = 0; i < buck->len; i++) {
+        if (strcmp(buck->pairs[i].key, key) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t bucket_get(legacy_bucket buck, char *key) {
+    if (key == NULL) return LEGACY_NOT_FOUND;
+
+    for (int i = 0; i < buck->len; i++) {
+        if (strcmp(buck->pairs[i].key, key) == 0) {
+            return buck->pairs[i].value;
+        }
+    }
+    return LEGACY_NOT_FOUND;
+}
+
+static void bucket_free(legacy_bucket buck, bool free_keys) {
+    if (buck == NULL) return;
+
+    if (free_keys) {
+        for(int i = 0; i < buck->len; i++) {
+            free(buck->pairs[i].key);
+        }
+    }
+    free(buck->pairs);
+    return;
+}
+
+static void legacy_symbol_table_resize(legacy_symbol_table table) {
+    if (table == NULL) return;
+
+    // Return if we don't need to resize
+    if (table->len < table->capacity * LEGACY_SYMBOL_TABLE_LOAD_FACTOR) return;
+
+    int newCapacity = table->capacity * LEGACY_SYMBOL_TABLE_RESIZE_RATE;
+
+    legacy_bucket newBuckets = malloc(sizeof(struct legacy_bucket) * newCapacity);
+
+    for (int i = 0; i < newCapacity; i++) {
+        newBuckets[i] = bucket_create();
+    }
+
+    for (int i = 0; i < table->capacity; i++) {
+        struct legacy_bucket curBucket = table->buckets[i];
+
+        for (int j = 0; j < curBucket.len; j++) {
+            uint64_t strHash = hash_string(curBucket.pairs[j].key);
+            uint64_t bucketIndex = strHash % newCapacity;
+
+            // Keys move over to the new buckets as they are
+            bucket_append(&newBuckets[bucketIndex], &curBucket.pairs[j]);
+        }
+    }
+
+    // Free the old buckets
+    for (int i = 0; i < table->capacity; i++) {
+        bucket_free(&table->buckets[i], false);
+    }
+    free(table->buckets);
+
+
+    table->capacity = newCapacity;
+    table->buckets = newBuckets;
+
+    return;
+}
+
+void legacy_symbol_table_append(legacy_symbol_table table, char *key, uint32_t value) {
+    if (key == NULL) return;
+
+    uint64_t strHash = hash_string(key);
+    uint64_t bucketIndex = strHash % table->capacity;
+    legacy_bucket buck = &table->buckets[bucketIndex];
+
+    // Existing keys just have their value updated
+    for (int i = 0; i < buck->len; i++) {
+        if (strcmp(buck->pairs[i].key, key) == 0) {
+            buck->pairs[i].value = value;
+            return;
+        }
+    }
+
+    struct legacy_pair newPair = {
+        .key = strdup(key),
+        .value = value
+    };
+    assert(newPair.key != NULL);
+
+    table->len++;
+    bucket_append(buck, &newPair);
+
+    legacy_symbol_table_resize(table);
+    return;
+}
+
+bool legacy_symbol_table_find(legacy_symbol_table table, char *key) {
+    if (key == NULL) return false;
+
+    uint64_t strHash = hash_string(key);
+    uint64_t bucketIndex = strHash % table->capacity;
+
+    if (bucket_find(&table->buckets[bucketIndex], key)) {
+        return true;
+    }
+
+    return false;
+}
+
+uint32_t legacy_symbol_table_get(legacy_symbol_table table, char *key) {
+    if (key == NULL) return LEGACY_NOT_FOUND;
+
+    uint64_t strHash = hash_string(key);
+    uint64_t bucketIndex = strHash % table->capacity;
+    
+    if (bucket_find(&table->buckets[bucketIndex], key)) {
+            return bucket_get(&table->buckets[bucketIndex], key);
+    }
+
+    return LEGACY_NOT_FOUND;
+}
+
+void legacy_symbol_table_free(legacy_symbol_table table) {
+    if (table == NULL) return;
+
+    for (int i = 0; i < table->capacity; i++) {
+        bucket_free(&table->buckets[i], true);
+    }
+    free(table->buckets);
+    free(table);
+
+    return;
+}
@@ -0,0 +1,123 @@
+#ifndef LEGACY_SYMBOL_TABLE_H
+#define LEGACY_SYMBOL_TABLE_H
+
+// The assembler's original separate chaining symbol table, kept here
+// under a legacy_ prefix as the baseline for the symbol table benchmark
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#define LEGACY_SYMBOL_TABLE_INITIAL_CAPACITY 4
+#define LEGACY_BUCKET_INITIAL_CAPACITY 4
+
+#define LEGACY_SYMBOL_TABLE_LOAD_FACTOR 0.75
+#define LEGACY_SYMBOL_TABLE_RESIZE_RATE 2
+
+#define LEGACY_BUCKET_RESIZE_RATE 2
+
+#define LEGACY_STRING_HASH_BASE 255
+
+#define LEGACY_NOT_FOUND (UINT32_MAX)
+#define LEGACY_HASH_STRING_NULL_OUTPUT 0
+
+/**
+ * @struct legacy_pair
+ * @brief A simple legacy_pair struct
+ * 
+ * Holds strings as keys and uint32_ts as values
+ */
+
+struct legacy_pair {
+    char *key;
+    uint32_t value;
+};
+typedef struct legacy_pair *legacy_pair;
+
+
+/**
+ * @struct legacy_bucket
+ * @brief A container holding multiple pairs to handle collisions
+ * 
+ * Contains an array of pairs, its capacity, and current length
+ */
+
+struct legacy_bucket {
+    int capacity;
+    int len;
+    legacy_pair pairs;
+};
+typedef struct legacy_bucket *legacy_bucket;
+
+
+/**
+ * @struct legacy_symbol_table
+ * @brief The main hash map structure
+ * 
+ * Holds an array of buckets, with its total capacity and number of entries
+ */
+
+struct legacy_symbol_table {
+    int capacity;
+    int len;
+    legacy_bucket buckets;
+};
+typedef struct legacy_symbol_table *legacy_symbol_table;
+
+/**
+ * @brief Creates a new, empty symbol table
+ * 
+ * Allocates and initializes the symbol table with default capacity
+ * 
+ * @return legacy_symbol_table Pointer to the newly created symbol table
+ */
+
+extern legacy_symbol_table legacy_symbol_table_create(void);
+
+/**
+ * @brief Inserts or updates a key-value legacy_pair in the symbol table
+ * 
+ * Copies the key string and associates it with the given value
+ * Resizes the table if necessary
+ * 
+ * @param table Pointer to the symbol table
+ * @param key Null-terminated string key
+ * @param value Unsigned 32-bit integer value
+ */
+
+extern void legacy_symbol_table_append(legacy_symbol_table, char *, uint32_t);
+
+/**
+ * @brief Checks whether a key exists in the symbol table
+ * 
+ * @param table Pointer to the symbol table
+ * @param key Null-terminated string key
+ * @return true If the key exists in the table
+ * @return false Otherwise or if key is NULL
+ */
+
+extern bool legacy_symbol_table_find(legacy_symbol_table, char *);
+
+/**
+ * @brief Retrieves the value associated with a key
+ * 
+ * @param table Pointer to the symbol table
+ * @param key Null-terminated string key
+ * @return uint32_t The value associated with the key or LEGACY_NOT_FOUND if key not found
+ */
+
+extern uint32_t legacy_symbol_table_get(legacy_symbol_table, char *);
+
+/**
+ * @brief Frees all resources used by the symbol table
+ * 
+ * Frees all keys, pairs, buckets, and finally the symbol table itself
+ * 
+ * @param table Pointer to the symbol table to free
+ */
+
+extern void legacy_symbol_table_free(legacy_symbol_table);
+
+#endif
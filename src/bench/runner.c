@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "machine_state.h"
+#include "ioutils.h"
+#include "execute.h"
+#include "coverage.h"
+#include "fuzz.h"
+
+#define DEFAULT_REPEATS 3
+
+/**
+ * Engine modes the kernels are measured in: the plain interpreter and the
+ * interpreter with each kind of instrumentation switched on.
+ */
+typedef enum {
+    MODE_INTERP,
+    MODE_COVERAGE,
+    MODE_FUZZ_EDGES,
+    NUM_MODES
+} engine_mode_t;
+
+static const char *mode_names[NUM_MODES] = { "interp", "coverage", "fuzz-edges" };
+
+typedef enum {
+    FORMAT_JSON,
+    FORMAT_CSV
+} output_format_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Strips the directory and extension from a kernel path
+static void kernel_name(const char *path, char *name, size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(name, size, "%s", base);
+    char *dot = strrchr(name, '.');
+    if (dot) *dot = '\0';
+}
+
+// Runs one kernel in one mode, keeping the fastest of `repeats` runs
+static void measure(const char *path, engine_mode_t mode, int repeats, output_format_t format) {
+    if (mode == MODE_FUZZ_EDGES) {
+        fuzz_edge_map = calloc(FUZZ_MAP_SIZE, 1);
+    }
+
+    uint64_t steps = 0;
+    double best = 0;
+    for (int i = 0; i < repeats; i++) {
+        STATE *state = new_machine_state();
+        load_binary_to_memory(path, state->memory);
+        if (mode == MODE_COVERAGE) coverage_enable();
+
+        double start = now_seconds();
+        steps = run_machine(state, 0);
+        double elapsed = now_seconds() - start;
+
+        if (i == 0 || elapsed < best) best = elapsed;
+        free_machine_state(state);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    char name[256];
+    kernel_name(path, name, sizeof(name));
+    double mips = best > 0 ? steps / best / 1e6 : 0;
+    double ns_per_instr = steps > 0 ? best * 1e9 / steps : 0;
+
+    if (format == FORMAT_JSON) {
+        printf("{\"kernel\": \"%s\", \"mode\": \"%s\", \"instructions\": %" PRIu64 ", "
+            "\"seconds\": %.6f, \"mips\": %.2f, \"ns_per_instr\": %.2f, \"peak_rss_kb\": %ld}\n",
+            name, mode_names[mode], steps, best, mips, ns_per_instr, usage.ru_maxrss);
+    } else {
+        printf("%s,%s,%" PRIu64 ",%.6f,%.2f,%.2f,%ld\n",
+            name, mode_names[mode], steps, best, mips, ns_per_instr, usage.ru_maxrss);
+    }
+    fflush(stdout);
+}
+
+static int usage(void) {
+    printf("Usage: ./runner [--repeat <n>] [--format json|csv] [--mode <mode>] <kernel.bin>...\n");
+    printf("Modes: interp, coverage, fuzz-edges (default: all)\n");
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    int repeats = DEFAULT_REPEATS;
+    output_format_t format = FORMAT_JSON;
+    int only_mode = -1;
+    int first_kernel = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+            if (repeats < 1) return usage();
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "json") == 0) {
+                format = FORMAT_JSON;
+            } else if (strcmp(argv[i], "csv") == 0) {
+                format = FORMAT_CSV;
+            } else {
+                return usage();
+            }
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            i++;
+            for (int m = 0; m < NUM_MODES; m++) {
+                if (strcmp(argv[i], mode_names[m]) == 0) only_mode = m;
+            }
+            if (only_mode < 0) return usage();
+        } else if (argv[i][0] != '-') {
+            first_kernel = i;
+            break;
+        } else {
+            return usage();
+        }
+    }
+
+    if (first_kernel == argc) {
+        return usage();
+    }
+
+    if (format == FORMAT_CSV) {
+        printf("kernel,mode,instructions,seconds,mips,ns_per_instr,peak_rss_kb\n");
+        fflush(stdout);
+    }
+
+    // Each measurement runs in its own process so peak RSS is per mode
+    int status = EXIT_SUCCESS;
+    for (int k = first_kernel; k < argc; k++) {
+        for (int m = 0; m < NUM_MODES; m++) {
+            if (only_mode >= 0 && m != only_mode) continue;
+
+            pid_t child = fork();
+            if (child < 0) {
+                perror("fork");
+                return EXIT_FAILURE;
+            }
+            if (child == 0) {
+                measure(argv[k], m, repeats, format);
+                exit(EXIT_SUCCESS);
+            }
+
+            int child_status;
+            waitpid(child, &child_status, 0);
+            if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+                fprintf(stderr, "Benchmark %s (%s) failed\n", argv[k], mode_names[m]);
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    return status;
+}
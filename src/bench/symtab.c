@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "symbol_table.h"
+#include "legacy_symbol_table.h"
+
+#define DEFAULT_LABELS 1000000
+#define LABEL_LEN 32
+
+/**
+ * Compares the assembler's symbol table against the original chained
+ * table (legacy_symbol_table.c) on generated labels: inserting every
+ * label, looking every label up, and looking up labels that are missing.
+ */
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Labels look like the ones compilers and generators emit
+static char *generate_labels(int count, const char *prefix) {
+    char *labels = malloc((size_t)count * LABEL_LEN);
+    if (!labels) {
+        perror("Failed to allocate labels");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        snprintf(labels + (size_t)i * LABEL_LEN, LABEL_LEN, ".%s_loop%d", prefix, i);
+    }
+    return labels;
+}
+
+// Visits the labels in a scrambled order so lookups do not follow inserts
+static int *shuffled_order(int count) {
+    int *order = malloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++) order[i] = i;
+
+    uint64_t state = 0x9E3779B97F4A7C15;
+    for (int i = count - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int j = state % (i + 1);
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    return order;
+}
+
+static void report(const char *table, const char *op, int count, double seconds) {
+    printf("{\"table\": \"%s\", \"op\": \"%s\", \"keys\": %d, \"seconds\": %.6f, "
+        "\"mops\": %.2f, \"ns_per_op\": %.2f}\n",
+        table, op, count, seconds, count / seconds / 1e6, seconds * 1e9 / count);
+}
+
+static void bench_current(const char *labels, const char *missing, const int *order, int count, bool presize) {
+    const char *name = presize ? "robin-hood-presized" : "robin-hood";
+    symbol_table table = symbol_table_create();
+
+    double start = now_seconds();
+    if (presize) symbol_table_reserve(table, count);
+    for (int i = 0; i < count; i++) {
+        symbol_table_append(table, (char *)labels + (size_t)i * LABEL_LEN, i * 4);
+    }
+    report(name, "insert", count, now_seconds() - start);
+
+    uint64_t checksum = 0;
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        checksum += symbol_table_get(table, (char *)labels + (size_t)order[i] * LABEL_LEN);
+    }
+    report(name, "lookup", count, now_seconds() - start);
+
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        checksum += symbol_table_find(table, (char *)missing + (size_t)order[i] * LABEL_LEN);
+    }
+    report(name, "miss", count, now_seconds() - start);
+
+    if (checksum != (uint64_t)count * (count - 1) * 2) {
+        fprintf(stderr, "%s returned wrong values\n", name);
+        exit(EXIT_FAILURE);
+    }
+    symbol_table_free(table);
+}
+
+static void bench_legacy(const char *labels, const char *missing, const int *order, int count) {
+    legacy_symbol_table table = legacy_symbol_table_create();
+
+    double start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        legacy_symbol_table_append(table, (char *)labels + (size_t)i * LABEL_LEN, i * 4);
+    }
+    report("chained", "insert", count, now_seconds() - start);
+
+    uint64_t checksum = 0;
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        checksum += legacy_symbol_table_get(table, (char *)labels + (size_t)order[i] * LABEL_LEN);
+    }
+    report("chained", "lookup", count, now_seconds() - start);
+
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        checksum += legacy_symbol_table_find(table, (char *)missing + (size_t)order[i] * LABEL_LEN);
+    }
+    report("chained", "miss", count, now_seconds() - start);
+
+    if (checksum != (uint64_t)count * (count - 1) * 2) {
+        fprintf(stderr, "chained table returned wrong values\n");
+        exit(EXIT_FAILURE);
+    }
+    legacy_symbol_table_free(table);
+}
+
+int main(int argc, char **argv) {
+    int count = DEFAULT_LABELS;
+    if (argc == 3 && strcmp(argv[1], "--labels") == 0) {
+        count = atoi(argv[2]);
+    } else if (argc != 1) {
+        printf("Usage: ./symtab [--labels <n>]\n");
+        return EXIT_FAILURE;
+    }
+    if (count < 1) {
+        printf("Label count must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    char *labels = generate_labels(count, "L");
+    char *missing = generate_labels(count, "M");
+    int *order = shuffled_order(count);
+
+    bench_legacy(labels, missing, order, count);
+    bench_current(labels, missing, order, count, false);
+    bench_current(labels, missing, order, count, true);
+
+    free(order);
+    free(missing);
+    free(labels);
+    return EXIT_SUCCESS;
+}
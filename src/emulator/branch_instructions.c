@@ -4,6 +4,8 @@
 #include "machine_state.h"
 #include "utils.h"
 #include "branch_instructions.h"
+#include "fuzz.h"
+#include "coverage.h"
 
 bool eval_cond(
     STATE *state, 
@@ -63,8 +65,10 @@ void branch_conditional(
     uint32_t simm19 = getRangeInt(instr,23,5);
     uint32_t cond = getRangeInt(instr,3,0);
     int64_t offset = sign_extend_64(simm19 << 2, 21);
+    bool taken = eval_cond(state, cond);
 
-    if (eval_cond(state, cond)) {
+    COVERAGE_RECORD_BRANCH(state->pc, taken);
+    if (taken) {
         state->pc += offset;
     }
     else {
@@ -85,6 +89,7 @@ void branch(
 
     uint32_t bit_31 = getRangeInt(instr, 31, 31);
     uint32_t bit_30 = getRangeInt(instr, 30, 30);
+    uint64_t from = state->pc;
     if (bit_31) {
         branch_register(state, instr);
     }
@@ -94,4 +99,5 @@ void branch(
     else {
         branch_unconditional(state, instr);
     }
+    FUZZ_RECORD_EDGE(from, state->pc);
 }
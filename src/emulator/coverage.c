@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "coverage.h"
+#include "linemap.h"
+#include "utils.h"
+
+#define IS_BRANCH_COND(instr) (((instr) & 0xFF000010) == 0x54000000)
+#define TEST_BIT(map, word) ((map)[(word) >> 3] & (1 << ((word) & 7)))
+#define SET_BIT(map, word) ((map)[(word) >> 3] |= (1 << ((word) & 7)))
+
+int coverage_enabled = 0;
+
+static coverage_page_t *pages[COVERAGE_NUM_PAGES];
+
+static coverage_page_t *get_page(uint64_t pc, bool allocate) {
+    uint64_t index = pc / COVERAGE_PAGE_SIZE;
+    if (index >= COVERAGE_NUM_PAGES) return NULL;
+
+    if (!pages[index] && allocate) {
+        pages[index] = calloc(1, sizeof(coverage_page_t));
+        if (!pages[index]) {
+            perror("Failed to allocate coverage page");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pages[index];
+}
+
+void coverage_enable(void) {
+    for (int i = 0; i < COVERAGE_NUM_PAGES; i++) {
+        free(pages[i]);
+        pages[i] = NULL;
+    }
+    coverage_enabled = 1;
+}
+
+void coverage_record_exec(
+    uint64_t pc
+) {
+    coverage_page_t *page = get_page(pc, true);
+    if (page) SET_BIT(page->executed, (pc % COVERAGE_PAGE_SIZE) / 4);
+}
+
+void coverage_record_branch(
+    uint64_t pc,
+    int was_taken
+) {
+    coverage_page_t *page = get_page(pc, true);
+    if (!page) return;
+
+    uint64_t word = (pc % COVERAGE_PAGE_SIZE) / 4;
+    if (was_taken) {
+        SET_BIT(page->taken, word);
+    } else {
+        SET_BIT(page->not_taken, word);
+    }
+}
+
+// Tallies for the LF/LH/BRF/BRH summary lines
+typedef struct {
+    int lines_found, lines_hit;
+    int branches_found, branches_hit;
+} lcov_totals_t;
+
+static void write_line(FILE *out, uint64_t addr, uint32_t line, STATE *state, lcov_totals_t *totals) {
+    coverage_page_t *page = get_page(addr, false);
+    uint64_t word = (addr % COVERAGE_PAGE_SIZE) / 4;
+    int executed = page && TEST_BIT(page->executed, word);
+
+    if (IS_BRANCH_COND(load_word(state, addr))) {
+        int taken = page && TEST_BIT(page->taken, word);
+        int not_taken = page && TEST_BIT(page->not_taken, word);
+        if (executed) {
+            fprintf(out, "BRDA:%u,0,0,%d\nBRDA:%u,0,1,%d\n", line, taken, line, not_taken);
+        } else {
+            fprintf(out, "BRDA:%u,0,0,-\nBRDA:%u,0,1,-\n", line, line);
+        }
+        totals->branches_found += 2;
+        totals->branches_hit += taken + not_taken;
+    }
+
+    fprintf(out, "DA:%u,%d\n", line, executed);
+    totals->lines_found++;
+    totals->lines_hit += executed;
+}
+
+bool coverage_write_lcov(
+    const char *filename,
+    const char *linemap_file,
+    const char *binary_name,
+    STATE *state,
+    size_t image_size
+) {
+    linemap_t *map = NULL;
+    if (linemap_file) {
+        map = linemap_load(linemap_file);
+        if (!map) {
+            fprintf(stderr, "Failed to load line map %s\n", linemap_file);
+            return false;
+        }
+    }
+
+    FILE *out = fopen(filename, "w");
+    if (!out) {
+        perror("Failed to open coverage file");
+        linemap_free(map);
+        return false;
+    }
+
+    lcov_totals_t totals = {0};
+    fprintf(out, "TN:\nSF:%s\n", map ? map->source : binary_name);
+
+    if (map) {
+        for (uint32_t i = 0; i < map->count; i++) {
+            write_line(out, map->entries[i].address, map->entries[i].line, state, &totals);
+        }
+    } else {
+        for (uint64_t addr = 0; addr + 3 < image_size; addr += 4) {
+            write_line(out, addr, addr / 4 + 1, state, &totals);
+        }
+    }
+
+    fprintf(out, "BRF:%d\nBRH:%d\nLF:%d\nLH:%d\nend_of_record\n",
+        totals.branches_found, totals.branches_hit,
+        totals.lines_found, totals.lines_hit);
+
+    linemap_free(map);
+    return fclose(out) == 0;
+}
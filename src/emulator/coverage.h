@@ -0,0 +1,91 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "machine_state.h"
+
+#define COVERAGE_PAGE_SIZE 4096
+#define COVERAGE_PAGE_WORDS (COVERAGE_PAGE_SIZE / 4)
+#define COVERAGE_BITMAP_BYTES (COVERAGE_PAGE_WORDS / 8)
+#define COVERAGE_NUM_PAGES (MEMORY_SIZE / COVERAGE_PAGE_SIZE)
+
+/**
+ * Coverage bitmaps for one page of guest text, one bit per instruction.
+ * Pages are only allocated once code on them executes.
+ */
+typedef struct {
+    uint8_t executed[COVERAGE_BITMAP_BYTES];
+    uint8_t taken[COVERAGE_BITMAP_BYTES];      // Conditional branch was taken
+    uint8_t not_taken[COVERAGE_BITMAP_BYTES];  // Conditional branch fell through
+} coverage_page_t;
+
+/**
+ * Non-zero while coverage is being collected.
+ */
+extern int coverage_enabled;
+
+/**
+ * Records that the instruction at `pc` executed.
+ */
+#define COVERAGE_RECORD_EXEC(pc) do { \
+    if (coverage_enabled) coverage_record_exec(pc); \
+} while (0)
+
+/**
+ * Records which way the conditional branch at `pc` went.
+ */
+#define COVERAGE_RECORD_BRANCH(pc, was_taken) do { \
+    if (coverage_enabled) coverage_record_branch((pc), (was_taken)); \
+} while (0)
+
+/**
+ * Starts collecting coverage, discarding anything recorded before.
+ */
+void coverage_enable(void);
+
+/**
+ * Marks the instruction at `pc` as executed.
+ *
+ * @param pc Address of the instruction.
+ */
+void coverage_record_exec(
+    uint64_t pc
+);
+
+/**
+ * Marks the conditional branch at `pc` as taken or not taken.
+ *
+ * @param pc Address of the branch instruction.
+ * @param was_taken Non-zero if the branch was taken.
+ */
+void coverage_record_branch(
+    uint64_t pc,
+    int was_taken
+);
+
+/**
+ * Writes the collected coverage as an lcov tracefile.
+ *
+ * Addresses are mapped back to source lines with the line table emitted
+ * by `assemble --linemap`. Without a table, every word of the loaded image
+ * is reported as a line of the binary itself (line = address / 4 + 1).
+ * Conditional branches are found by decoding guest memory and reported
+ * as BRDA records with the taken branch first.
+ *
+ * @param filename Path to the output tracefile.
+ * @param linemap_file Path to the assembler's line table, or NULL.
+ * @param binary_name Path of the binary that was run.
+ * @param state Pointer to the final machine state.
+ * @param image_size Number of bytes loaded from the binary.
+ * @return true on success, false on failure.
+ */
+bool coverage_write_lcov(
+    const char *filename,
+    const char *linemap_file,
+    const char *binary_name,
+    STATE *state,
+    size_t image_size
+);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+#include "emulate.h"
+#include "machine_state.h"
+
+/**
+ * The instruction groups, told apart by bits 28-25 (op0).
+ *
+ * Shared by the emulator, which dispatches on the group, and the
+ * disassembler, so the two never disagree about what a word is.
+ */
+typedef enum {
+    CLASS_HALT,
+    CLASS_BRANCH,
+    CLASS_DP_IMM,
+    CLASS_DP_REG,
+    CLASS_LOAD_STORE,
+    CLASS_UNKNOWN
+} instr_class_t;
+
+/**
+ * Extracts the bits `hi` down to `lo` of an instruction.
+ *
+ * A shift and a mask, unlike `getRangeInt`, for the paths that decode
+ * every word of a large image.
+ *
+ * @param instr The 32-bit instruction.
+ * @param hi Index of the highest bit of the field.
+ * @param lo Index of the lowest bit of the field.
+ * @return The field, in the low bits.
+ */
+static inline uint32_t decode_field(
+    uint32_t instr,
+    unsigned hi,
+    unsigned lo
+) {
+    return (instr >> lo) & ((UINT32_C(2) << (hi - lo)) - 1);
+}
+
+/**
+ * Finds which group an instruction belongs to.
+ *
+ * @param instr The 32-bit instruction.
+ * @return The group, with the halt instruction in a group of its own.
+ */
+static inline instr_class_t decode_class(
+    uint32_t instr
+) {
+    uint32_t op0 = decode_field(instr, 28, 25);
+
+    if (instr == HALT_INSTR) return CLASS_HALT;
+    if (IS_BRANCH(op0)) return CLASS_BRANCH;
+    if (IS_DP_IMM(op0)) return CLASS_DP_IMM;
+    if (IS_DP_REG(op0)) return CLASS_DP_REG;
+    if (IS_LOAD_STORE(op0)) return CLASS_LOAD_STORE;
+    return CLASS_UNKNOWN;
+}
+
+#endif
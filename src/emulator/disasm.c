@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "disassemble.h"
+
+#define DISASM_CHUNK_WORDS (64 * 1024)
+#define ANNOTATION_MAX 24
+// Room for a label line and an instruction line for every word
+#define DISASM_CHUNK_BYTES ((size_t)DISASM_CHUNK_WORDS * (ANNOTATION_MAX + 2 * DISASM_LINE_MAX) + DISASM_LINE_MAX)
+
+static int usage(void) {
+    printf("Usage: ./disasm [--annotate] [-j <threads>] <file_in> [<file_out>]\n");
+    return EXIT_FAILURE;
+}
+
+typedef struct {
+    const uint32_t *words;
+    uint32_t count;
+    uint32_t size;
+    const uint64_t *labels;
+    int annotate;
+    char **buffers;     // One per chunk of the current round
+    size_t *lengths;
+    uint32_t first_chunk;
+    uint32_t round_chunks;
+    atomic_uint next_chunk;
+} format_job_t;
+
+static size_t write_label(
+    char *p,
+    uint32_t address
+) {
+    size_t length = disassemble_label(address, p);
+    p[length++] = ':';
+    p[length++] = '\n';
+    return length;
+}
+
+// Formats the words of one chunk, with the label lines in front of them
+static size_t format_chunk(
+    const format_job_t *job,
+    uint32_t chunk,
+    char *out
+) {
+    uint32_t first = chunk * DISASM_CHUNK_WORDS;
+    uint32_t last = first + DISASM_CHUNK_WORDS;
+    // The last chunk also holds the label at the end of the image
+    if (last >= job->count) last = job->count + 1;
+
+    char *p = out;
+    for (uint32_t i = first; i < last; i++) {
+        if (job->labels[i / 64] >> (i % 64) & 1) {
+            p += write_label(p, i * 4);
+        }
+        if (i == job->count) break;
+        if (job->annotate) {
+            // objdump style address and word columns; not valid assembly
+            p += snprintf(p, ANNOTATION_MAX, "%8x:\t%08x\t", i * 4, job->words[i]);
+        }
+        p += disassemble_instruction(job->words[i], i * 4, job->size, p);
+    }
+    return p - out;
+}
+
+static void *format_worker(void *arg) {
+    format_job_t *job = arg;
+
+    for (;;) {
+        uint32_t slot = atomic_fetch_add(&job->next_chunk, 1);
+        if (slot >= job->round_chunks) break;
+        job->lengths[slot] = format_chunk(job, job->first_chunk + slot, job->buffers[slot]);
+    }
+    return NULL;
+}
+
+// Disassembles an image of `size` bytes, placing a label line at every
+// address a branch or literal load refers to. Rounds of one chunk per
+// thread are formatted side by side and written out in order
+static int disassemble_image(
+    const uint32_t *words,
+    uint32_t size,
+    FILE *file_out,
+    int annotate,
+    int threads
+) {
+    format_job_t job = { .words = words, .count = size / 4, .size = size, .annotate = annotate };
+    uint32_t chunk_count = job.count / DISASM_CHUNK_WORDS + 1;
+    if ((uint32_t)threads > chunk_count) threads = chunk_count;
+
+    // One bit per word, plus the end of the image
+    uint64_t *labels = calloc(job.count / 64 + 1, sizeof(uint64_t));
+    job.buffers = calloc(threads, sizeof(char *));
+    job.lengths = calloc(threads, sizeof(size_t));
+    pthread_t *pool = calloc(threads, sizeof(pthread_t));
+    int ok = labels && job.buffers && job.lengths && pool;
+    for (int i = 0; ok && i < threads; i++) {
+        job.buffers[i] = malloc(DISASM_CHUNK_BYTES);
+        ok = job.buffers[i] != NULL;
+    }
+    if (!ok) {
+        perror("Failed to allocate memory");
+    }
+
+    for (uint32_t i = 0; ok && i < job.count; i++) {
+        uint32_t target;
+        if (disassemble_target(words[i], i * 4, size, &target)) {
+            labels[target / 256] |= UINT64_C(1) << (target / 4 % 64);
+        }
+    }
+    job.labels = labels;
+
+    for (uint32_t round = 0; ok && round < chunk_count; round += threads) {
+        job.first_chunk = round;
+        job.round_chunks = chunk_count - round < (uint32_t)threads ? chunk_count - round : (uint32_t)threads;
+        atomic_init(&job.next_chunk, 0);
+
+        // The calling thread formats chunks alongside the pool
+        int started = 0;
+        for (; started < (int)job.round_chunks - 1; started++) {
+            if (pthread_create(&pool[started], NULL, format_worker, &job) != 0) break;
+        }
+        format_worker(&job);
+        for (int i = 0; i < started; i++) {
+            pthread_join(pool[i], NULL);
+        }
+
+        for (uint32_t i = 0; ok && i < job.round_chunks; i++) {
+            ok = fwrite(job.buffers[i], 1, job.lengths[i], file_out) == job.lengths[i];
+        }
+    }
+
+    for (int i = 0; job.buffers && i < threads; i++) {
+        free(job.buffers[i]);
+    }
+    free(job.buffers);
+    free(job.lengths);
+    free(pool);
+    free(labels);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    int annotate = 0;
+    int threads = 1;
+    char *files[2] = { NULL, NULL }; // Input and optional output file
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--annotate") == 0) {
+            annotate = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) return usage();
+        } else if (argv[i][0] != '-' && file_count < 2) {
+            files[file_count++] = argv[i];
+        } else {
+            return usage();
+        }
+    }
+    if (file_count == 0) {
+        return usage();
+    }
+
+    int fd = open(files[0], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("Error opening file");
+        return EXIT_FAILURE;
+    }
+    if (st.st_size % 4 != 0 || st.st_size > UINT32_MAX) {
+        fprintf(stderr, "%s is not a whole number of instructions\n", files[0]);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    // The image is read straight from the page cache, once per pass
+    const uint32_t *words = NULL;
+    if (st.st_size > 0) {
+        words = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (words == MAP_FAILED) {
+            perror("Failed to map file");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        madvise((void *)words, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    FILE *file_out = files[1] ? fopen(files[1], "w") : stdout;
+    if (!file_out) {
+        perror("Error opening file");
+        return EXIT_FAILURE;
+    }
+
+    int status = disassemble_image(words, st.st_size, file_out, annotate, threads);
+    if (fclose(file_out) != 0) status = EXIT_FAILURE;
+    if (words) munmap((void *)words, st.st_size);
+    return status;
+}
@@ -0,0 +1,458 @@
+#include <string.h>
+#include "machine_state.h"
+#include "utils.h"
+#include "decode.h"
+#include "data_proc.h"
+#include "dp_register.h"
+#include "bitwise_shifts.h"
+#include "branch_instructions.h"
+#include "disassemble.h"
+
+// Fixed bits of the encodings the assembler produces, beyond what
+// decode_class already checks
+#define BRANCH_MASK        0xFC000000
+#define BRANCH_BITS        0x14000000
+#define BRANCH_COND_MASK   0xFF000010
+#define BRANCH_COND_BITS   0x54000000
+#define BRANCH_REG_MASK    0xFFFFFC1F
+#define BRANCH_REG_BITS    0xD61F0000
+#define LOAD_LITERAL_MASK  0xBF000000
+#define LOAD_LITERAL_BITS  0x18000000
+#define TRANSFER_MASK      0xBC800000 // bit 31, bits 29-26 and bit 23
+#define TRANSFER_BITS      0xB8000000
+#define REGISTER_OFFSET    26         // bits 15-10 of a register offset transfer
+#define ZERO_REGISTER      31
+
+// Names are copied 8 bytes at a time, which the slack in DISASM_LINE_MAX allows
+typedef struct {
+    char text[8];
+    size_t length;
+} name_t;
+
+#define NAME(str) { str, sizeof(str) - 1 }
+
+static const name_t arithmetic_names[4] = { NAME("add"), NAME("adds"), NAME("sub"), NAME("subs") };
+static const name_t logical_names[4][2] = {
+    [AND]  = { NAME("and"), NAME("bic") },
+    [ORR]  = { NAME("orr"), NAME("orn") },
+    [EOR]  = { NAME("eor"), NAME("eon") },
+    [ANDS] = { NAME("ands"), NAME("bics") }
+};
+static const name_t wide_move_names[4] = { [MOVN] = NAME("movn"), [MOVZ] = NAME("movz"), [MOVK] = NAME("movk") };
+static const name_t shift_names[4] = { [LSL] = NAME("lsl"), [LSR] = NAME("lsr"), [ASR] = NAME("asr"), [ROR] = NAME("ror") };
+static const name_t condition_names[16] = {
+    [EQ] = NAME("b.eq"), [NE] = NAME("b.ne"), [GE] = NAME("b.ge"), [LT] = NAME("b.lt"),
+    [GT] = NAME("b.gt"), [LE] = NAME("b.le"), [AL] = NAME("b.al")
+};
+static const char hex_digits[] = "0123456789abcdef";
+
+// Inlined, so the length of a literal is known at compile time
+static inline char *put_str(
+    char *p,
+    const char *str
+) {
+    size_t length = strlen(str);
+    memcpy(p, str, length);
+    return p + length;
+}
+
+static inline char *put_name(
+    char *p,
+    const name_t *name
+) {
+    memcpy(p, name->text, sizeof(name->text));
+    return p + name->length;
+}
+
+// Hex without leading zeros or a prefix
+static char *put_hex_digits(
+    char *p,
+    uint32_t value
+) {
+    int shift = 28;
+    while (shift > 0 && (value >> shift) == 0) shift -= 4;
+    for (; shift >= 0; shift -= 4) {
+        *p++ = hex_digits[(value >> shift) & 0xF];
+    }
+    return p;
+}
+
+static char *put_hex(
+    char *p,
+    uint32_t value
+) {
+    *p++ = '0';
+    *p++ = 'x';
+    return put_hex_digits(p, value);
+}
+
+static char *put_dec(
+    char *p,
+    int64_t value
+) {
+    char digits[20];
+    int n = 0;
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    if (value < 0) *p++ = '-';
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+static char *put_reg(
+    char *p,
+    uint32_t number,
+    bool is_64bit
+) {
+    *p++ = is_64bit ? 'x' : 'w';
+    if (number == ZERO_REGISTER) {
+        *p++ = 'z';
+        *p++ = 'r';
+    } else if (number >= 10) {
+        *p++ = '0' + number / 10;
+        *p++ = '0' + number % 10;
+    } else {
+        *p++ = '0' + number;
+    }
+    return p;
+}
+
+static char *put_sep_reg(
+    char *p,
+    uint32_t number,
+    bool is_64bit
+) {
+    *p++ = ',';
+    *p++ = ' ';
+    return put_reg(p, number, is_64bit);
+}
+
+// ", #<imm>" with the immediate in hex
+static char *put_sep_imm(
+    char *p,
+    uint32_t value
+) {
+    p = put_str(p, ", #");
+    return put_hex(p, value);
+}
+
+// ", <shift> #<amount>", left out for the default `lsl #0`
+static char *put_shift(
+    char *p,
+    uint32_t type,
+    uint32_t amount
+) {
+    if (type == LSL && amount == 0) return p;
+    *p++ = ',';
+    *p++ = ' ';
+    p = put_name(p, &shift_names[type]);
+    p = put_str(p, " #");
+    return put_dec(p, amount);
+}
+
+// True if a target can be written as a label, which the assembler needs
+// for branches
+static bool has_label(
+    int64_t target,
+    uint32_t image_size
+) {
+    return target >= 0 && target <= image_size;
+}
+
+size_t disassemble_label(
+    uint32_t address,
+    char *out
+) {
+    out[0] = 'L';
+    return put_hex_digits(out + 1, address) - out;
+}
+
+// Finds the address a branch or literal load refers to, which may lie
+// outside the image
+static bool referenced_address(
+    uint32_t instr,
+    uint32_t address,
+    int64_t *target
+) {
+    if ((instr & BRANCH_MASK) == BRANCH_BITS) {
+        *target = address + (int64_t)sign_extend(decode_field(instr, 25, 0), 26) * 4;
+        return true;
+    }
+    if ((instr & BRANCH_COND_MASK) == BRANCH_COND_BITS || (instr & LOAD_LITERAL_MASK) == LOAD_LITERAL_BITS) {
+        *target = address + (int64_t)sign_extend(decode_field(instr, 23, 5), 19) * 4;
+        return true;
+    }
+    return false;
+}
+
+bool disassemble_target(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    uint32_t *target
+) {
+    int64_t referenced;
+    if (!referenced_address(instr, address, &referenced) || !has_label(referenced, image_size)) {
+        return false;
+    }
+    *target = referenced;
+    return true;
+}
+
+static char *format_dp_imm(
+    uint32_t instr,
+    char *p
+) {
+    bool sf = decode_field(instr, 31, 31);
+    uint32_t opc = decode_field(instr, 30, 29);
+    uint32_t opi = decode_field(instr, 25, 23);
+    uint32_t rd = decode_field(instr, 4, 0);
+
+    if (opi == ARITHMETIC) {
+        uint32_t rn = decode_field(instr, 9, 5);
+        if (rd == ZERO_REGISTER && (opc == ADDS || opc == SUBS)) {
+            p = put_str(p, opc == SUBS ? "cmp " : "cmn ");
+            p = put_reg(p, rn, sf);
+        } else {
+            p = put_name(p, &arithmetic_names[opc]);
+            *p++ = ' ';
+            p = put_reg(p, rd, sf);
+            p = put_sep_reg(p, rn, sf);
+        }
+        p = put_sep_imm(p, decode_field(instr, 21, 10));
+        if (decode_field(instr, 22, 22) == SHIFT) {
+            p = put_str(p, ", lsl #12");
+        }
+        return p;
+    }
+
+    if (opi == WIDE_MOVE && wide_move_names[opc].length) {
+        uint32_t hw = decode_field(instr, 22, 21);
+        p = put_name(p, &wide_move_names[opc]);
+        *p++ = ' ';
+        p = put_reg(p, rd, sf);
+        p = put_sep_imm(p, decode_field(instr, 20, 5));
+        if (hw) {
+            p = put_str(p, ", lsl #");
+            p = put_dec(p, hw * 16);
+        }
+        return p;
+    }
+    return NULL;
+}
+
+static char *format_multiply(
+    uint32_t instr,
+    char *p
+) {
+    // opc must be 00 and opr 1000, as the emulator checks
+    if (decode_field(instr, 30, 29) != 0 || decode_field(instr, 24, 21) != 8) {
+        return NULL;
+    }
+    bool sf = decode_field(instr, 31, 31);
+    bool negate = decode_field(instr, 15, 15);
+    uint32_t ra = decode_field(instr, 14, 10);
+
+    if (ra == ZERO_REGISTER) {
+        p = put_str(p, negate ? "mneg " : "mul ");
+    } else {
+        p = put_str(p, negate ? "msub " : "madd ");
+    }
+    p = put_reg(p, decode_field(instr, 4, 0), sf);
+    p = put_sep_reg(p, decode_field(instr, 9, 5), sf);
+    p = put_sep_reg(p, decode_field(instr, 20, 16), sf);
+    if (ra != ZERO_REGISTER) {
+        p = put_sep_reg(p, ra, sf);
+    }
+    return p;
+}
+
+static char *format_dp_reg(
+    uint32_t instr,
+    char *p
+) {
+    if (decode_field(instr, 28, 28)) {
+        return format_multiply(instr, p);
+    }
+
+    bool sf = decode_field(instr, 31, 31);
+    uint32_t opc = decode_field(instr, 30, 29);
+    bool arithmetic = decode_field(instr, 24, 24);
+    uint32_t shift_type = decode_field(instr, 23, 22);
+    uint32_t N = decode_field(instr, 21, 21);
+    uint32_t rm = decode_field(instr, 20, 16);
+    uint32_t amount = decode_field(instr, 15, 10);
+    uint32_t rn = decode_field(instr, 9, 5);
+    uint32_t rd = decode_field(instr, 4, 0);
+
+    // Register the alias leaves out: 0 for rd, 1 for rn, -1 for neither
+    int omitted = -1;
+    if (arithmetic) {
+        if (shift_type == ROR || N) return NULL;
+        if (rd == ZERO_REGISTER && (opc == ADDS || opc == SUBS)) {
+            p = put_str(p, opc == SUBS ? "cmp" : "cmn");
+            omitted = 0;
+        } else if (rn == ZERO_REGISTER && (opc == SUB || opc == SUBS)) {
+            p = put_str(p, opc == SUBS ? "negs" : "neg");
+            omitted = 1;
+        } else {
+            p = put_name(p, &arithmetic_names[opc]);
+        }
+    } else {
+        if (opc == ANDS && !N && rd == ZERO_REGISTER) {
+            p = put_str(p, "tst");
+            omitted = 0;
+        } else if (opc == ORR && rn == ZERO_REGISTER && (N || (shift_type == LSL && amount == 0))) {
+            p = put_str(p, N ? "mvn" : "mov");
+            omitted = 1;
+        } else {
+            p = put_name(p, &logical_names[opc][N]);
+        }
+    }
+
+    *p++ = ' ';
+    if (omitted != 0) {
+        p = put_reg(p, rd, sf);
+        *p++ = ',';
+        *p++ = ' ';
+    }
+    if (omitted != 1) {
+        p = put_reg(p, rn, sf);
+        *p++ = ',';
+        *p++ = ' ';
+    }
+    p = put_reg(p, rm, sf);
+    return put_shift(p, shift_type, amount);
+}
+
+static char *format_branch(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    char *p
+) {
+    if ((instr & BRANCH_REG_MASK) == BRANCH_REG_BITS) {
+        p = put_str(p, "br ");
+        return put_reg(p, decode_field(instr, 9, 5), true);
+    }
+
+    int64_t target;
+    if (!referenced_address(instr, address, &target) || !has_label(target, image_size)) {
+        return NULL;
+    }
+    if ((instr & BRANCH_MASK) == BRANCH_BITS) {
+        p = put_str(p, "b ");
+    } else {
+        const name_t *name = &condition_names[decode_field(instr, 3, 0)];
+        if (!name->length) return NULL;
+        p = put_name(p, name);
+        *p++ = ' ';
+    }
+    return p + disassemble_label(target, p);
+}
+
+static char *format_load_literal(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    char *p
+) {
+    bool sf = decode_field(instr, 30, 30);
+    uint32_t rt = decode_field(instr, 4, 0);
+
+    // The assembler only takes x registers as 64-bit literal loads
+    if (sf && rt == ZERO_REGISTER) return NULL;
+
+    int64_t target;
+    referenced_address(instr, address, &target);
+    if (target < 0) return NULL;
+
+    p = put_str(p, "ldr ");
+    p = put_reg(p, rt, sf);
+    *p++ = ',';
+    *p++ = ' ';
+    if (has_label(target, image_size)) {
+        return p + disassemble_label(target, p);
+    }
+    return put_hex(p, target);
+}
+
+static char *format_load_store(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    char *p
+) {
+    if ((instr & LOAD_LITERAL_MASK) == LOAD_LITERAL_BITS) {
+        return format_load_literal(instr, address, image_size, p);
+    }
+    if ((instr & TRANSFER_MASK) != TRANSFER_BITS) return NULL;
+
+    bool sf = decode_field(instr, 30, 30);
+    bool load = decode_field(instr, 22, 22);
+    uint32_t xn = decode_field(instr, 9, 5);
+
+    p = put_str(p, load ? "ldr " : "str ");
+    p = put_reg(p, decode_field(instr, 4, 0), sf);
+    p = put_str(p, ", [");
+    p = put_reg(p, xn, true);
+
+    if (decode_field(instr, 24, 24)) {
+        // Unsigned offset, scaled by the size of the transfer
+        uint32_t offset = decode_field(instr, 21, 10) * (sf ? 8 : 4);
+        if (offset) {
+            p = put_str(p, ", #");
+            p = put_dec(p, offset);
+        }
+        *p++ = ']';
+    } else if (decode_field(instr, 21, 21)) {
+        if (decode_field(instr, 15, 10) != REGISTER_OFFSET) return NULL;
+        p = put_sep_reg(p, decode_field(instr, 20, 16), true);
+        *p++ = ']';
+    } else {
+        if (!decode_field(instr, 10, 10)) return NULL;
+        int32_t simm9 = sign_extend(decode_field(instr, 20, 12), 9);
+        bool pre_index = decode_field(instr, 11, 11);
+        p = put_str(p, pre_index ? ", #" : "], #");
+        p = put_dec(p, simm9);
+        if (pre_index) p = put_str(p, "]!");
+    }
+    return p;
+}
+
+size_t disassemble_instruction(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    char *out
+) {
+    char *end = NULL;
+
+    switch (decode_class(instr)) {
+        case CLASS_HALT:    // and x0, x0, x0
+        case CLASS_DP_REG:
+            end = format_dp_reg(instr, out);
+            break;
+        case CLASS_DP_IMM:
+            end = format_dp_imm(instr, out);
+            break;
+        case CLASS_BRANCH:
+            end = format_branch(instr, address, image_size, out);
+            break;
+        case CLASS_LOAD_STORE:
+            end = format_load_store(instr, address, image_size, out);
+            break;
+        default:
+            break;
+    }
+
+    if (!end) {
+        end = put_str(out, ".int ");
+        end = put_hex(end, instr);
+    }
+    *end++ = '\n';
+    return end - out;
+}
@@ -0,0 +1,65 @@
+#ifndef DISASSEMBLE_H
+#define DISASSEMBLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest line disassemble_instruction writes, newline included
+#define DISASM_LINE_MAX 64
+
+/**
+ * Finds the label a branch or literal load refers to.
+ *
+ * Targets from 0 up to and including the end of the image are written
+ * as labels, so the caller places a label line (see disassemble_label)
+ * at every address this reports.
+ *
+ * @param instr The 32-bit instruction.
+ * @param address Address of the instruction.
+ * @param image_size Size of the image in bytes.
+ * @param target Set to the address of the label.
+ * @return true if the instruction refers to a label.
+ */
+bool disassemble_target(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    uint32_t *target
+);
+
+/**
+ * Writes one instruction in the assembler's syntax, ending in a newline.
+ *
+ * Aliases (`cmp`, `cmn`, `neg`, `negs`, `tst`, `mov`, `mvn`, `mul`,
+ * `mneg`) are preferred over the instructions they stand for. Words the
+ * assembler could not produce from any instruction, including encodings
+ * with bits it always sets differently, are written as `.int`
+ * directives, so the output always reassembles to the same bytes.
+ *
+ * @param instr The 32-bit instruction.
+ * @param address Address of the instruction.
+ * @param image_size Size of the image in bytes, which bounds the labels.
+ * @param out Buffer of at least DISASM_LINE_MAX bytes, not null terminated.
+ * @return The number of bytes written.
+ */
+size_t disassemble_instruction(
+    uint32_t instr,
+    uint32_t address,
+    uint32_t image_size,
+    char *out
+);
+
+/**
+ * Writes the label name of an address, `L` followed by the address in hex.
+ *
+ * @param address Address of the label.
+ * @param out Buffer of at least 10 bytes, not null terminated.
+ * @return The number of bytes written.
+ */
+size_t disassemble_label(
+    uint32_t address,
+    char *out
+);
+
+#endif
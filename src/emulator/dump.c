@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "dump.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Writes `value` as exactly `digits` lowercase hex digits
+static char *put_hex(char *p, uint64_t value, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        p[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+    return p + digits;
+}
+
+static char *put_str(char *p, const char *str) {
+    size_t len = strlen(str);
+    memcpy(p, str, len);
+    return p + len;
+}
+
+static char *put_le(char *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (char)(value >> (8 * i));
+    }
+    return p + bytes;
+}
+
+static uint32_t memory_word(STATE *state, uint64_t addr) {
+    return state->memory[addr] |
+          (state->memory[addr + 1] << 8) |
+          (state->memory[addr + 2] << 16) |
+          ((uint32_t)state->memory[addr + 3] << 24);
+}
+
+static char *format_text(STATE *state, char *p) {
+    p = put_str(p, "Registers:\n");
+    for (int i = 0; i < NUM_REGISTERS; i++) {
+        *p++ = 'X';
+        *p++ = '0' + i / 10;
+        *p++ = '0' + i % 10;
+        p = put_str(p, " = ");
+        p = put_hex(p, state->registers[i], 16);
+        *p++ = '\n';
+    }
+
+    p = put_str(p, "PC  = ");
+    p = put_hex(p, state->pc, 16);
+    *p++ = '\n';
+
+    p = put_str(p, "PSTATE : ");
+    *p++ = state->pstate.N ? 'N' : '-';
+    *p++ = state->pstate.Z ? 'Z' : '-';
+    *p++ = state->pstate.C ? 'C' : '-';
+    *p++ = state->pstate.V ? 'V' : '-';
+    *p++ = '\n';
+
+    p = put_str(p, "Non-zero Memory:\n");
+    for (uint64_t addr = 0; addr + 3 < MEMORY_SIZE; addr += 4) {
+        uint32_t word = memory_word(state, addr);
+        if (word != 0) {
+            p = put_str(p, "0x");
+            p = put_hex(p, addr, 8);
+            p = put_str(p, ": ");
+            p = put_hex(p, word, 8);
+            *p++ = '\n';
+        }
+    }
+    return p;
+}
+
+static char *format_binary(STATE *state, char *p) {
+    p = put_le(p, DUMP_BINARY_MAGIC, 4);
+    for (int i = 0; i < NUM_REGISTERS; i++) {
+        p = put_le(p, state->registers[i], 8);
+    }
+    p = put_le(p, state->pc, 8);
+    p = put_le(p, (state->pstate.N << 3) | (state->pstate.Z << 2)
+        | (state->pstate.C << 1) | state->pstate.V, 4);
+
+    // Word count is filled in once the memory has been scanned
+    char *count_pos = p;
+    p += 4;
+    uint32_t count = 0;
+    for (uint64_t addr = 0; addr + 3 < MEMORY_SIZE; addr += 4) {
+        uint32_t word = memory_word(state, addr);
+        if (word != 0) {
+            p = put_le(p, addr, 4);
+            p = put_le(p, word, 4);
+            count++;
+        }
+    }
+    put_le(count_pos, count, 4);
+    return p;
+}
+
+dump_t format_machine_state(
+    STATE *state,
+    dump_format_t format
+) {
+    // Worst case is every word of memory being non-zero
+    size_t capacity = format == DUMP_TEXT
+        ? DUMP_HEADER_LEN + (NUM_REGISTERS + 1) * DUMP_REGISTER_LINE_LEN
+            + DUMP_PSTATE_LINE_LEN + (MEMORY_SIZE / 4) * DUMP_MEMORY_LINE_LEN
+        : 4 * 3 + (NUM_REGISTERS + 1) * 8 + (MEMORY_SIZE / 4) * 8;
+
+    dump_t dump = { .data = malloc(capacity), .len = 0 };
+    if (!dump.data) {
+        perror("Failed to allocate dump buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    char *end = format == DUMP_TEXT
+        ? format_text(state, dump.data)
+        : format_binary(state, dump.data);
+    dump.len = end - dump.data;
+    return dump;
+}
+
+bool write_machine_state(
+    STATE *state,
+    FILE *fout,
+    dump_format_t format
+) {
+    dump_t dump = format_machine_state(state, format);
+
+    // Anything already buffered in the stream has to go out first
+    fflush(fout);
+    int fd = fileno(fout);
+    size_t written = 0;
+    while (written < dump.len) {
+        ssize_t n = write(fd, dump.data + written, dump.len - written);
+        if (n < 0) {
+            perror("Failed to write machine state");
+            free_dump(&dump);
+            return false;
+        }
+        written += n;
+    }
+
+    free_dump(&dump);
+    return true;
+}
+
+// Splits `text` in place into lines, returning the number of lines
+static size_t split_lines(char *text, size_t len, char ***lines) {
+    size_t count = 0, capacity = 64;
+    *lines = malloc(sizeof(char *) * capacity);
+
+    char *p = text, *end = text + len;
+    while (p < end) {
+        if (count == capacity) {
+            capacity *= 2;
+            *lines = realloc(*lines, sizeof(char *) * capacity);
+        }
+        (*lines)[count++] = p;
+        char *nl = memchr(p, '\n', end - p);
+        if (!nl) break;
+        *nl = '\0';
+        p = nl + 1;
+    }
+    return count;
+}
+
+static int is_memory_line(const char *line) {
+    return strncmp(line, "0x", 2) == 0;
+}
+
+int diff_machine_state(
+    STATE *state,
+    const char *expected_file,
+    FILE *report
+) {
+    FILE *file = fopen(expected_file, "rb");
+    if (!file) {
+        perror("Error opening expected output");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long expected_len = ftell(file);
+    rewind(file);
+
+    char *expected = malloc(expected_len + 1);
+    if (!expected || fread(expected, 1, expected_len, file) != (size_t)expected_len) {
+        fprintf(stderr, "Error reading expected output %s\n", expected_file);
+        fclose(file);
+        free(expected);
+        return -1;
+    }
+    expected[expected_len] = '\0';
+    fclose(file);
+
+    dump_t actual = format_machine_state(state, DUMP_TEXT);
+
+    char **exp_lines, **act_lines;
+    size_t n_exp = split_lines(expected, expected_len, &exp_lines);
+    size_t n_act = split_lines(actual.data, actual.len, &act_lines);
+
+    int differences = 0;
+    size_t i = 0, j = 0;
+    while (i < n_exp || j < n_act) {
+        if (i < n_exp && j < n_act && strcmp(exp_lines[i], act_lines[j]) == 0) {
+            i++;
+            j++;
+            continue;
+        }
+
+        // Line up memory words by address so one extra word is one difference
+        if (i < n_exp && j < n_act && is_memory_line(exp_lines[i]) && is_memory_line(act_lines[j])) {
+            unsigned long exp_addr = strtoul(exp_lines[i], NULL, 16);
+            unsigned long act_addr = strtoul(act_lines[j], NULL, 16);
+            if (exp_addr < act_addr) {
+                fprintf(report, "-%s\n", exp_lines[i++]);
+                differences++;
+                continue;
+            }
+            if (act_addr < exp_addr) {
+                fprintf(report, "+%s\n", act_lines[j++]);
+                differences++;
+                continue;
+            }
+        }
+
+        if (i < n_exp) fprintf(report, "-%s\n", exp_lines[i++]);
+        if (j < n_act) fprintf(report, "+%s\n", act_lines[j++]);
+        differences++;
+    }
+
+    free(exp_lines);
+    free(act_lines);
+    free(expected);
+    free_dump(&actual);
+    return differences;
+}
+
+void free_dump(
+    dump_t *dump
+) {
+    free(dump->data);
+    dump->data = NULL;
+    dump->len = 0;
+}
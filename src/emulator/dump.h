@@ -0,0 +1,97 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "machine_state.h"
+
+#define DUMP_BINARY_MAGIC 0x504D4441 // "ADMP"
+
+// Longest lines of the text format, used to size the dump buffer up front
+#define DUMP_REGISTER_LINE_LEN 23   // "X00 = 0000000000000000\n"
+#define DUMP_PSTATE_LINE_LEN 14     // "PSTATE : NZCV\n"
+#define DUMP_MEMORY_LINE_LEN 21     // "0x00000000: 00000000\n"
+#define DUMP_HEADER_LEN 64          // "Registers:\n" and "Non-zero Memory:\n"
+
+/**
+ * Output formats for a machine state dump.
+ *
+ * The binary format is the magic number, the 31 registers and the PC as
+ * little-endian 64-bit values, the flags as a 32-bit NZCV bitmask
+ * (N = bit 3), the number of non-zero words, and then an (address, word)
+ * pair of 32-bit values for each non-zero word.
+ */
+typedef enum {
+    DUMP_TEXT,
+    DUMP_BINARY
+} dump_format_t;
+
+/**
+ * A dump formatted into memory, ready to be written in one go.
+ */
+typedef struct {
+    char *data;
+    size_t len;
+} dump_t;
+
+/**
+ * Formats the machine state into a single preallocated buffer.
+ *
+ * The text format matches `print_machine_state`: registers, PC, PSTATE and
+ * every non-zero 4-byte word of memory. Hex digits are formatted by hand
+ * rather than through stdio.
+ *
+ * @param state Pointer to the machine state.
+ * @param format Text or binary format.
+ * @return The formatted dump, to be freed with `free_dump`.
+ */
+dump_t format_machine_state(
+    STATE *state,
+    dump_format_t format
+);
+
+/**
+ * Formats the machine state and writes it to a file stream with a single
+ * `write` on its file descriptor.
+ *
+ * @param state Pointer to the machine state.
+ * @param fout File stream to write to (e.g., stdout or a file).
+ * @param format Text or binary format.
+ * @return true on success, false on failure.
+ */
+bool write_machine_state(
+    STATE *state,
+    FILE *fout,
+    dump_format_t format
+);
+
+/**
+ * Compares the text dump of the machine state against an expected dump.
+ *
+ * Each mismatching line is reported to `report` as the expected line
+ * prefixed with '-' and the actual line prefixed with '+'. Memory lines
+ * are matched up by address, so a missing or extra word is reported on
+ * its own.
+ *
+ * @param state Pointer to the machine state.
+ * @param expected_file Path to the expected text dump.
+ * @param report File stream the differences are written to.
+ * @return The number of differing lines, or -1 if the file could not be read.
+ */
+int diff_machine_state(
+    STATE *state,
+    const char *expected_file,
+    FILE *report
+);
+
+/**
+ * Frees the buffer of a dump.
+ *
+ * @param dump Pointer to the dump.
+ */
+void free_dump(
+    dump_t *dump
+);
+
+#endif
@@ -2,28 +2,77 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 #include "emulate.h"
 #include "ioutils.h"
 #include "machine_state.h"
-#include "single_data_transfer.h"
-#include "data_proc.h"
-#include "utils.h"
-#include "branch_instructions.h"
-#include "dp_register.h"
+#include "execute.h"
+#include "fuzz.h"
+#include "coverage.h"
+#include "dump.h"
+
+static int usage(void) {
+    printf("Usage: ./emulate [--mmap | --asm] [--dump-format text|binary] [--expect <expected.out>]\n");
+    printf("                 [--coverage <out.info> [--linemap <file.map>]] <file_in> [<file_out>]\n");
+    printf("       ./emulate --fuzz <file_in> [<input_addr>]\n");
+    return EXIT_FAILURE;
+}
 
 int main(int argc, char **argv) {
-    
-    if (argc > 3 || argc < 2) {
-        printf("Usage: ./emulate <file_in> [<file_out>]\n");
-        return EXIT_FAILURE;
+
+    if (argc >= 3 && strcmp(argv[1], "--fuzz") == 0) {
+        if (argc > 4) return usage();
+        uint64_t input_addr = argc == 4
+            ? strtoull(argv[3], NULL, 0) : FUZZ_DEFAULT_INPUT_ADDR;
+        return fuzz_main(argv[2], input_addr);
     }
 
-    char* in_file_name = argv[1];
+    int use_mmap = 0;
+    int assemble = 0;
+    dump_format_t dump_format = DUMP_TEXT;
+    char *expected_file = NULL;
+    char *coverage_file = NULL;
+    char *linemap_file = NULL;
+    char *files[2] = { NULL, NULL }; // Input and optional output file
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mmap") == 0) {
+            use_mmap = 1;
+        } else if (strcmp(argv[i], "--asm") == 0) {
+            assemble = 1;
+        } else if (strcmp(argv[i], "--dump-format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "text") == 0) {
+                dump_format = DUMP_TEXT;
+            } else if (strcmp(argv[i], "binary") == 0) {
+                dump_format = DUMP_BINARY;
+            } else {
+                return usage();
+            }
+        } else if (strcmp(argv[i], "--expect") == 0 && i + 1 < argc) {
+            expected_file = argv[++i];
+        } else if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+            coverage_file = argv[++i];
+        } else if (strcmp(argv[i], "--linemap") == 0 && i + 1 < argc) {
+            linemap_file = argv[++i];
+        } else if (argv[i][0] != '-' && file_count < 2) {
+            files[file_count++] = argv[i];
+        } else {
+            return usage();
+        }
+    }
+
+    if (file_count == 0 || (use_mmap && assemble)) {
+        return usage();
+    }
+
+    char* in_file_name = files[0];
     FILE* file_out; // Stdout or output file pointer
 
-    if (argc == 3) {
-        create_empty_file(argv[2]);
-        file_out = load_file(argv[2], "w");
+    if (files[1]) {
+        create_empty_file(files[1]);
+        file_out = load_file(files[1], "w");
     } else {
         file_out = stdout;
     }
@@ -31,37 +80,34 @@ int main(int argc, char **argv) {
     // Loads a new state
     STATE *machine_state = new_machine_state();
 
-    load_binary_to_memory(in_file_name, machine_state->memory);
-
-    while (!machine_state->is_halted) {
-        // Fetch
-        uint32_t instr_curr = fetch_next_instruction(machine_state);
-        // After decoding the instruction, if we see that it's a branch instruction do not change pc
-        // If it's not, add 4 
-
-        // Decode logic
-        uint32_t op0 = getRangeInt(instr_curr, 28, 25);
-
-        if (instr_curr == HALT_INSTR) {
-            machine_state->is_halted = 1;
-        } else if (IS_BRANCH(op0)) {
-            branch(machine_state, instr_curr);
-        } else if (IS_DP_IMM(op0)) {
-            data_proc_imm(machine_state, instr_curr);
-            machine_state->pc += PC_INCREMENT;
-        } else if (IS_DP_REG(op0)) {
-            data_proc_reg(machine_state, instr_curr);
-            machine_state->pc += PC_INCREMENT;
-        } else if (IS_LOAD_STORE(op0)) {
-            data_transfer(machine_state, instr_curr);
-            machine_state->pc += PC_INCREMENT;
-        } else {
-            fprintf(stderr, "The instruction does not exist");
-            machine_state->is_halted = 1;
+    // With --asm the input is assembly source, assembled straight into memory
+    size_t image_size = assemble
+        ? assemble_to_memory(in_file_name, machine_state->memory)
+        : use_mmap
+        ? map_binary_to_memory(in_file_name, machine_state->memory)
+        : load_binary_to_memory(in_file_name, machine_state->memory);
+
+    if (coverage_file) {
+        coverage_enable();
+    }
+
+    run_machine(machine_state, 0);
+
+    int status = EXIT_SUCCESS;
+
+    if (expected_file) {
+        // Report differences from the expected dump instead of the dump itself
+        if (diff_machine_state(machine_state, expected_file, file_out) != 0) {
+            status = EXIT_FAILURE;
         }
+    } else if (!write_machine_state(machine_state, file_out, dump_format)) {
+        status = EXIT_FAILURE;
     }
 
-    print_machine_state(machine_state, file_out);
+    if (coverage_file && !coverage_write_lcov(coverage_file, linemap_file,
+            in_file_name, machine_state, image_size)) {
+        status = EXIT_FAILURE;
+    }
 
-    return EXIT_SUCCESS;
+    return status;
 }
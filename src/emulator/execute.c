@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "emulate.h"
+#include "execute.h"
+#include "decode.h"
+#include "machine_state.h"
+#include "single_data_transfer.h"
+#include "data_proc.h"
+#include "utils.h"
+#include "branch_instructions.h"
+#include "dp_register.h"
+#include "coverage.h"
+
+void execute_instruction(
+    STATE *state,
+    uint32_t instr
+) {
+    // After decoding the instruction, if we see that it's a branch instruction do not change pc
+    // If it's not, add 4 
+    switch (decode_class(instr)) {
+        case CLASS_HALT:
+            state->is_halted = 1;
+            break;
+        case CLASS_BRANCH:
+            branch(state, instr);
+            break;
+        case CLASS_DP_IMM:
+            data_proc_imm(state, instr);
+            state->pc += PC_INCREMENT;
+            break;
+        case CLASS_DP_REG:
+            data_proc_reg(state, instr);
+            state->pc += PC_INCREMENT;
+            break;
+        case CLASS_LOAD_STORE:
+            data_transfer(state, instr);
+            state->pc += PC_INCREMENT;
+            break;
+        default:
+            fprintf(stderr, "The instruction does not exist");
+            state->is_halted = 1;
+            break;
+    }
+}
+
+uint64_t run_machine(
+    STATE *state,
+    uint64_t max_steps
+) {
+    uint64_t steps = 0;
+
+    while (!state->is_halted && (max_steps == 0 || steps < max_steps)) {
+        COVERAGE_RECORD_EXEC(state->pc);
+        execute_instruction(state, fetch_next_instruction(state));
+        steps++;
+    }
+    return steps;
+}
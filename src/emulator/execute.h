@@ -0,0 +1,34 @@
+#ifndef EXECUTE_H
+#define EXECUTE_H
+
+#include <stdint.h>
+#include "machine_state.h"
+
+/**
+ * Decodes and executes a single instruction.
+ *
+ * Dispatches on bits 28-25 of the instruction to the branch, data
+ * processing or data transfer handlers, advancing the PC for every
+ * non-branch instruction. The halt instruction sets `is_halted`.
+ *
+ * @param state Pointer to the machine state.
+ * @param instr The 32-bit instruction to execute.
+ */
+void execute_instruction(
+    STATE *state,
+    uint32_t instr
+);
+
+/**
+ * Runs the fetch-decode-execute cycle until the machine halts.
+ *
+ * @param state Pointer to the machine state.
+ * @param max_steps Maximum number of instructions to execute, or 0 for no limit.
+ * @return The number of instructions executed.
+ */
+uint64_t run_machine(
+    STATE *state,
+    uint64_t max_steps
+);
+
+#endif
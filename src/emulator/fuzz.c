@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/shm.h>
+#include "fuzz.h"
+#include "execute.h"
+#include "ioutils.h"
+#include "machine_state.h"
+
+uint8_t *fuzz_edge_map = NULL;
+
+static uint32_t *shm_input_len = NULL; // AFL shared memory testcase, if offered
+static uint8_t *shm_input = NULL;
+static volatile int in_guest = 0;
+
+void fuzz_record_edge(
+    uint64_t from,
+    uint64_t to
+) {
+    // Instructions are word aligned, so drop the low bits before mixing
+    uint32_t prev = (uint32_t)((from >> 2) * 0x9E3779B1u);
+    uint32_t cur = (uint32_t)((to >> 2) * 0x85EBCA6Bu);
+    fuzz_edge_map[((prev >> 1) ^ cur) & (FUZZ_MAP_SIZE - 1)]++;
+}
+
+// Emulator errors exit(); while running guest code turn them into crashes
+static void abort_on_guest_exit(void) {
+    if (in_guest) abort();
+}
+
+static void *attach_shm(const char *env_var) {
+    const char *id = getenv(env_var);
+    if (!id) return NULL;
+
+    void *map = shmat(atoi(id), NULL, 0);
+    if (map == (void *)-1) {
+        perror("Failed to attach AFL shared memory");
+        exit(EXIT_FAILURE);
+    }
+    return map;
+}
+
+// Reads the next input into `buf`, returning its length
+static size_t read_input(uint8_t *buf, size_t max_len) {
+    if (shm_input_len) {
+        size_t len = *shm_input_len < max_len ? *shm_input_len : max_len;
+        memcpy(buf, shm_input, len);
+        return len;
+    }
+
+    // afl-fuzz rewrites the same file behind stdin for every run
+    lseek(STDIN_FILENO, 0, SEEK_SET);
+    size_t len = 0;
+    ssize_t n;
+    while (len < max_len && (n = read(STDIN_FILENO, buf + len, max_len - len)) > 0) {
+        len += n;
+    }
+    return len;
+}
+
+static void run_input(
+    STATE *state,
+    const STATE *snapshot,
+    uint64_t input_addr
+) {
+    copy_machine_state(state, snapshot);
+
+    size_t len = read_input(&state->memory[input_addr], MEMORY_SIZE - input_addr);
+    set_register(state, 0, input_addr, 0);
+    set_register(state, 1, len, 0);
+
+    in_guest = 1;
+    run_machine(state, FUZZ_MAX_STEPS);
+    in_guest = 0;
+}
+
+// Classic AFL fork server. Returns in each forked child, which then runs
+// up to FUZZ_PERSISTENT_ITERATIONS inputs, stopping itself between them.
+static void fork_server(void) {
+    uint32_t status = 0;
+    uint32_t was_killed;
+    pid_t child = -1;
+    int child_stopped = 0;
+
+    while (1) {
+        if (read(FUZZ_FORKSRV_FD, &was_killed, 4) != 4) _exit(0);
+
+        // A stopped child that afl-fuzz killed on timeout has to be reaped
+        if (child_stopped && was_killed) {
+            child_stopped = 0;
+            if (waitpid(child, (int *)&status, 0) < 0) _exit(1);
+        }
+
+        if (!child_stopped) {
+            child = fork();
+            if (child < 0) _exit(1);
+            if (child == 0) {
+                close(FUZZ_FORKSRV_FD);
+                close(FUZZ_FORKSRV_FD + 1);
+                return;
+            }
+        } else {
+            kill(child, SIGCONT);
+            child_stopped = 0;
+        }
+
+        if (write(FUZZ_FORKSRV_FD + 1, &child, 4) != 4) _exit(1);
+        if (waitpid(child, (int *)&status, WUNTRACED) < 0) _exit(1);
+        if (WIFSTOPPED(status)) child_stopped = 1;
+        if (write(FUZZ_FORKSRV_FD + 1, &status, 4) != 4) _exit(1);
+    }
+}
+
+int fuzz_main(
+    const char *filename,
+    uint64_t input_addr
+) {
+    if (input_addr >= MEMORY_SIZE) {
+        fprintf(stderr, "Fuzz input address out of bounds: 0x%" PRIx64 "\n", input_addr);
+        return EXIT_FAILURE;
+    }
+
+    STATE *snapshot = new_machine_state();
+    STATE *state = new_machine_state();
+    load_binary_to_memory(filename, snapshot->memory);
+
+    fuzz_edge_map = attach_shm(FUZZ_SHM_ENV_VAR);
+    atexit(abort_on_guest_exit);
+
+    // Say hello to afl-fuzz; if nobody is listening we replay one input
+    uint32_t hello = getenv(FUZZ_SHM_FUZZ_ENV_VAR)
+        ? (FUZZ_OPT_ENABLED | FUZZ_OPT_SHDMEM_FUZZ) : 0;
+    if (write(FUZZ_FORKSRV_FD + 1, &hello, 4) != 4) {
+        run_input(state, snapshot, input_addr);
+        print_machine_state(state, stdout);
+        free_machine_state(state);
+        free_machine_state(snapshot);
+        return EXIT_SUCCESS;
+    }
+
+    if (hello) {
+        uint32_t options;
+        if (read(FUZZ_FORKSRV_FD, &options, 4) != 4) _exit(1);
+        if ((options & (FUZZ_OPT_ENABLED | FUZZ_OPT_SHDMEM_FUZZ))
+                == (FUZZ_OPT_ENABLED | FUZZ_OPT_SHDMEM_FUZZ)) {
+            shm_input_len = attach_shm(FUZZ_SHM_FUZZ_ENV_VAR);
+            shm_input = (uint8_t *)(shm_input_len + 1);
+        }
+    }
+
+    fork_server();
+
+    for (int i = 0; i < FUZZ_PERSISTENT_ITERATIONS; i++) {
+        // Wait for the fork server to hand us the next input
+        if (i > 0) raise(SIGSTOP);
+        run_input(state, snapshot, input_addr);
+    }
+
+    free_machine_state(state);
+    free_machine_state(snapshot);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdint.h>
+#include "machine_state.h"
+
+#define FUZZ_MAP_SIZE (1 << 16)          // AFL edge bitmap size
+#define FUZZ_FORKSRV_FD 198               // AFL control pipe, status pipe is +1
+#define FUZZ_SHM_ENV_VAR "__AFL_SHM_ID"
+#define FUZZ_SHM_FUZZ_ENV_VAR "__AFL_SHM_FUZZ_ID"
+#define FUZZ_OPT_ENABLED 0x80000001
+#define FUZZ_OPT_SHDMEM_FUZZ 0x01000000
+#define FUZZ_DEFAULT_INPUT_ADDR 0x100000  // Guest address inputs are patched to
+#define FUZZ_PERSISTENT_ITERATIONS 10000  // Runs per child before re-forking
+#define FUZZ_MAX_STEPS (1 << 24)          // Instruction budget per run
+
+/**
+ * AFL-compatible edge coverage bitmap, or NULL when not fuzzing.
+ */
+extern uint8_t *fuzz_edge_map;
+
+/**
+ * Records a control flow edge if an edge map is attached. Cheap enough
+ * to leave in the branch handlers when not fuzzing.
+ */
+#define FUZZ_RECORD_EDGE(from, to) do { \
+    if (fuzz_edge_map) fuzz_record_edge((from), (to)); \
+} while (0)
+
+/**
+ * Bumps the hit counter for the edge `from` -> `to` in the edge map.
+ *
+ * @param from Address of the branch instruction.
+ * @param to Address the branch transferred control to.
+ */
+void fuzz_record_edge(
+    uint64_t from,
+    uint64_t to
+);
+
+/**
+ * Runs the emulator in persistent fuzzing mode.
+ *
+ * The binary is loaded once and the machine state snapshotted. For every
+ * input the snapshot is restored, the input is copied to `input_addr` in
+ * guest memory (with X0 = `input_addr` and X1 = input length) and the
+ * program is run until it halts or exhausts its instruction budget.
+ *
+ * Under afl-fuzz (control pipes open) this runs the AFL fork server with
+ * persistent children, reading inputs from the AFL shared memory testcase
+ * buffer when offered and from stdin otherwise. Standalone, a single input
+ * is read from stdin and the final state is printed, so crashes found by
+ * the fuzzer can be replayed.
+ *
+ * Guest faults (e.g. out of bounds memory accesses) abort the process so
+ * that AFL reports them as crashes.
+ *
+ * @param filename Path to the binary to fuzz.
+ * @param input_addr Guest address the input is copied to.
+ * @return Exit status for the emulator.
+ */
+int fuzz_main(
+    const char *filename,
+    uint64_t input_addr
+);
+
+#endif
@@ -1,8 +1,16 @@
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ioutils.h"
 #include "machine_state.h"
 #include "utils.h"
+#include "dump.h"
+#include "../assembler/libasm.h"
+#include "../assembler/diagnostics.h"
 
 void create_empty_file(
     const char *filename
@@ -47,6 +55,71 @@ size_t load_binary_to_memory(
     return bytes_read;
 }
 
+size_t map_binary_to_memory(
+    const char *filename, 
+    uint8_t *memory
+) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror("Error opening file");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = st.st_size < MEMORY_SIZE ? (size_t)st.st_size : MEMORY_SIZE;
+    if (size > 0) {
+        // The tail of the last page past the end of the file reads as zero
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t mapped_size = (size + page_size - 1) / page_size * page_size;
+        void *image = mmap(memory, mapped_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (image == MAP_FAILED) {
+            perror("Error mapping file");
+            exit(EXIT_FAILURE);
+        }
+    }
+    close(fd);
+
+    return size;
+}
+
+size_t assemble_to_memory(
+    const char *filename,
+    uint8_t *memory
+) {
+    FILE *file = load_file(filename, "rb");
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *source = malloc(length > 0 ? length : 1);
+    if (!source || length < 0 || fread(source, 1, length, file) != (size_t)length) {
+        perror("Error reading file");
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+
+    uint32_t *words;
+    size_t count;
+    // Errors name the source, as they do from assemble
+    const char *previous_file = diag_file();
+    diag_set_file(filename);
+    int errors = asm_assemble_buffer(source, length, &words, &count);
+    diag_set_file(previous_file);
+    free(source);
+    if (errors > 0) {
+        fprintf(stderr, "Failed to assemble %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = count * sizeof(uint32_t);
+    if (size > MEMORY_SIZE) size = MEMORY_SIZE;
+    memcpy(memory, words, size);
+    free(words);
+
+    return size;
+}
+
 FILE* load_file(
     const char* filename, 
     const char* mode
@@ -63,31 +136,7 @@ void print_machine_state(
     STATE *state, 
     FILE *fout
 ) {
-    // Registers
-    fprintf(fout, "Registers:\n");
-    for (int i = 0; i < NUM_REGISTERS; i++) {
-        fprintf(fout, "X%02d = %016" PRIx64 "\n", i, state->registers[i]);
-    }
-
-    // PC
-    fprintf(fout, "PC  = %016" PRIx64 "\n", state->pc);
-
-    // PSTATE
-    fprintf(fout, "PSTATE : ");
-    fprintf(fout, "%c", state->pstate.N ? 'N' : '-');
-    fprintf(fout, "%c", state->pstate.Z ? 'Z' : '-');
-    fprintf(fout, "%c", state->pstate.C ? 'C' : '-');
-    fprintf(fout, "%c\n", state->pstate.V ? 'V' : '-');
-
-    // Non-zero memory
-    fprintf(fout, "Non-zero Memory:\n");
-    for (uint64_t addr = 0; addr + 3 < MEMORY_SIZE; addr += 4) {
-        // Reads 4 bytes as a little-endian 32-bit word
-        uint32_t word = load_word(state, addr);
-
-        if (word != 0) {
-            fprintf(fout, "0x%08" PRIx64 ": %08x\n", addr, word);
-        }
+    if (!write_machine_state(state, fout, DUMP_TEXT)) {
+        exit(EXIT_FAILURE);
     }
-
 }
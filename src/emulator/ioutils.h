@@ -22,6 +22,40 @@ size_t load_binary_to_memory(
     unsigned char* memory
 );
 
+/**
+ * Maps a binary file directly into the machine's memory.
+ *
+ * The file is mapped privately (copy-on-write) over the start of
+ * `memory`, which must be a page aligned mapping of `MEMORY_SIZE` bytes,
+ * so nothing is copied at startup and unmodified pages are shared through
+ * the page cache by every emulator running the same image. Files larger
+ * than `MEMORY_SIZE` are truncated.
+ *
+ * @param filename Path to the binary file to map.
+ * @param memory Pointer to the page aligned guest memory.
+ * @return The number of bytes of the file that were mapped.
+ */
+size_t map_binary_to_memory(
+    const char *filename, 
+    uint8_t *memory
+);
+
+/**
+ * Assembles a source file in memory and loads the words into memory.
+ *
+ * The assembler is linked in as a library, so no binary is written or
+ * read back. Exits if the source has errors. Programs larger than
+ * `MEMORY_SIZE` are truncated.
+ *
+ * @param filename Path to the assembly source.
+ * @param memory Pointer to the memory buffer where the words will be written.
+ * @return The number of bytes loaded.
+ */
+size_t assemble_to_memory(
+    const char *filename,
+    uint8_t *memory
+);
+
 /**
  * Opens a file safely with error checking.
  *
@@ -63,6 +97,9 @@ void write_to_file(
  * - The processor flags PSTATE
  * - All non-zero 4-byte memory values
  *
+ * The whole dump is formatted into one buffer and written with a single
+ * `write` (see `write_machine_state`).
+ *
  * @param state Pointer to the machine state.
  * @param fout File stream to print to (e.g., stdout or a file).
  */
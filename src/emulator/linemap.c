@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "linemap.h"
+
+bool linemap_write(
+    const char *filename,
+    const char *source,
+    const linemap_entry_t *entries,
+    uint32_t count
+) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("Failed to open line map for writing");
+        return false;
+    }
+
+    uint32_t header[3] = { LINEMAP_MAGIC, count, (uint32_t)strlen(source) };
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1
+        && fwrite(source, 1, header[2], file) == header[2]
+        && fwrite(entries, sizeof(linemap_entry_t), count, file) == count;
+
+    if (fclose(file) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Failed to write line map %s\n", filename);
+    return ok;
+}
+
+linemap_t *linemap_load(
+    const char *filename
+) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    uint32_t header[3];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != LINEMAP_MAGIC) {
+        fprintf(stderr, "Invalid line map %s\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    linemap_t *map = malloc(sizeof(linemap_t));
+    if (!map) {
+        fclose(file);
+        return NULL;
+    }
+    map->count = header[1];
+    map->source = malloc((size_t)header[2] + 1);
+    map->entries = malloc(sizeof(linemap_entry_t) * (map->count ? map->count : 1));
+
+    if (!map->source || !map->entries
+            || fread(map->source, 1, header[2], file) != header[2]
+            || fread(map->entries, sizeof(linemap_entry_t), map->count, file) != map->count) {
+        fprintf(stderr, "Truncated line map %s\n", filename);
+        fclose(file);
+        linemap_free(map);
+        return NULL;
+    }
+    map->source[header[2]] = '\0';
+
+    fclose(file);
+    return map;
+}
+
+uint32_t linemap_lookup(
+    const linemap_t *map,
+    uint64_t address
+) {
+    // Binary search, the entries are sorted by address
+    uint32_t lo = 0, hi = map->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (map->entries[mid].address < address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < map->count && map->entries[lo].address == address) {
+        return map->entries[lo].line;
+    }
+    return 0;
+}
+
+void linemap_free(
+    linemap_t *map
+) {
+    if (map == NULL) return;
+    free(map->source);
+    free(map->entries);
+    free(map);
+}
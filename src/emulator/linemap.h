@@ -0,0 +1,78 @@
+#ifndef LINEMAP_H
+#define LINEMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LINEMAP_MAGIC 0x314D4C41 // "ALM1"
+
+/**
+ * Maps the address of one instruction to the source line it came from.
+ */
+typedef struct {
+    uint32_t address;
+    uint32_t line;
+} linemap_entry_t;
+
+/**
+ * Address to source line table, emitted by the assembler and read by
+ * the emulator's coverage tooling.
+ *
+ * On disk the table is the magic number, the entry count, the length of
+ * the source path, the source path itself and then the entries, sorted by
+ * address. Only instructions have entries; data directives do not.
+ */
+typedef struct {
+    char *source;
+    linemap_entry_t *entries;
+    uint32_t count;
+} linemap_t;
+
+/**
+ * Writes an address to line table to a file.
+ *
+ * @param filename Path to the output file.
+ * @param source Path of the assembly source the entries refer to.
+ * @param entries Entries sorted by address.
+ * @param count Number of entries.
+ * @return true on success, false on failure.
+ */
+bool linemap_write(
+    const char *filename,
+    const char *source,
+    const linemap_entry_t *entries,
+    uint32_t count
+);
+
+/**
+ * Loads an address to line table from a file.
+ *
+ * @param filename Path to the table.
+ * @return Pointer to the loaded table (must be freed with linemap_free), or NULL on failure.
+ */
+linemap_t *linemap_load(
+    const char *filename
+);
+
+/**
+ * Looks up the source line of the instruction at `address`.
+ *
+ * @param map Pointer to the table.
+ * @param address Address of the instruction.
+ * @return The source line, or 0 if the address is not an instruction.
+ */
+uint32_t linemap_lookup(
+    const linemap_t *map,
+    uint64_t address
+);
+
+/**
+ * Frees a table returned by linemap_load.
+ *
+ * @param map Pointer to the table to free.
+ */
+void linemap_free(
+    linemap_t *map
+);
+
+#endif
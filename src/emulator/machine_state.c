@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <sys/mman.h>
 
 STATE *new_machine_state(void) {
     STATE *state = malloc(sizeof(STATE));
@@ -14,14 +15,34 @@ STATE *new_machine_state(void) {
     memset(state, 0, sizeof(STATE));
     // With exception of PSTATE: N=0, Z=1, C=0, V=0
     state->pstate.Z = 1;
+
+    // Anonymous mappings are zero filled
+    state->memory = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (state->memory == MAP_FAILED) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
     return state;
 }
 
 void free_machine_state(
     STATE *state
 ) {
-    if (state != NULL) 
+    if (state != NULL) {
+        munmap(state->memory, MEMORY_SIZE);
         free(state);
+    }
+}
+
+void copy_machine_state(
+    STATE *dst,
+    const STATE *src
+) {
+    uint8_t *memory = dst->memory;
+    *dst = *src;
+    dst->memory = memory;
+    memcpy(dst->memory, src->memory, MEMORY_SIZE);
 }
 
 uint64_t get_register(
@@ -28,14 +28,14 @@ typedef struct {
  * - General-purpose registers (X0 to X30, XZR)
  * - Program counter (`pc`)
  * - Condition flags (`pstate`)
- * - Memory space
+ * - Memory space, a page aligned mapping of `MEMORY_SIZE` bytes
  * - Halt status
  */
 typedef struct {
     uint64_t registers[NUM_REGISTERS]; 
     uint64_t pc;
     PSTATE pstate;
-    uint8_t memory[MEMORY_SIZE];
+    uint8_t *memory;
     int is_halted;
 } STATE;
 
@@ -44,6 +44,8 @@ typedef struct {
  *
  * All memory, registers, and flags are initialized to 0,
  * except for the Zero (Z) flag which is initialized to 1.
+ * Memory is an anonymous page aligned mapping so that binaries
+ * can be mapped directly over it (see `map_binary_to_memory`).
  *
  * @return Pointer to the newly allocated STATE structure.
  */
@@ -58,6 +60,19 @@ void free_machine_state(
     STATE *state
 );
 
+/**
+ * Copies the complete machine state (registers, flags and memory) from
+ * `src` into `dst`. Used to snapshot a loaded machine and restore it
+ * between runs without reloading the binary.
+ *
+ * @param dst Pointer to the machine state to overwrite.
+ * @param src Pointer to the machine state to copy from.
+ */
+void copy_machine_state(
+    STATE *dst,
+    const STATE *src
+);
+
 /**
  * Returns the value stored in the given register. For 32-bit access,
  * only the lower 32 bits are returned. Access to register 31 always returns 0.